@@ -0,0 +1,775 @@
+#include "../include/MiniSearchEngine.h"
+#include "../include/ShardedSearchEngine.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+/**
+ * engine_bench: Indexing throughput, query latency percentiles, QPS across
+ * thread counts and index bytes per document, written as one JSON object
+ * so runs can be compared across versions. Progress goes to stderr.
+ *
+ * Usage: engine_bench [--docs N] [--vocabulary V] [--zipf S] [--corpus file]
+ *                     [--queries N] [--query-log file] [--threads 1,2,4]
+ *                     [--k K] [--no-snippets] [--codec raw|varbyte|bitpacked]
+ *                     [--label text] [--seed N] [--stop-words english|N]
+ *                     [--stemming] [--impact 1,0.5,0.1] [--shards 1,2,4]
+ *                     [--async N] [--pages N]
+ *
+ * Phase times come from a separate pass with every query sampled, so the
+ * latency pass itself never reads the clock more than once per query.
+ *
+ * Without --corpus, documents come from a Zipfian synthetic generator and are
+ * added one addDocument() call at a time; with it, the pipe-separated file
+ * is indexed by loadFromFile(). Without --query-log, queries are drawn from
+ * the same vocabulary and replayed with Zipfian repeats, like a real log.
+ * --stop-words N drops the N most frequent synthetic words. --impact builds
+ * impact-ordered lists and replays the log through searchImpacts() at each
+ * posting fraction, reporting the overlap of its top k with that of an
+ * exhaustive impact ranking and of search() under BM25. --shards indexes
+ * the corpus again into a ShardedSearchEngine of each size and reports its
+ * latency, its QPS at the largest thread count and how often its top k is
+ * identical to the single engine's. --async N replays the log against the
+ * saved index with its pages evicted, once with search() on the largest
+ * thread count and once through searchAsync() on as many async threads
+ * with N queries in flight. --pages N reads the first N pages of k results
+ * of distinct logged queries, once by asking search() for all results up
+ * to each page and once through searchAfter() cursors, and reports the
+ * mean cost of a page and of the last page for both.
+ */
+
+struct BenchOptions {
+    size_t documents;
+    size_t vocabulary;
+    double zipfExponent;
+    string corpusFile;
+    size_t queries;
+    string queryLog;
+    vector<unsigned> threads;
+    int maxResults;
+    bool withSnippets;
+    PostingCodec codec;
+    string label;
+    unsigned seed;
+    string stopWords;       // "english", a count of top synthetic words, or empty
+    bool stemming;
+    vector<double> impactFractions;     // Empty unless impact ranking is measured
+    vector<size_t> shardCounts;         // Empty unless sharded engines are measured
+    size_t asyncDepth;                  // Queries in flight for searchAsync(); 0 skips it
+    size_t pages;                       // Pages read per query for pagination; 0 skips it
+
+    BenchOptions()
+        : documents(100000), vocabulary(50000), zipfExponent(1.0), queries(20000),
+          maxResults(10), withSnippets(true), codec(PostingCodec::VarByte), seed(42),
+          stemming(false), asyncDepth(0), pages(0) {}
+};
+
+/**
+ * ZipfSampler: Draws ranks 0..n-1 with probability proportional to 1/(rank+1)^s
+ */
+class ZipfSampler {
+private:
+    vector<double> cumulative;
+
+public:
+    ZipfSampler(size_t n, double exponent) : cumulative(n) {
+        double total = 0.0;
+        for (size_t rank = 0; rank < n; ++rank) {
+            total += 1.0 / pow(static_cast<double>(rank + 1), exponent);
+            cumulative[rank] = total;
+        }
+    }
+
+    size_t sample(mt19937& rng) const {
+        double target = uniform_real_distribution<double>(0.0, cumulative.back())(rng);
+        size_t rank = static_cast<size_t>(upper_bound(cumulative.begin(), cumulative.end(), target) -
+                                          cumulative.begin());
+        return min(rank, cumulative.size() - 1);
+    }
+};
+
+/**
+ * SyntheticCorpus: Pronounceable words whose frequencies follow Zipf's law;
+ * frequent words get the shortest spellings, as in natural language
+ */
+class SyntheticCorpus {
+private:
+    vector<string> words;
+    ZipfSampler sampler;
+    mt19937 rng;
+
+public:
+    SyntheticCorpus(size_t vocabulary, double exponent, unsigned seed)
+        : sampler(vocabulary, exponent), rng(seed) {
+        static const char consonants[] = "bcdfghjklmnprstv";
+        static const char vowels[] = "aeiou";
+        const size_t syllables = 16 * 5;
+        for (size_t rank = 0; rank < vocabulary; ++rank) {
+            // Base-80 digits of the rank, one consonant-vowel syllable each,
+            // at least two so every word survives the tokenizer's length cut
+            string word;
+            size_t value = rank;
+            do {
+                word += consonants[value % syllables / 5];
+                word += vowels[value % 5];
+                value /= syllables;
+            } while (value > 0 || word.size() < 4);
+            words.push_back(word);
+        }
+    }
+
+    const string& word() { return words[sampler.sample(rng)]; }
+    const string& wordOfRank(size_t rank) const { return words[rank]; }
+
+    string text(size_t wordCount) {
+        string text;
+        for (size_t i = 0; i < wordCount; ++i) {
+            if (i > 0) text += (rng() % 12 == 0) ? ". " : " ";
+            text += word();
+        }
+        return text;
+    }
+
+    // Title of 2-8 words and content of 20-300 words, skewed short
+    void document(string& title, string& content) {
+        title = text(2 + rng() % 7);
+        size_t length = 20 + static_cast<size_t>(exponential_distribution<double>(1.0 / 100)(rng));
+        content = text(min<size_t>(length, 300));
+    }
+
+    // 1-4 words, two-word queries being the most common
+    string query() {
+        static const int lengths[] = {1, 1, 1, 2, 2, 2, 2, 3, 3, 4};
+        return text(static_cast<size_t>(lengths[rng() % 10]));
+    }
+
+    mt19937& random() { return rng; }
+};
+
+static bool parseCodec(const string& name, PostingCodec& codec) {
+    if (name == "raw") codec = PostingCodec::Raw;
+    else if (name == "varbyte") codec = PostingCodec::VarByte;
+    else if (name == "bitpacked") codec = PostingCodec::BitPacked;
+    else return false;
+    return true;
+}
+
+static bool parseOptions(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        string flag = argv[i];
+        if (flag == "--no-snippets") {
+            options.withSnippets = false;
+            continue;
+        }
+        if (flag == "--stemming") {
+            options.stemming = true;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        string value = argv[++i];
+        if (flag == "--docs") options.documents = strtoul(value.c_str(), nullptr, 10);
+        else if (flag == "--vocabulary") options.vocabulary = strtoul(value.c_str(), nullptr, 10);
+        else if (flag == "--zipf") options.zipfExponent = atof(value.c_str());
+        else if (flag == "--corpus") options.corpusFile = value;
+        else if (flag == "--queries") options.queries = strtoul(value.c_str(), nullptr, 10);
+        else if (flag == "--query-log") options.queryLog = value;
+        else if (flag == "--k") options.maxResults = atoi(value.c_str());
+        else if (flag == "--label") options.label = value;
+        else if (flag == "--seed") options.seed = static_cast<unsigned>(strtoul(value.c_str(), nullptr, 10));
+        else if (flag == "--stop-words") options.stopWords = value;
+        else if (flag == "--async") options.asyncDepth = strtoul(value.c_str(), nullptr, 10);
+        else if (flag == "--pages") options.pages = strtoul(value.c_str(), nullptr, 10);
+        else if (flag == "--codec") {
+            if (!parseCodec(value, options.codec)) return false;
+        } else if (flag == "--impact") {
+            stringstream list(value);
+            string item;
+            while (getline(list, item, ',')) {
+                double fraction = atof(item.c_str());
+                if (fraction <= 0.0) return false;
+                options.impactFractions.push_back(fraction);
+            }
+        } else if (flag == "--shards") {
+            stringstream list(value);
+            string item;
+            while (getline(list, item, ',')) {
+                size_t count = strtoul(item.c_str(), nullptr, 10);
+                if (count == 0) return false;
+                options.shardCounts.push_back(count);
+            }
+        } else if (flag == "--threads") {
+            options.threads.clear();
+            stringstream list(value);
+            string item;
+            while (getline(list, item, ',')) {
+                unsigned count = static_cast<unsigned>(strtoul(item.c_str(), nullptr, 10));
+                if (count > 0) options.threads.push_back(count);
+            }
+        } else {
+            return false;
+        }
+    }
+    if (options.threads.empty()) {
+        unsigned cores = max(1u, thread::hardware_concurrency());
+        for (unsigned count = 1; count < cores; count *= 2) options.threads.push_back(count);
+        options.threads.push_back(cores);
+    }
+    return options.vocabulary > 0 && options.maxResults > 0;
+}
+
+static double secondsSince(chrono::steady_clock::time_point begin) {
+    return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+// Value at quantile q of sorted samples (nearest rank)
+static double percentile(const vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = static_cast<size_t>(ceil(q * static_cast<double>(sorted.size())));
+    return sorted[min(sorted.size(), max<size_t>(rank, 1)) - 1];
+}
+
+static string jsonString(const string& text) {
+    string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+// Drops the file's pages from the page cache, so the next reads go to disk
+static void evictFile(const string& path) {
+#if !defined(_WIN32)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+#endif
+}
+
+static size_t fileSize(const string& path) {
+    ifstream file(path, ios::binary | ios::ate);
+    return file ? static_cast<size_t>(file.tellg()) : 0;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        cerr << "Usage: engine_bench [--docs N] [--vocabulary V] [--zipf S] [--corpus file]"
+                " [--queries N] [--query-log file] [--threads 1,2,4] [--k K] [--no-snippets]"
+                " [--codec raw|varbyte|bitpacked] [--label text] [--seed N]"
+                " [--stop-words english|N] [--stemming] [--impact 1,0.5,0.1]"
+                " [--shards 1,2,4] [--async N] [--pages N]" << endl;
+        return 1;
+    }
+
+    SyntheticCorpus corpus(options.vocabulary, options.zipfExponent, options.seed);
+    AnalyzerOptions analysis;
+    analysis.stemming = options.stemming;
+    if (options.stopWords == "english") {
+        analysis.stopWords = AnalyzerOptions::englishStopWords();
+    } else if (!options.stopWords.empty()) {
+        size_t count = min<size_t>(strtoul(options.stopWords.c_str(), nullptr, 10), options.vocabulary);
+        for (size_t rank = 0; rank < count; ++rank) analysis.stopWords.push_back(corpus.wordOfRank(rank));
+    }
+    MiniSearchEngine engine(options.codec, analysis);
+    if (!options.impactFractions.empty()) engine.setImpactOrdering(true);
+    cout << fixed << setprecision(3);
+
+    // Indexing, including publishing and any merges it triggers
+    size_t documents = 0;
+    size_t inputBytes = 0;
+    double indexSeconds = 0.0;
+    vector<Document> shardInput;    // Kept for the sharded engines
+    if (options.corpusFile.empty()) {
+        cerr << "Indexing " << options.documents << " synthetic documents..." << endl;
+        vector<Document> batch;
+        batch.reserve(options.documents);
+        for (size_t i = 0; i < options.documents; ++i) {
+            Document doc(static_cast<int>(i), "", "", "https://example.com/" + to_string(i));
+            corpus.document(doc.title, doc.content);
+            inputBytes += doc.title.size() + doc.content.size() + doc.url.size();
+            batch.push_back(move(doc));
+        }
+        auto begin = chrono::steady_clock::now();
+        for (const Document& doc : batch) engine.addDocument(doc.title, doc.content, doc.url);
+        engine.refresh();
+        engine.waitForMerges();
+        indexSeconds = secondsSince(begin);
+        documents = batch.size();
+        if (!options.shardCounts.empty()) shardInput = move(batch);
+    } else {
+        cerr << "Loading " << options.corpusFile << "..." << endl;
+        auto begin = chrono::steady_clock::now();
+        LoadStats loaded = engine.loadFromFile(options.corpusFile);
+        engine.refresh();
+        engine.waitForMerges();
+        indexSeconds = secondsSince(begin);
+        if (!loaded.opened || loaded.documents == 0) {
+            cerr << "Could not load documents from " << options.corpusFile << endl;
+            return 1;
+        }
+        documents = loaded.documents;
+        inputBytes = loaded.bytes;
+        if (!options.shardCounts.empty()) {
+            DocumentReader reader(options.corpusFile);
+            DocumentFields fields;
+            while (reader.next(fields)) {
+                int id = static_cast<int>(shardInput.size());
+                shardInput.push_back(Document(id, fields.title, fields.content, fields.url));
+            }
+        }
+    }
+
+    IndexMemoryStats memory = engine.memoryStats();
+
+    // The saved index holds postings, positions, lengths and stored fields
+    const string indexPath = "engine_bench.idx";
+    size_t indexBytes = engine.saveIndex(indexPath) ? fileSize(indexPath) : 0;
+
+    vector<string> queries;
+    if (options.queryLog.empty()) {
+        // Distinct queries, replayed with Zipfian popularity
+        vector<string> distinct;
+        size_t distinctCount = max<size_t>(1, options.queries / 4);
+        for (size_t i = 0; i < distinctCount; ++i) distinct.push_back(corpus.query());
+        ZipfSampler popularity(distinct.size(), 1.0);
+        for (size_t i = 0; i < options.queries; ++i) {
+            queries.push_back(distinct[popularity.sample(corpus.random())]);
+        }
+    } else {
+        ifstream log(options.queryLog);
+        string line;
+        while (getline(log, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!line.empty()) queries.push_back(line);
+        }
+    }
+    if (queries.empty()) {
+        cerr << "No queries to replay" << endl;
+        return 1;
+    }
+
+    // Latency on one thread, after a warm-up pass over part of the log
+    cerr << "Replaying " << queries.size() << " queries..." << endl;
+    size_t warmup = min<size_t>(queries.size(), 1000);
+    size_t checksum = 0;
+    for (size_t i = 0; i < warmup; ++i) {
+        checksum += engine.search(queries[i], options.maxResults, options.withSnippets).size();
+    }
+    vector<double> latencies;
+    latencies.reserve(queries.size());
+    double latencyTotal = 0.0;
+    for (const string& query : queries) {
+        auto begin = chrono::steady_clock::now();
+        checksum += engine.search(query, options.maxResults, options.withSnippets).size();
+        double micros = secondsSince(begin) * 1e6;
+        latencies.push_back(micros);
+        latencyTotal += micros;
+    }
+    sort(latencies.begin(), latencies.end());
+
+    // Phase breakdown from a second pass with every query sampled, kept out
+    // of the latency pass so the clock reads do not inflate it
+    SearchMetrics before = engine.searchMetrics();
+    engine.setQueryMetricsSampling(1);
+    for (const string& query : queries) {
+        checksum += engine.search(query, options.maxResults, options.withSnippets).size();
+    }
+    engine.setQueryMetricsSampling(0);
+    SearchMetrics after = engine.searchMetrics();
+    double sampled = static_cast<double>(max<uint64_t>(after.sampledQueries - before.sampledQueries, 1));
+
+    // Throughput: threads pull queries from a shared counter until the log is done
+    vector<pair<unsigned, double>> throughput;
+    for (unsigned threadCount : options.threads) {
+        cerr << "Throughput with " << threadCount << " threads..." << endl;
+        atomic<size_t> next(0);
+        atomic<size_t> results(0);
+        auto begin = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (unsigned t = 0; t < threadCount; ++t) {
+            workers.emplace_back([&]() {
+                size_t found = 0;
+                for (size_t i = next++; i < queries.size(); i = next++) {
+                    found += engine.search(queries[i], options.maxResults, options.withSnippets).size();
+                }
+                results += found;
+            });
+        }
+        for (thread& worker : workers) worker.join();
+        throughput.push_back(make_pair(threadCount, queries.size() / secondsSince(begin)));
+        checksum += results;
+    }
+
+    // Deep pagination: offsets rank every earlier page again, cursors cut
+    // pages from the ranking searchAfter() keeps ahead
+    struct PageRun {
+        size_t queries;
+        double offsetMicros;        // Per page, and for the last page alone
+        double offsetLastMicros;
+        double cursorMicros;
+        double cursorLastMicros;
+        double identical;           // Share of queries whose pages matched
+    };
+    PageRun pageRun = PageRun();
+    if (options.pages > 0 && options.maxResults > 0) {
+        cerr << "Paginating " << options.pages << " pages..." << endl;
+        vector<string> distinct(queries.begin(), queries.end());
+        sort(distinct.begin(), distinct.end());
+        distinct.erase(unique(distinct.begin(), distinct.end()), distinct.end());
+        distinct.resize(min<size_t>(distinct.size(), 200));
+        pageRun.queries = distinct.size();
+        size_t identical = 0;
+        for (const string& query : distinct) {
+            vector<int> offsetIds;
+            for (size_t p = 0; p < options.pages; ++p) {
+                int depth = options.maxResults * static_cast<int>(p + 1);
+                auto begin = chrono::steady_clock::now();
+                vector<SearchResult> results = engine.search(query, depth, options.withSnippets);
+                double micros = secondsSince(begin) * 1e6;
+                pageRun.offsetMicros += micros;
+                if (p + 1 == options.pages) pageRun.offsetLastMicros += micros;
+                size_t first = static_cast<size_t>(depth - options.maxResults);
+                for (size_t i = first; i < results.size(); ++i) {
+                    offsetIds.push_back(results[i].documentId);
+                }
+                checksum += results.size();
+            }
+            vector<int> cursorIds;
+            SearchCursor cursor;
+            for (size_t p = 0; p < options.pages; ++p) {
+                auto begin = chrono::steady_clock::now();
+                SearchPage page = engine.searchAfter(query, cursor, options.maxResults,
+                                                     options.withSnippets);
+                double micros = secondsSince(begin) * 1e6;
+                pageRun.cursorMicros += micros;
+                if (p + 1 == options.pages) pageRun.cursorLastMicros += micros;
+                for (const SearchResult& result : page.results) {
+                    cursorIds.push_back(result.documentId);
+                }
+                checksum += page.results.size();
+                cursor = page.next;
+            }
+            if (offsetIds == cursorIds) ++identical;
+        }
+        double count = static_cast<double>(max<size_t>(distinct.size(), 1));
+        pageRun.offsetMicros /= count * options.pages;
+        pageRun.cursorMicros /= count * options.pages;
+        pageRun.offsetLastMicros /= count;
+        pageRun.cursorLastMicros /= count;
+        pageRun.identical = identical / count;
+    }
+
+    // Cold index: each mode opens the saved file afresh with its pages evicted
+    struct AsyncRun {
+        double syncQueriesPerSecond;
+        double asyncQueriesPerSecond;
+        AsyncSearchStats stats;
+    };
+    AsyncRun asyncRun = AsyncRun();
+    unsigned asyncThreads = options.threads.back();
+    if (options.asyncDepth > 0 && indexBytes > 0) {
+        cerr << "Cold index, blocking and async..." << endl;
+        {
+            evictFile(indexPath);
+            MiniSearchEngine cold(options.codec, analysis);
+            cold.openIndex(indexPath);
+            atomic<size_t> next(0);
+            auto begin = chrono::steady_clock::now();
+            vector<thread> workers;
+            for (unsigned t = 0; t < asyncThreads; ++t) {
+                workers.emplace_back([&]() {
+                    for (size_t i = next++; i < queries.size(); i = next++) {
+                        cold.search(queries[i], options.maxResults, options.withSnippets);
+                    }
+                });
+            }
+            for (thread& worker : workers) worker.join();
+            asyncRun.syncQueriesPerSecond = queries.size() / secondsSince(begin);
+        }
+        {
+            evictFile(indexPath);
+            MiniSearchEngine cold(options.codec, analysis);
+            cold.setAsyncThreads(asyncThreads);
+            cold.openIndex(indexPath);
+            mutex flight;
+            condition_variable landed;
+            size_t inFlight = 0;
+            size_t completed = 0;
+            auto begin = chrono::steady_clock::now();
+            for (const string& query : queries) {
+                {
+                    unique_lock<mutex> lock(flight);
+                    landed.wait(lock, [&]() { return inFlight < options.asyncDepth; });
+                    inFlight++;
+                }
+                cold.searchAsync(query, options.maxResults, options.withSnippets,
+                                 [&](vector<SearchResult> results) {
+                    lock_guard<mutex> lock(flight);
+                    checksum += results.size();
+                    inFlight--;
+                    completed++;
+                    landed.notify_all();
+                });
+            }
+            unique_lock<mutex> lock(flight);
+            landed.wait(lock, [&]() { return completed == queries.size(); });
+            asyncRun.asyncQueriesPerSecond = queries.size() / secondsSince(begin);
+            asyncRun.stats = cold.asyncSearchStats();
+        }
+    }
+    remove(indexPath.c_str());
+
+    // Sharded engines over the same documents; every shard count gets a
+    // fresh engine whose shards index their parts in parallel
+    struct ShardRun {
+        size_t shards;
+        double indexSeconds;
+        double meanMicros;
+        double p99Micros;
+        double queriesPerSecond;    // With the largest thread count
+        double identical;           // Share of queries ranked exactly like the single engine
+    };
+    vector<ShardRun> shardRuns;
+    unsigned shardClients = options.threads.back();
+    for (size_t shardCount : options.shardCounts) {
+        cerr << "Sharded engine with " << shardCount << " shards..." << endl;
+        ShardedSearchEngine sharded(shardCount, 0, options.codec, analysis);
+        auto begin = chrono::steady_clock::now();
+        sharded.addDocuments(shardInput);
+        sharded.refresh();
+        sharded.waitForMerges();
+        ShardRun run;
+        run.shards = shardCount;
+        run.indexSeconds = secondsSince(begin);
+
+        size_t identical = 0;
+        for (size_t i = 0; i < warmup; ++i) {
+            checksum += sharded.search(queries[i], options.maxResults, options.withSnippets).size();
+        }
+        vector<double> shardLatencies;
+        double shardTotal = 0.0;
+        for (const string& query : queries) {
+            begin = chrono::steady_clock::now();
+            checksum += sharded.search(query, options.maxResults, options.withSnippets).size();
+            double micros = secondsSince(begin) * 1e6;
+            shardLatencies.push_back(micros);
+            shardTotal += micros;
+        }
+        sort(shardLatencies.begin(), shardLatencies.end());
+        run.meanMicros = shardTotal / queries.size();
+        run.p99Micros = percentile(shardLatencies, 0.99);
+
+        atomic<size_t> next(0);
+        begin = chrono::steady_clock::now();
+        vector<thread> clients;
+        for (unsigned t = 0; t < shardClients; ++t) {
+            clients.emplace_back([&]() {
+                for (size_t i = next++; i < queries.size(); i = next++) {
+                    sharded.search(queries[i], options.maxResults, options.withSnippets);
+                }
+            });
+        }
+        for (thread& client : clients) client.join();
+        run.queriesPerSecond = queries.size() / secondsSince(begin);
+
+        for (const string& query : queries) {
+            vector<ScoredDocument> expected = engine.searchIds(query, options.maxResults);
+            vector<ScoredDocument> actual = sharded.searchIds(query, options.maxResults);
+            bool same = expected.size() == actual.size();
+            for (size_t r = 0; same && r < expected.size(); ++r) {
+                same = expected[r].documentId == actual[r].documentId &&
+                       expected[r].score == actual[r].score;
+            }
+            identical += same;
+        }
+        run.identical = static_cast<double>(identical) / queries.size();
+        shardRuns.push_back(run);
+    }
+    vector<Document>().swap(shardInput);
+
+    // Impact ranking last, since the BM25 reference switches the scoring model
+    struct ImpactRun {
+        double fraction;
+        double meanMicros;
+        double p99Micros;
+        double postings;
+        double exhaustiveOverlap;   // Share of the top k that exhaustive impact ranking returns
+        double bm25Overlap;         // Same against search() with BM25
+    };
+    vector<ImpactRun> impactRuns;
+    if (!options.impactFractions.empty()) {
+        cerr << "Impact ranking..." << endl;
+        ImpactSearchOptions exhaustive;
+        exhaustive.withSnippets = false;
+        vector<vector<int>> exhaustiveIds(queries.size());
+        vector<vector<int>> bm25Ids(queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            vector<SearchResult> results = engine.searchImpacts(queries[i], options.maxResults,
+                                                                exhaustive);
+            for (const SearchResult& result : results) {
+                exhaustiveIds[i].push_back(result.documentId);
+            }
+            sort(exhaustiveIds[i].begin(), exhaustiveIds[i].end());
+        }
+        engine.setScoring(ScoringParams(ScoringModel::BM25));
+        for (size_t i = 0; i < queries.size(); ++i) {
+            for (const ScoredDocument& scored : engine.searchIds(queries[i], options.maxResults)) {
+                bm25Ids[i].push_back(scored.documentId);
+            }
+            sort(bm25Ids[i].begin(), bm25Ids[i].end());
+        }
+
+        for (double fraction : options.impactFractions) {
+            ImpactSearchOptions impactOptions;
+            impactOptions.postingFraction = fraction;
+            impactOptions.withSnippets = options.withSnippets;
+            SearchMetrics impactBefore = engine.searchMetrics();
+            vector<double> impactLatencies;
+            double impactTotal = 0.0;
+            size_t shared = 0, sharedBM25 = 0, expected = 0, expectedBM25 = 0;
+            for (size_t i = 0; i < queries.size(); ++i) {
+                auto begin = chrono::steady_clock::now();
+                vector<SearchResult> results = engine.searchImpacts(queries[i], options.maxResults,
+                                                                    impactOptions);
+                double micros = secondsSince(begin) * 1e6;
+                impactLatencies.push_back(micros);
+                impactTotal += micros;
+                const vector<int>& exhaustiveTop = exhaustiveIds[i];
+                const vector<int>& bm25Top = bm25Ids[i];
+                for (const SearchResult& result : results) {
+                    int id = result.documentId;
+                    shared += binary_search(exhaustiveTop.begin(), exhaustiveTop.end(), id);
+                    sharedBM25 += binary_search(bm25Top.begin(), bm25Top.end(), id);
+                }
+                expected += exhaustiveTop.size();
+                expectedBM25 += bm25Top.size();
+                checksum += results.size();
+            }
+            sort(impactLatencies.begin(), impactLatencies.end());
+            SearchMetrics impactAfter = engine.searchMetrics();
+            uint64_t impactPostings = impactAfter.postingsScanned - impactBefore.postingsScanned;
+            impactRuns.push_back(ImpactRun{fraction, impactTotal / queries.size(),
+                percentile(impactLatencies, 0.99),
+                static_cast<double>(impactPostings) / queries.size(),
+                static_cast<double>(shared) / max<size_t>(expected, 1),
+                static_cast<double>(sharedBM25) / max<size_t>(expectedBM25, 1)});
+        }
+    }
+
+    cout << "{" << endl;
+    cout << "  \"benchmark\": \"engine_bench\"," << endl;
+    cout << "  \"label\": " << jsonString(options.label) << "," << endl;
+    cout << "  \"codec\": " << jsonString(postingCodecName(options.codec)) << "," << endl;
+    cout << "  \"index_format_version\": " << IndexFile::kFormatVersion << "," << endl;
+    cout << "  \"analyzer\": {\"stop_words\": " << analysis.stopWords.size()
+         << ", \"stemming\": " << (options.stemming ? "true" : "false") << "}," << endl;
+    cout << "  \"corpus\": {\"source\": "
+         << jsonString(options.corpusFile.empty() ? "synthetic" : options.corpusFile)
+         << ", \"documents\": " << documents << ", \"input_bytes\": " << inputBytes;
+    if (options.corpusFile.empty()) {
+        cout << ", \"vocabulary\": " << options.vocabulary << ", \"zipf\": " << options.zipfExponent
+             << ", \"seed\": " << options.seed;
+    }
+    cout << "}," << endl;
+    cout << "  \"indexing\": {\"seconds\": " << indexSeconds
+         << ", \"documents_per_second\": " << documents / indexSeconds
+         << ", \"megabytes_per_second\": " << inputBytes / (1024.0 * 1024.0) / indexSeconds << "}," << endl;
+    cout << "  \"memory\": {\"dictionary_bytes\": " << memory.dictionaryBytes
+         << ", \"posting_bytes\": " << memory.postingBytes
+         << ", \"bitmap_bytes\": " << memory.bitmapBytes
+         << ", \"impact_bytes\": " << memory.impactBytes
+         << ", \"position_bytes\": " << memory.positionBytes
+         << ", \"length_bytes\": " << memory.lengthBytes
+         << ", \"document_bytes\": " << memory.documentBytes
+         << ", \"deletion_bytes\": " << memory.deletionBytes
+         << ", \"total_bytes\": " << memory.totalBytes()
+         << ", \"bytes_per_document\": " << static_cast<double>(memory.totalBytes()) / documents
+         << "}," << endl;
+    cout << "  \"index_file\": {\"bytes\": " << indexBytes
+         << ", \"bytes_per_document\": " << static_cast<double>(indexBytes) / documents << "}," << endl;
+    cout << "  \"queries\": {\"source\": "
+         << jsonString(options.queryLog.empty() ? "synthetic" : options.queryLog)
+         << ", \"count\": " << queries.size() << ", \"max_results\": " << options.maxResults
+         << ", \"snippets\": " << (options.withSnippets ? "true" : "false") << "}," << endl;
+    cout << "  \"latency_us\": {\"mean\": " << latencyTotal / latencies.size()
+         << ", \"p50\": " << percentile(latencies, 0.5) << ", \"p99\": " << percentile(latencies, 0.99)
+         << ", \"p999\": " << percentile(latencies, 0.999) << ", \"max\": " << latencies.back() << "}," << endl;
+    cout << "  \"phases_us\": {";
+    for (size_t p = 0; p < kQueryPhaseCount; ++p) {
+        cout << (p ? ", " : "") << jsonString(queryPhaseName(static_cast<QueryPhase>(p))) << ": "
+             << (after.phaseNanos[p] - before.phaseNanos[p]) / 1000.0 / sampled;
+    }
+    cout << "}," << endl;
+    cout << "  \"per_query\": {\"postings_scanned\": "
+         << (after.postingsScanned - before.postingsScanned) / sampled
+         << ", \"candidates_scored\": " << (after.candidatesScored - before.candidatesScored) / sampled
+         << "}," << endl;
+    cout << "  \"throughput\": [";
+    for (size_t i = 0; i < throughput.size(); ++i) {
+        cout << (i ? ", " : "") << "{\"threads\": " << throughput[i].first
+             << ", \"queries_per_second\": " << throughput[i].second << "}";
+    }
+    cout << "]," << endl;
+    if (options.pages > 0 && options.maxResults > 0) {
+        cout << "  \"pagination\": {\"pages\": " << options.pages
+             << ", \"queries\": " << pageRun.queries
+             << ", \"offset_us\": {\"per_page\": " << pageRun.offsetMicros
+             << ", \"last_page\": " << pageRun.offsetLastMicros
+             << "}, \"cursor_us\": {\"per_page\": " << pageRun.cursorMicros
+             << ", \"last_page\": " << pageRun.cursorLastMicros
+             << "}, \"identical_pages\": " << pageRun.identical << "}," << endl;
+    }
+    if (options.asyncDepth > 0 && indexBytes > 0) {
+        cout << "  \"cold_index\": {\"threads\": " << asyncThreads
+             << ", \"in_flight\": " << options.asyncDepth
+             << ", \"blocking_queries_per_second\": " << asyncRun.syncQueriesPerSecond
+             << ", \"async_queries_per_second\": " << asyncRun.asyncQueriesPerSecond
+             << ", \"queries_waited\": " << asyncRun.stats.waited
+             << ", \"queries_timed_out\": " << asyncRun.stats.timedOut
+             << ", \"pages_requested\": " << asyncRun.stats.pagesRequested << "}," << endl;
+    }
+    if (!shardRuns.empty()) {
+        cout << "  \"sharded\": [";
+        for (size_t i = 0; i < shardRuns.size(); ++i) {
+            const ShardRun& run = shardRuns[i];
+            cout << (i ? ", " : "") << "{\"shards\": " << run.shards
+                 << ", \"documents_per_second\": " << documents / run.indexSeconds
+                 << ", \"latency_us\": {\"mean\": " << run.meanMicros
+                 << ", \"p99\": " << run.p99Micros << "}, \"threads\": " << shardClients
+                 << ", \"queries_per_second\": " << run.queriesPerSecond
+                 << ", \"identical_top_k\": " << run.identical << "}";
+        }
+        cout << "]," << endl;
+    }
+    if (!impactRuns.empty()) {
+        cout << "  \"impact\": [";
+        for (size_t i = 0; i < impactRuns.size(); ++i) {
+            const ImpactRun& run = impactRuns[i];
+            cout << (i ? ", " : "") << "{\"posting_fraction\": " << run.fraction
+                 << ", \"latency_us\": {\"mean\": " << run.meanMicros
+                 << ", \"p99\": " << run.p99Micros << "}, \"postings_scanned\": " << run.postings
+                 << ", \"overlap_exhaustive\": " << run.exhaustiveOverlap
+                 << ", \"overlap_bm25\": " << run.bm25Overlap << "}";
+        }
+        cout << "]," << endl;
+    }
+    cout << "  \"checksum\": " << checksum << endl;
+    cout << "}" << endl;
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "../include/Tokenizer.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cctype>
+#include <random>
+using namespace std;
+
+/**
+ * normalize_bench: Compares the legacy per-char preprocessing loop with the
+ * table-driven and SIMD normalization kernels, in MB/s
+ *
+ * Usage: normalize_bench [corpus-file] [iterations]
+ */
+
+static string legacyPreprocess(const string& text) {
+    string result;
+    for (char c : text) {
+        if (isalnum(c) || isspace(c)) {
+            result += tolower(c);
+        } else {
+            result += ' ';
+        }
+    }
+    return result;
+}
+
+static string syntheticText(size_t bytes) {
+    static const char* words[] = {
+        "Search", "engine", "index", "posting", "C++", "query,", "document.",
+        "ranking", "TF-IDF", "snippet", "tokenizer", "(2024)", "the", "and"
+    };
+    mt19937 rng(42);
+    string text;
+    while (text.size() < bytes) {
+        text += words[rng() % (sizeof(words) / sizeof(words[0]))];
+        text += (rng() % 8 == 0) ? '\n' : ' ';
+    }
+    return text;
+}
+
+// Sampled sum of the output so the compiler cannot drop the work
+static size_t sampleChecksum(const string& out) {
+    size_t sum = 0;
+    for (size_t i = 0; i < out.size(); i += 61) {
+        sum += static_cast<unsigned char>(out[i]);
+    }
+    return sum;
+}
+
+template <typename Kernel>
+static void run(const char* name, const string& text, int iterations, Kernel kernel) {
+    auto begin = chrono::steady_clock::now();
+    size_t checksum = 0;
+    for (int i = 0; i < iterations; ++i) {
+        checksum += kernel();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    double megabytes = static_cast<double>(text.size()) * iterations / (1024.0 * 1024.0);
+    cout << name << ": " << (megabytes / seconds) << " MB/s (checksum " << checksum << ")" << endl;
+}
+
+int main(int argc, char** argv) {
+    string text;
+    if (argc > 1) {
+        ifstream file(argv[1], ios::binary);
+        stringstream contents;
+        contents << file.rdbuf();
+        text = contents.str();
+    } else {
+        text = syntheticText(16 * 1024 * 1024);
+    }
+    int iterations = (argc > 2) ? atoi(argv[2]) : 10;
+    if (text.empty() || iterations <= 0) {
+        cerr << "Nothing to benchmark" << endl;
+        return 1;
+    }
+
+    cout << "Input: " << text.size() << " bytes, " << iterations << " iterations" << endl;
+    string out(text.size(), '\0');
+
+    run("legacy isalnum/tolower", text, iterations, [&]() {
+        return sampleChecksum(legacyPreprocess(text));
+    });
+    run("scalar table", text, iterations, [&]() {
+        Tokenizer::normalizeScalar(text.data(), text.size(), &out[0]);
+        return sampleChecksum(out);
+    });
+    string kernel = string("vector kernel (") + Tokenizer::normalizeKernelName() + ")";
+    run(kernel.c_str(), text, iterations, [&]() {
+        Tokenizer::normalize(text.data(), text.size(), &out[0]);
+        return sampleChecksum(out);
+    });
+    return 0;
+}
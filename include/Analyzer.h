@@ -0,0 +1,85 @@
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "Tokenizer.h"
+#include "StringRef.h"
+using namespace std;
+
+/**
+ * AnalyzerOptions: Filters applied to tokens after normalization. Documents
+ * and queries must go through the same options, so index files record them.
+ */
+struct AnalyzerOptions {
+    vector<string> stopWords;   // Dropped from documents and queries; normalized like text
+    bool stemming;              // Porter-stem every token that is kept
+
+    AnalyzerOptions() : stemming(false) {}
+
+    static vector<string> englishStopWords();   // Common function words of three letters or more
+};
+
+/**
+ * StopWordSet: Immutable set of terms behind a perfect hash. Words are
+ * hashed into small buckets, and each bucket stores the seed that sends all
+ * its words to distinct slots, so a lookup hashes the term once and compares
+ * it with at most one word.
+ */
+class StopWordSet {
+private:
+    vector<string> words;
+    vector<uint32_t> seeds;     // Per bucket
+    vector<int> slots;          // Index into words, -1 where empty; a power of two long
+
+    static uint64_t hash(StringRef term);
+    static size_t slotOf(uint64_t hash, uint32_t seed, size_t mask);
+    size_t bucketOf(uint64_t hash) const { return static_cast<size_t>(hash >> 32) % seeds.size(); }
+
+public:
+    explicit StopWordSet(vector<string> words);    // Normalized, duplicates allowed
+
+    bool contains(StringRef term) const;
+    size_t size() const { return words.size(); }
+};
+
+/**
+ * Analyzer: Turns text into index terms: the tokenizer's normalized tokens,
+ * minus stop words, optionally stemmed. Spans still address the original
+ * text, so positions and snippets are unaffected by stemming. Copies share
+ * the stop-word set; each copy has its own buffers, so use one per thread.
+ */
+class Analyzer {
+private:
+    Tokenizer tokenizer;
+    shared_ptr<const StopWordSet> stopWords;    // Null if none are dropped
+    bool stemming;
+    uint64_t id;
+
+    // Output of the last call when a filter is active
+    vector<TokenSpan> kept;
+    vector<uint32_t> stemLengths;   // Per kept token
+    string stemmed;                 // Normalized text with stems written over their tokens
+
+    bool filtering() const { return stopWords || stemming; }
+
+public:
+    explicit Analyzer(const AnalyzerOptions& options = AnalyzerOptions());
+
+    // Adopts other's filters, keeping this analyzer's buffers
+    void copySettings(const Analyzer& other);
+
+    // Spans of the tokens that became terms, in text order
+    const vector<TokenSpan>& analyze(const char* text, size_t length);
+    const vector<TokenSpan>& analyze(const string& text) { return analyze(text.data(), text.size()); }
+    StringRef term(size_t i) const;     // Term of the i-th span of the last call
+    string termText(size_t i) const { return term(i).str(); }
+
+    bool isStopWord(StringRef term) const { return stopWords && stopWords->contains(term); }
+    // Equal for analyzers that produce the same terms; 0 for the plain tokenizer
+    uint64_t fingerprint() const { return id; }
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef BITOPS_H
+#define BITOPS_H
+
+#include <cstdint>
+#include <cstddef>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+using namespace std;
+
+/** countTrailingZeros: Index of the lowest set bit; word must not be 0 */
+inline size_t countTrailingZeros(uint64_t word) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<size_t>(index);
+#else
+    return static_cast<size_t>(__builtin_ctzll(word));
+#endif
+}
+
+/** countBits: Number of set bits in word */
+inline size_t countBits(uint64_t word) {
+#if defined(_MSC_VER)
+    return static_cast<size_t>(__popcnt64(word));
+#else
+    return static_cast<size_t>(__builtin_popcountll(word));
+#endif
+}
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef BOOLEANQUERY_H
+#define BOOLEANQUERY_H
+
+#include <string>
+#include <vector>
+#include "Segment.h"
+#include "DocSet.h"
+#include "Analyzer.h"
+using namespace std;
+
+/**
+ * QueryNodeType: Operators of a parsed boolean query
+ */
+enum class QueryNodeType {
+    Term,
+    Phrase,     // Words that must appear next to each other, in order
+    Prefix,     // A word ending in '*'; the engine expands it into an Or of its completions
+    And,
+    Or,
+    Not         // Excludes documents matching its only child
+};
+
+/**
+ * QueryNode: Node of a boolean query tree. Terms are normalized the same
+ * way documents are, so they can be looked up directly.
+ */
+struct QueryNode {
+    QueryNodeType type;
+    vector<string> terms;           // Term: one term; Phrase: its words in order; Prefix: the prefix
+    vector<QueryNode> children;     // And, Or: operands; Not: the excluded operand
+    vector<size_t> slots;           // Term, Phrase: each term's entry in the query's term table
+
+    bool blank() const;             // No terms at all, e.g. only short words; parents ignore it
+};
+
+/**
+ * BooleanQueryParser: Parses queries such as
+ *     rust AND (async OR tokio) -java "memory safety"
+ * Adjacent operands are ANDed, OR binds looser than AND, and NOT or a
+ * leading '-' excludes from the enclosing conjunction; alone, or as an OR
+ * operand, it matches nothing. Operators must be upper case; any other word
+ * is a term, or a prefix if it ends in '*' (algo*). Words go through the
+ * analyzer documents were indexed with; a word it splits into several
+ * terms becomes a phrase, and one it drops entirely is ignored.
+ */
+class BooleanQueryParser {
+private:
+    vector<string> lexemes;
+    size_t next;
+    Analyzer analyzer;
+
+    void lex(const string& query);
+    QueryNode parseOr();
+    QueryNode parseAnd();
+    QueryNode parseUnary();
+    QueryNode parsePrimary();
+    QueryNode wordsNode(const string& text);
+    bool atOperand() const;
+
+public:
+    explicit BooleanQueryParser(const Analyzer& analyzer = Analyzer());
+
+    QueryNode parse(const string& query);
+
+    // Appends every term occurrence outside a NOT; matches are scored on these
+    static void scoringTerms(const QueryNode& node, vector<string>& terms);
+    // Fills table with every term of the tree, excluded ones included, sorted
+    // and without duplicates, and points each node's slots into it
+    static void indexTerms(QueryNode& root, vector<string>& table);
+    // Folds text the way indexed terms are folded; false if it is empty or
+    // holds a byte no indexed term can contain
+    static bool normalizePrefix(const string& text, string& prefix);
+};
+
+/**
+ * BooleanMatcher: Evaluates a query tree against one segment. Conjunctions
+ * start from the operand with the fewest postings and probe the others,
+ * which touches far fewer documents than scoring the union. Intermediate
+ * results are DocSets, so frequent terms' bitmaps combine a word at a time
+ * and exclusions of common terms cost a bit test per candidate. Terms arrive
+ * already resolved, so nothing is looked up while matching. Prefixes must
+ * be expanded beforehand; one left in the tree matches nothing.
+ */
+class BooleanMatcher {
+private:
+    const Segment& segment;
+    PositionStoreView positions;
+    const int* termIds;             // Per table entry, -1 if the segment lacks it
+    size_t visited;
+
+    int termId(const QueryNode& node, size_t i) const { return termIds[node.slots[i]]; }
+    size_t cost(const QueryNode& node) const;    // Upper bound on the matches of node
+    DocSet emptySet() const { return DocSet(segment.baseDocId(), segment.documentCount()); }
+    DocSet matchTerm(int termId);
+    DocSet matchPhrase(const QueryNode& node);
+    DocSet matchAnd(const QueryNode& node);
+    DocSet matchOr(const QueryNode& node);
+    void filter(DocSet& candidates, const QueryNode& node, bool keep);
+    void filterTerm(DocSet& candidates, int termId, bool keep);
+    void verifyPhrase(vector<int>& candidates, const vector<int>& termIds);
+
+public:
+    // termIds holds the segment's id for each entry of the table the tree was indexed against
+    BooleanMatcher(const Segment& segment, const int* termIds);
+
+    DocSet match(const QueryNode& node);        // Deleted documents included
+    size_t postingsVisited() const { return visited; }
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef DELETIONBITMAP_H
+#define DELETIONBITMAP_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+using namespace std;
+
+/**
+ * DeletionBitmap: One bit per document of a segment, set once the document
+ * is deleted. Numbered from the segment's base doc id.
+ */
+class DeletionBitmap {
+private:
+    vector<uint64_t> words;
+    size_t documents;
+    size_t deleted;
+
+public:
+    explicit DeletionBitmap(size_t documentCount = 0);
+    DeletionBitmap(const uint64_t* data, size_t documentCount);
+
+    bool contains(size_t doc) const { return (words[doc >> 6] >> (doc & 63)) & 1; }
+    bool insert(size_t doc);    // False if the document was already deleted
+    void insertAll(const DeletionBitmap& other, size_t offset);    // other's doc 0 lands at offset
+
+    size_t size() const { return documents; }
+    size_t count() const { return deleted; }
+    const uint64_t* data() const { return words.data(); }
+    size_t wordCount() const { return words.size(); }
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef DOCSET_H
+#define DOCSET_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+using namespace std;
+
+/**
+ * DocSet: Set of doc ids inside one segment. While sparse it is a sorted
+ * array; once it holds one document in every kDenseRatio it becomes a bitset
+ * over the segment, on which intersection, union and difference run a word
+ * at a time. Every operation accepts either representation on either side.
+ */
+class DocSet {
+public:
+    // From this density on a bitset is no larger than the array
+    static const size_t kDenseRatio = 32;
+
+    DocSet(int base, size_t documents);                         // Empty
+    DocSet(int base, size_t documents, vector<int> docs);       // Sorted doc ids
+    DocSet(int base, size_t documents, const uint64_t* words);  // Bit per document from base
+
+    size_t size() const { return dense ? count : docs.size(); }
+    bool empty() const { return size() == 0; }
+    bool isDense() const { return dense; }
+    bool contains(int docId) const;
+
+    void clear();
+    void intersect(const DocSet& other);
+    void intersect(const uint64_t* words);      // A bitmap laid out like the dense form
+    void unite(const DocSet& other);
+    void subtract(const DocSet& other);
+    void subtract(const uint64_t* words);
+
+    // Sorted doc ids, switching to the array form first. Callers may remove
+    // ids in place but not add any
+    vector<int>& sortedDocs();
+    vector<int> toVector() const;
+
+private:
+    int base;
+    size_t documents;
+    bool dense;
+    size_t count;               // Set bits while dense
+    vector<int> docs;           // Sorted doc ids while sparse
+    vector<uint64_t> words;     // Bit per document from base while dense
+
+    size_t wordCount() const { return (documents + 63) / 64; }
+    bool testBit(const uint64_t* bits, int docId) const {
+        size_t doc = static_cast<size_t>(docId - base);
+        return (bits[doc >> 6] >> (doc & 63)) & 1;
+    }
+    void recount();
+    void settle();      // Picks the representation that suits the current size
+    void makeDense();
+    void makeSparse();
+};
+
+#endif
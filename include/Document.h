@@ -2,6 +2,7 @@
 #define DOCUMENT_H
 
 #include <string>
+#include "StringRef.h"
 using namespace std;
 
 /**
@@ -15,6 +16,17 @@ public:
     string url;
 
     Document(int id, const string& title, const string& content, const string& url = "");
+    Document(int id, StringRef title, StringRef content, StringRef url);
+};
+
+/**
+ * DocumentView: Read-only document fields referencing the owning store
+ */
+struct DocumentView {
+    int id;
+    StringRef title;
+    StringRef content;
+    StringRef url;
 };
 
 #endif
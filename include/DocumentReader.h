@@ -0,0 +1,62 @@
+#ifndef DOCUMENTREADER_H
+#define DOCUMENTREADER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include "StringRef.h"
+using namespace std;
+
+/**
+ * LoadStats: Counters collected while streaming a document file
+ */
+struct LoadStats {
+    bool opened;
+    size_t bytes;               // Input bytes consumed
+    size_t lines;
+    size_t documents;
+    size_t malformedLines;      // Non-empty lines without a '|' separator
+    size_t firstMalformedLine;  // 1-based line number, 0 if none
+    double seconds;
+
+    LoadStats();
+    double megabytesPerSecond() const;
+};
+
+/**
+ * DocumentFields: Pipe-separated fields of one line, valid until the next read
+ */
+struct DocumentFields {
+    StringRef title;
+    StringRef content;
+    StringRef url;
+};
+
+/**
+ * DocumentReader: Streams "title|content|url" lines from a file through a
+ * fixed-size chunk buffer. Fields are returned as views into the buffer, so
+ * memory use is bounded by the longest line rather than the file size.
+ */
+class DocumentReader {
+public:
+    static const size_t kChunkSize = 1 << 20;
+
+    explicit DocumentReader(const string& path);
+
+    bool isOpen() const { return stats.opened; }
+    bool next(DocumentFields& fields);  // False once the input is exhausted
+    const LoadStats& loadStats() const { return stats; }
+
+private:
+    ifstream file;
+    vector<char> buffer;
+    size_t begin;       // Start of the unconsumed bytes in buffer
+    size_t end;         // End of the valid bytes in buffer
+    bool exhausted;
+    LoadStats stats;
+
+    bool nextLine(StringRef& line);
+    bool fill();
+};
+
+#endif
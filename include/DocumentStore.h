@@ -0,0 +1,69 @@
+#ifndef DOCUMENTSTORE_H
+#define DOCUMENTSTORE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "Document.h"
+using namespace std;
+
+/**
+ * DocumentStore: Append-only store of document fields. Field bytes are
+ * packed into large arena blocks and entries into fixed chunks; neither ever
+ * moves, so one writer may add documents while readers look up documents it
+ * has already published. Repeated titles and URLs are interned and share one
+ * copy.
+ */
+class DocumentStore {
+public:
+    static const size_t kBlockSize = 1 << 20;
+
+    explicit DocumentStore(int docBase = 0);
+
+    int add(StringRef title, StringRef content, StringRef url);     // Returns the global docId
+    DocumentView document(int docId) const;
+
+    int baseDocId() const { return docBase; }
+    int endDocId() const { return docBase + static_cast<int>(count); }
+    size_t size() const { return count; }
+
+    size_t arenaBytes() const { return allocatedBytes; }
+    size_t internedBytes() const { return savedBytes; }     // Bytes not stored thanks to interning
+    size_t blockCount() const { return blocks.size(); }
+    size_t memoryBytes() const;
+
+private:
+    struct Entry {
+        StringRef title;
+        StringRef content;
+        StringRef url;
+    };
+
+    // Chunk k holds kFirstChunkSize << k entries, so the chunk table is never
+    // resized and published entries are never relocated
+    static const int kFirstChunkBits = 10;
+    static const size_t kFirstChunkSize = size_t(1) << kFirstChunkBits;
+    static const int kChunkCount = 22;
+
+    int docBase;
+    size_t count;
+    unique_ptr<Entry[]> chunks[kChunkCount];
+    vector<unique_ptr<char[]>> blocks;
+    char* cursor;               // Free space in the newest block
+    size_t remaining;
+    size_t allocatedBytes;
+    size_t savedBytes;
+
+    // Open-addressing set of interned strings; empty slots have a null data pointer
+    vector<StringRef> internTable;
+    size_t internCount;
+
+    static int chunkOf(size_t index);
+    Entry& entry(size_t index) const;
+    StringRef copy(StringRef text);
+    StringRef intern(StringRef text);
+    void growInternTable();
+};
+
+#endif
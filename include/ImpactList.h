@@ -0,0 +1,69 @@
+#ifndef IMPACTLIST_H
+#define IMPACTLIST_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+using namespace std;
+
+/**
+ * ImpactGroup: Postings of one term that share a quantized impact; their
+ * documents are stored in increasing order as variable-byte gaps
+ */
+struct ImpactGroup {
+    uint32_t impact;
+    uint32_t count;
+    uint64_t offset;        // First byte of the group in the index data
+};
+
+/**
+ * ImpactListView: A term's postings ordered by impact instead of doc id,
+ * highest impact first
+ */
+struct ImpactListView {
+    const ImpactGroup* groups;
+    uint32_t groupCount;
+    const uint8_t* data;
+
+    // Appends the documents of group g, numbered from the segment's base
+    void decodeGroup(size_t g, vector<int>& docs) const;
+};
+
+/**
+ * ImpactIndexView: Impact-ordered postings of every term of a segment; it
+ * can point into an ImpactIndex or into a mapped index file
+ */
+struct ImpactIndexView {
+    uint32_t termCount;             // 0 if the segment has no impact ordering
+    const uint32_t* termStart;      // First group of each term, plus the end
+    const ImpactGroup* groups;
+    const uint8_t* data;
+    uint64_t dataSize;
+
+    bool empty() const { return termCount == 0; }
+    ImpactListView list(int termId) const;
+    size_t groupTotal() const { return termCount ? termStart[termCount] : 0; }
+    size_t memoryBytes() const;
+};
+
+/**
+ * ImpactIndex: Builds impact-ordered postings one term at a time, in term id order
+ */
+class ImpactIndex {
+private:
+    vector<uint32_t> termStart;
+    vector<ImpactGroup> groups;
+    vector<uint8_t> data;
+    vector<uint64_t> entries;       // Postings of the term being added
+
+public:
+    ImpactIndex();
+
+    void add(int doc, uint32_t impact);     // doc numbered from the segment's base
+    void endTerm();                         // Groups the postings added since the last call
+    void clear();
+
+    ImpactIndexView view() const;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef INDEXFILE_H
+#define INDEXFILE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "Segment.h"
+#include "Document.h"
+#include "DeletionBitmap.h"
+using namespace std;
+
+/**
+ * IndexFile: Versioned binary index image opened through mmap. The term
+ * dictionary, postings, positions and stored documents are read straight
+ * from the mapped pages; nothing is deserialized when the file is opened.
+ */
+class IndexFile : public Segment {
+public:
+    static const uint32_t kFormatVersion = 7;
+
+    // Writes segment, its documents (one per docId, in order), its deleted
+    // documents, if any, and the fingerprint of the analyzer that indexed it
+    static bool write(const string& path, const Segment& segment,
+                      const vector<DocumentView>& documents,
+                      const DeletionBitmap* deleted = nullptr, uint64_t analyzer = 0);
+    // Returns nullptr if the file is missing, truncated or from another format version
+    static unique_ptr<IndexFile> open(const string& path);
+
+    ~IndexFile();
+
+    int baseDocId() const override { return docBase; }
+    int endDocId() const override { return docBase + static_cast<int>(docCount); }
+    PostingCodec postingCodec() const override { return codec; }
+    size_t termCount() const override { return terms; }
+    string term(int termId) const override { return termRef(termId).str(); }
+    int findTermId(const string& term) const override;
+    void termsWithPrefix(const string& prefix, vector<int>& termIds) const override;
+    PostingListView postingList(int termId) const override;
+    const uint64_t* termBitmap(int termId) const override;
+    void termPages(int termId, PageSet& pages) const override;
+    PositionStoreView positionStore() const override { return positions; }
+    const DocumentLength* documentLengths() const override { return lengths; }
+    const uint8_t* documentPriors() const override { return priors; }
+    ImpactIndexView impactIndex() const override { return impacts; }
+    uint64_t titleTokenCount() const override { return titleTokens; }
+    uint64_t contentTokenCount() const override { return contentTokens; }
+    size_t dictionaryBytes() const override;
+
+    DocumentView document(int docId) const;
+    size_t documentBytes() const;       // Stored fields and their offsets
+    DeletionBitmap deletions() const;
+    size_t fileBytes() const { return size; }
+    uint64_t analyzerFingerprint() const { return analyzer; }
+
+private:
+    struct TermInfo;
+
+    const uint8_t* base;
+    size_t size;
+    vector<uint8_t> buffer;     // Holds the file where mmap is unavailable
+
+    PostingCodec codec;
+    int docBase;
+    uint32_t docCount;
+    uint32_t terms;
+    uint64_t analyzer;
+    const uint64_t* termOffsets;
+    const char* termText;
+    const TermInfo* termInfos;
+    const PostingBlock* blocks;
+    const uint8_t* postingData;
+    uint64_t postingDataSize;
+    const Posting* tails;
+    const uint64_t* docOffsets;
+    const char* docText;
+    const DocumentLength* lengths;
+    const uint8_t* priors;
+    uint64_t titleTokens;
+    uint64_t contentTokens;
+    const uint64_t* deletionWords;      // Null if the file has no deletions
+    const uint64_t* bitmaps;            // Frequent terms' bitmaps, indexed by TermInfo::bitmap
+    PositionStoreView positions;
+    ImpactIndexView impacts;
+
+    IndexFile();
+    IndexFile(const IndexFile&) = delete;
+    IndexFile& operator=(const IndexFile&) = delete;
+
+    bool map(const string& path);
+    bool attach();
+    StringRef termRef(int termId) const;
+    size_t lowerBound(StringRef key) const;     // Ordinal of the first term not below key
+};
+
+#endif
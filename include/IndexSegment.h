@@ -0,0 +1,95 @@
+#ifndef INDEXSEGMENT_H
+#define INDEXSEGMENT_H
+
+#include <string>
+#include <vector>
+#include "Segment.h"
+#include "TermDictionary.h"
+#include "Analyzer.h"
+using namespace std;
+
+/**
+ * IndexSegment: Growable in-memory segment with its own term dictionary,
+ * posting lists and position store. Every structure is indexed by dense term
+ * id. While the segment grows, term text is packed into one buffer and found
+ * through an open-addressing table of ids; once frozen, terms are numbered in
+ * sorted order and held front-coded, and frequent terms get a bitmap next
+ * to their posting list. Frozen segments may also keep every list a second
+ * time in impact order.
+ */
+class IndexSegment : public Segment {
+private:
+    PostingCodec codec;
+    int docBase;                            // Global id of the first document
+    int docCount;
+    string termText;                        // Text of every term, back to back, until frozen
+    vector<uint32_t> termOffsets;           // Start of each term in termText, plus the end
+    vector<int> termSlots;                  // Hash table of term ids, -1 where empty
+    TermDictionary dictionary;              // Sorted term dictionary once frozen
+    bool frozen;
+    vector<PostingList> postings;           // Posting list per term id
+    vector<uint64_t> bitmaps;               // Bitmaps of frequent terms back to back, once frozen
+    vector<uint32_t> bitmapSlots;           // Per term id, 1 + its index in bitmaps; 0 if none
+    PositionStore positions;                // Indexed by docId - docBase
+    vector<DocumentLength> lengths;         // Indexed by docId - docBase
+    vector<uint8_t> priors;                 // Indexed by docId - docBase
+    ImpactIndex impacts;                    // Empty unless frozen with impact ordering
+    uint64_t titleTokens;                   // Sums of lengths
+    uint64_t contentTokens;
+
+    // Scratch buffers reused across documents so indexing does not allocate
+    Analyzer analyzer;
+    vector<int> docTermIds;
+    vector<int> contentTermIds;
+
+    StringRef termRef(int termId) const {
+        return StringRef(termText.data() + termOffsets[termId],
+                         termOffsets[termId + 1] - termOffsets[termId]);
+    }
+    size_t findSlot(StringRef term) const;      // The term's slot, or the empty one it would take
+    void growSlots();
+    int termIdFor(StringRef term);
+    void appendLengths(const Segment& next, const DeletionBitmap* deleted);
+    uint64_t* addBitmap(size_t documents);     // Appends a cleared bitmap
+    void buildImpacts();
+
+public:
+    explicit IndexSegment(PostingCodec codec = PostingCodec::VarByte, int docBase = 0,
+                          const Analyzer& analyzer = Analyzer());
+
+    // Returns the global docId; the url only goes into the document's prior
+    int addDocument(StringRef title, StringRef content, StringRef url = StringRef());
+    // next must start where this segment ends. Postings and positions of
+    // documents in deleted (numbered from next's base) are dropped; their
+    // doc ids stay allocated so later ids do not shift
+    void append(const Segment& next, const DeletionBitmap* deleted = nullptr);
+    // Renumbers terms in sorted order and swaps the hash dictionary for a
+    // front-coded one. The segment takes no more documents afterwards.
+    // impactOrdered also lays every posting list out in impact order
+    void freeze(bool impactOrdered = false);
+    // Fills an empty segment with adjacent inputs, starting at its base, and
+    // freezes it. Terms are merged in sorted order, so no hashing is needed;
+    // deleted[i], if not null, drops documents of inputs[i] as append() does
+    void merge(const vector<const Segment*>& inputs, const vector<const DeletionBitmap*>& deleted,
+               bool impactOrdered = false);
+
+    int baseDocId() const override { return docBase; }
+    int endDocId() const override { return docBase + docCount; }
+    PostingCodec postingCodec() const override { return codec; }
+    size_t termCount() const override { return postings.size(); }
+    string term(int termId) const override;
+    int findTermId(const string& term) const override;
+    void termsWithPrefix(const string& prefix, vector<int>& matches) const override;
+    PostingListView postingList(int termId) const override { return postings[termId].view(); }
+    const uint64_t* termBitmap(int termId) const override;
+    void termPages(int, PageSet&) const override {}
+    PositionStoreView positionStore() const override { return positions.view(); }
+    const DocumentLength* documentLengths() const override { return lengths.data(); }
+    const uint8_t* documentPriors() const override { return priors.data(); }
+    ImpactIndexView impactIndex() const override { return impacts.view(); }
+    uint64_t titleTokenCount() const override { return titleTokens; }
+    uint64_t contentTokenCount() const override { return contentTokens; }
+    size_t dictionaryBytes() const override;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+using namespace std;
+
+/**
+ * QueryPhase: Stages a query's wall time is split into. Postings traversal
+ * and scoring are interleaved document-at-a-time, so Rank covers both.
+ */
+enum class QueryPhase {
+    Tokenize,   // Parsing the query into terms
+    Lookup,     // Dictionary lookups and document frequencies
+    Rank,       // Posting traversal and scoring into the top-k heap
+    Sort,       // Ordering (and merging) the top k
+    Snippets    // Stored fields and snippets of the results
+};
+
+const size_t kQueryPhaseCount = 5;
+const char* queryPhaseName(QueryPhase phase);
+
+/**
+ * QueryMetrics: Cost of one query. Counters are always filled in; phase
+ * times only for sampled queries.
+ */
+struct QueryMetrics {
+    uint64_t phaseNanos[kQueryPhaseCount];
+    uint64_t postingsScanned;       // Postings decoded or probed
+    uint64_t candidatesScored;      // Documents scored in full
+    uint64_t results;
+    bool cacheHit;
+    bool sampled;
+
+    QueryMetrics();
+    uint64_t totalNanos() const;
+};
+
+/**
+ * SearchMetrics: Query totals since the engine was created
+ */
+struct SearchMetrics {
+    uint64_t queries;
+    uint64_t cacheHits;
+    uint64_t sampledQueries;
+    uint64_t phaseNanos[kQueryPhaseCount];  // Summed over sampled queries
+    uint64_t postingsScanned;
+    uint64_t candidatesScored;
+    uint64_t results;
+
+    SearchMetrics();
+    double averagePhaseMicros(QueryPhase phase) const;     // Per sampled query
+};
+
+/**
+ * IndexMemoryStats: Bytes held by each index structure over all segments.
+ * Structures of an opened index file are counted at their size in the file.
+ */
+struct IndexMemoryStats {
+    size_t dictionaryBytes;     // Term text and lookup tables
+    size_t postingBytes;        // Encoded blocks, skip headers and tails
+    size_t bitmapBytes;         // Bitmaps of frequent terms
+    size_t impactBytes;         // Impact-ordered copies of the posting lists
+    size_t positionBytes;
+    size_t lengthBytes;         // Per-document field lengths and static priors
+    size_t documentBytes;       // Stored titles, contents and URLs
+    size_t deletionBytes;
+    size_t mappedBytes;         // Size of the memory-mapped index file, if any
+
+    size_t totalBytes() const {
+        return dictionaryBytes + postingBytes + bitmapBytes + impactBytes + positionBytes +
+               lengthBytes + documentBytes + deletionBytes;
+    }
+};
+
+typedef function<void(const string& query, const QueryMetrics& metrics)> QueryObserver;
+
+/**
+ * QueryTimer: Splits a sampled query's wall time into phases; for other
+ * queries it never reads the clock
+ */
+class QueryTimer {
+private:
+    QueryMetrics& metrics;
+    chrono::steady_clock::time_point last;
+
+public:
+    explicit QueryTimer(QueryMetrics& metrics);
+    void lap(QueryPhase phase);     // Charges the time since the previous lap to phase
+};
+
+/**
+ * MetricsRegistry: Query counters kept per thread and summed when scraped.
+ * A thread only ever writes its own counters, so recording a query takes
+ * no lock and no atomic read-modify-write.
+ */
+class MetricsRegistry {
+private:
+    struct ThreadCounters;
+
+    const uint64_t id;              // Unique across registries, keys the thread-local lookup
+    atomic<uint32_t> sampleEvery;
+    mutable mutex threadsMutex;
+    vector<unique_ptr<ThreadCounters>> threads;
+    shared_ptr<const QueryObserver> observer;
+
+    ThreadCounters& local();
+
+public:
+    MetricsRegistry();
+    ~MetricsRegistry();
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    void setSampling(uint32_t every);       // Times one query in every on each thread; 0 never
+    void setObserver(QueryObserver callback);   // Called for every sampled query; empty removes it
+    bool sampleNext();                      // Whether the query starting on this thread is timed
+    void record(const string& query, const QueryMetrics& metrics);
+    SearchMetrics snapshot() const;
+};
+
+#endif
@@ -10,33 +10,470 @@
 #include <sstream>
 #include <fstream>
 #include <cmath>
+#include <cstring>
 #include <iomanip>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <future>
 #include "Document.h"
 #include "SearchResult.h"
+#include "PostingList.h"
+#include "TopK.h"
+#include "Analyzer.h"
+#include "IndexSegment.h"
+#include "IndexFile.h"
+#include "DocumentReader.h"
+#include "DocumentStore.h"
+#include "DeletionBitmap.h"
+#include "ThreadPool.h"
+#include "QueryCache.h"
+#include "Scorer.h"
+#include "BooleanQuery.h"
+#include "Metrics.h"
+#include "BitOps.h"
 
 using namespace std;
 
+/**
+ * QueryTerm: Distinct query term and how many times the query repeats it
+ */
+struct QueryTerm {
+    string text;
+    int count;
+};
+
+/**
+ * TermSuggestion: Indexed term completing a prefix
+ */
+struct TermSuggestion {
+    string term;
+    size_t documentFrequency;   // Over every segment, removed documents not yet purged included
+};
+
+/**
+ * QueryPlan: Query terms resolved against one snapshot, ready for ranking
+ */
+struct QueryPlan {
+    size_t termCount;
+    vector<int> termIds;        // termCount ids per segment, -1 where the term is absent
+    vector<double> weights;     // idf times the query count of each term
+    size_t postingTotal;        // Postings of all terms over all segments
+    ScoringParams scoring;
+    CollectionStats stats;
+    bool paged;                 // Only documents ranking after 'after' are kept
+    ScoredDocument after;
+};
+
+/**
+ * TermStatistics: What one engine knows of a query's terms. A coordinator
+ * adds up the statistics of its shards and ranks every shard with the sum,
+ * which gives each document the score a single engine holding them all would
+ */
+struct TermStatistics {
+    vector<string> terms;                   // Distinct analyzed terms, sorted
+    vector<uint64_t> documentFrequencies;   // Per term
+    uint64_t documentCount;                 // Documents still in the postings, for idf
+    uint64_t titleTokens;
+    uint64_t contentTokens;
+
+    TermStatistics();
+    void add(const TermStatistics& other);  // Terms must match, as with one analyzer
+};
+
+/**
+ * ImpactSearchOptions: Speed/quality knobs of searchImpacts()
+ */
+struct ImpactSearchOptions {
+    // Share of the query's postings scored at most. At 1 ranking stops only
+    // once no unscored posting can change the top k; below it, possibly earlier
+    double postingFraction;
+    bool withSnippets;
+
+    ImpactSearchOptions() : postingFraction(1.0), withSnippets(true) {}
+};
+
+/**
+ * SearchCursor: Where a page of searchAfter() ended; the next page holds the
+ * documents ranking after (score, documentId). The batch fields name the
+ * cached ranking the page was cut from, so the next page can be cut from it too
+ */
+struct SearchCursor {
+    double score;
+    int documentId;             // -1 before the first page
+    double batchScore;          // Position the batch was ranked after
+    int batchDocumentId;
+
+    SearchCursor();
+    bool atStart() const { return documentId < 0; }
+};
+
+/**
+ * SearchPage: One page of searchAfter() results and the cursor of the next
+ */
+struct SearchPage {
+    vector<SearchResult> results;
+    SearchCursor next;
+    bool more;                  // False once no document ranks after this page
+};
+
+/**
+ * AsyncSearchStats: What searchAsync() did to keep threads from blocking on
+ * page faults. A query waits for its pages until they are resident or
+ * kPrefetchWaitMillis pass
+ */
+struct AsyncSearchStats {
+    uint64_t queries;
+    uint64_t waited;            // Queries that found some of their pages missing
+    uint64_t timedOut;          // Of those, queries that ran before all pages arrived
+    uint64_t pagesRequested;    // Mapped pages read ahead for the queries that waited
+
+    AsyncSearchStats();
+};
+
+// Receives the results of searchAsync() on one of the engine's async threads
+typedef function<void(vector<SearchResult> results)> SearchCallback;
+
+/**
+ * IndexSnapshot: Immutable generation of the index that queries run against.
+ * Published segments are never modified, so any number of readers can share
+ * a snapshot without locking while writers prepare the next one.
+ */
+struct IndexSnapshot {
+    vector<shared_ptr<const Segment>> segments;             // In doc-id order
+    vector<shared_ptr<const DeletionBitmap>> deletions;     // Per segment, null if none
+    shared_ptr<const IndexFile> file;                       // Mapped base index, if any
+    shared_ptr<const DocumentStore> store;                  // Fields of documents after the base
+    size_t storeBytes;                                      // Held by store when published
+    int endDocId;                                           // Documents below this are visible
+    size_t deletedCount;
+    size_t purgedCount;                                     // Deleted and gone from the postings
+    uint64_t generation;                                    // Increases with every published change
+    ScoringParams scoring;
+    uint64_t titleTokens;                                   // Field lengths summed over all segments
+    uint64_t contentTokens;
+
+    const Segment& segmentFor(int docId) const;
+    DocumentView document(int docId) const;
+    bool isDeleted(int docId) const;
+    size_t documentCount() const { return static_cast<size_t>(endDocId) - deletedCount; }   // Live documents
+    // Documents still present in the postings, removed or not. Used for IDF
+    // so that a document frequency never exceeds it
+    size_t postedDocumentCount() const { return static_cast<size_t>(endDocId) - purgedCount; }
+    // k, but no more than the snapshot's documents, so heaps are never sized by the caller alone
+    size_t resultLimit(size_t k) const { return min(k, static_cast<size_t>(max(endDocId, 0))); }
+    CollectionStats collectionStats() const;
+};
+
+/**
+ * SealedSegment: Writer-side record of a published segment and its deletions
+ */
+struct SealedSegment {
+    shared_ptr<const Segment> segment;
+    shared_ptr<DeletionBitmap> deleted;     // Null until a document is deleted
+    bool published;     // deleted is shared with a snapshot and is copied before changing
+    size_t purged;      // Deleted documents whose postings are already gone
+};
+
+/**
+ * MergeStats: Cost of background segment merges. Write amplification is the
+ * total bytes written (sealed plus merged) divided by the bytes sealed.
+ */
+struct MergeStats {
+    size_t segmentsSealed;      // Pending segments frozen by publishing
+    size_t merges;
+    size_t segmentsMerged;
+    size_t documentsMerged;
+    size_t bytesSealed;
+    size_t bytesMerged;
+    double seconds;
+
+    MergeStats();
+    double writeAmplification() const;
+};
+
 /**
  * MiniSearchEngine: Full-featured search engine implementation
  */
 class MiniSearchEngine {
 private:
-    vector<Document> documents;
-    unordered_map<string, unordered_set<int>> invertedIndex;
-    unordered_map<int, unordered_map<string, int>> termFrequency;
-    unordered_map<string, int> documentFrequency;
+    // Writer state, guarded by writeMutex. New documents go to the pending
+    // segment and become visible when it is sealed into a new snapshot
+    mutex writeMutex;
+    PostingCodec codec;
+    bool impactOrdered;     // Segments are frozen and merged with impact-ordered lists
+    // Settings for documents and queries alike. Every user works on a copy,
+    // so this one is never written and needs no lock
+    const Analyzer analyzer;
+    shared_ptr<const IndexFile> baseIndex;      // Mapped index opened from disk, if any
+    shared_ptr<DocumentStore> store;            // Stored fields of the in-memory documents
+    unique_ptr<IndexSegment> pending;
+    vector<SealedSegment> sealed;
+    bool deletionsPending;
+    // Changes not yet published are published by the merge thread at
+    // flushDeadline, refreshMillis after the first of them (0 never)
+    bool flushScheduled;
+    chrono::steady_clock::time_point flushDeadline;
+    int refreshMillis;
+    uint64_t generation;        // Of the last snapshot installed
+    ScoringParams scoring;
+
+    // Current generation, replaced with atomic_store and read with atomic_load
+    shared_ptr<const IndexSnapshot> current;
 
-    string preprocessText(const string& text);
-    vector<string> tokenize(const string& text);
-    double calculateTFIDF(const string& term, int docId);
-    string generateSnippet(const Document& doc, const vector<string>& queryTerms);
+    // Intra-query parallelism; queries touching fewer postings than
+    // parallelMinPostings run on the calling thread alone
+    shared_ptr<ThreadPool> searchPool;
+    atomic<size_t> parallelMinPostings;
+    // Threads of searchBatch() without a search pool, created on first use
+    // and kept, so their per-thread scratch survives from batch to batch
+    mutex batchMutex;
+    shared_ptr<ThreadPool> batchPool;
+
+    // Optional result cache in front of search(), replaced atomically
+    shared_ptr<QueryCache> queryCache;
+    // Rankings of kCursorBatchPages pages ahead for searchAfter(), keyed by
+    // the query, the page size and the position they were ranked after
+    QueryCache cursorCache;
+    MetricsRegistry queryMetrics;
+
+    // Asynchronous queries, started with the first searchAsync(). A query
+    // whose postings are mapped but not resident waits in parkedQueries
+    // while the kernel reads them in, and pagerThread hands it back to
+    // asyncPool once they are, so no async thread blocks on a page fault
+    struct AsyncQuery {
+        string query;
+        int maxResults;
+        bool withSnippets;
+        SearchCallback done;
+        // Resolved while reading ahead and reused to run the query
+        shared_ptr<const IndexSnapshot> index;
+        vector<QueryTerm> terms;
+        QueryPlan plan;
+        PageSet pages;
+        chrono::steady_clock::time_point deadline;
+    };
+    mutex asyncMutex;
+    condition_variable asyncWakeup;
+    shared_ptr<ThreadPool> asyncPool;
+    unsigned asyncThreads;      // 0 for one per core
+    vector<shared_ptr<AsyncQuery>> parkedQueries;
+    thread pagerThread;
+    bool asyncStopping;
+    atomic<uint64_t> asyncQueries;
+    atomic<uint64_t> asyncWaited;
+    atomic<uint64_t> asyncTimedOut;
+    atomic<uint64_t> asyncPages;
+
+    // Background merging of sealed segments, also guarded by writeMutex
+    thread mergeThread;
+    condition_variable mergeWakeup;
+    condition_variable mergeIdle;
+    bool mergeRunning;
+    bool stopping;
+    MergeStats mergeTotals;
+
+    // Pending segments are sealed once they reach this many documents
+    static const size_t kMaxPendingDocuments = 4096;
+    // The tiered merge policy combines this many adjacent segments of one size
+    // tier; tier t holds segments of kMergeBaseDocuments * kMergeFactor^t
+    // documents or more
+    static const size_t kMergeFactor = 4;
+    static const size_t kMergeBaseDocuments = 64;
+    // A segment is rewritten on its own once this share of it is deleted but not purged
+    static const size_t kRewriteDeletedPercent = 25;
+    // Doc-id ranges per pool thread for a parallel query; more ranges than
+    // threads lets stealing even out segments of unequal density
+    static const size_t kRangesPerSearchThread = 4;
+    // Queries handed to a pool thread at a time by searchBatch
+    static const size_t kBatchQueriesPerTask = 16;
+    // A prefix in a boolean query matches its this many most frequent completions
+    static const size_t kMaxPrefixTerms = 64;
+    // searchAfter() ranks this many pages at once and keeps this many batches
+    static const size_t kCursorBatchPages = 10;
+    static const size_t kCursorCacheEntries = 256;
+    static const size_t kMaxCursorBatch = 1 << 16;     // Results ranked ahead at most
+    // Longest a query waits for its pages, and how often waiting ones are checked
+    static const int kPrefetchWaitMillis = 50;
+    static const int kPagerPollMicros = 200;
+    static const int kDefaultRefreshMillis = 100;
+
+    void publish();     // Requires writeMutex
+    void sealPending();
+    void installSnapshot();
+    void scheduleFlush();   // Requires writeMutex; called after each unpublished change
+    bool deleteDocument(int docId);
+    bool findMerge(size_t& first, size_t& count) const;
+    void mergeLoop();
+    shared_ptr<const IndexSnapshot> snapshot();
+    void indexDocuments(const vector<DocumentView>& batch, unsigned threadCount);
+    shared_ptr<ThreadPool> startAsync();
+    shared_ptr<ThreadPool> batchPoolFor(unsigned threadCount);
+    void prefetchQuery(const shared_ptr<AsyncQuery>& query);   // Runs the query or parks it
+    void runAsync(AsyncQuery& query);
+    void pagerLoop();
+
+    vector<QueryTerm> resolveQuery(const string& query) const;
+    static vector<QueryTerm> countTerms(vector<string>& texts);
+    static string cacheKey(const vector<QueryTerm>& queryTerms, int maxResults, bool withSnippets);
+    static string cursorKey(const vector<QueryTerm>& queryTerms, size_t batchSize,
+                            double score, int documentId);
+    // Most frequent completions of a normalized prefix, ties in term order
+    static vector<TermSuggestion> completeTerm(const IndexSnapshot& index, const string& prefix,
+                                               size_t maxTerms);
+    static void expandPrefixes(const IndexSnapshot& index, QueryNode& node);
+    // Dispatches to rankSegmentWith for the plan's scoring model
+    static void rankSegment(const Segment& segment, const DeletionBitmap* deleted,
+                            const QueryPlan& plan, size_t segmentIndex,
+                            int fromDoc, int toDoc, TopKHeap& heap);
+    template <class Scorer>
+    static void rankSegmentWith(const Segment& segment, const DeletionBitmap* deleted,
+                                const QueryPlan& plan, size_t segmentIndex,
+                                int fromDoc, int toDoc, TopKHeap& heap);
+    // Boolean ranking: plain conjunctions of terms are intersected and scored
+    // in one pass; other trees are matched first and then scored. tableIds
+    // holds the segment's id for each entry of the tree's term table
+    static void rankBoolean(const Segment& segment, const DeletionBitmap* deleted,
+                            const QueryPlan& plan, size_t segmentIndex, const QueryNode& root,
+                            const int* tableIds, bool conjunction, TopKHeap& heap);
+    template <class Scorer>
+    static void rankConjunction(const Segment& segment, const DeletionBitmap* deleted,
+                                const QueryPlan& plan, size_t segmentIndex,
+                                const vector<int>& excludedIds, TopKHeap& heap);
+    // Scores documents known to match, summing terms in the same order as rankSegmentWith
+    template <class Scorer>
+    static void scoreMatches(const Segment& segment, const QueryPlan& plan, size_t segmentIndex,
+                             const vector<int>& matches, TopKHeap& heap);
+    // Impact ranking: postings are scored in falling impact order until the
+    // rest cannot change the top k or the segment's share of the budget is
+    // spent; then the k best are rescored exactly. Segments without impact
+    // lists are scored in full from their doc-id lists
+    static void rankImpacts(const Segment& segment, const DeletionBitmap* deleted,
+                            const QueryPlan& plan, size_t segmentIndex, size_t k,
+                            double postingFraction, TopKHeap& heap);
+    // Weights and collection statistics come from global when given, else
+    // from index; terms global lacks keep their frequency in index
+    static void planQuery(const IndexSnapshot& index, const vector<QueryTerm>& queryTerms,
+                          QueryPlan& plan, const TermStatistics* global = nullptr);
+    vector<ScoredDocument> rankPlan(const IndexSnapshot& index, const QueryPlan& plan,
+                                    size_t k, bool allowParallel, QueryTimer& timer) const;
+    vector<ScoredDocument> rankDocuments(const IndexSnapshot& index,
+                                         const vector<QueryTerm>& queryTerms, size_t k,
+                                         QueryTimer& timer,
+                                         const TermStatistics* global = nullptr) const;
+    vector<ScoredDocument> rankQuery(const string& query, int maxResults,
+                                     const TermStatistics* global);
+    // search() once the query is resolved; planned, if given, is used
+    // instead of planning the query again
+    vector<SearchResult> searchWith(const IndexSnapshot& index, const vector<QueryTerm>& queryTerms,
+                                    const QueryPlan* planned, const string& query,
+                                    int maxResults, bool withSnippets, QueryMetrics& metrics,
+                                    QueryTimer& timer);
+    // Snippets find the query terms through the ids plan resolved for them
+    static vector<SearchResult> buildResults(const IndexSnapshot& index,
+                                             const vector<ScoredDocument>& ranked,
+                                             const QueryPlan& plan, bool withSnippets);
+    static string generateSnippet(const IndexSnapshot& index, const DocumentView& doc,
+                                  const QueryPlan& plan);
 
 public:
-    void addDocument(const string& title, const string& content, const string& url = "");
-    vector<SearchResult> search(const string& query, int maxResults = 10);
+    // Documents and queries go through an analyzer built from analysis;
+    // index files record it, and only open in an engine with the same one
+    explicit MiniSearchEngine(PostingCodec codec = PostingCodec::VarByte,
+                              const AnalyzerOptions& analysis = AnalyzerOptions());
+    ~MiniSearchEngine();
+    MiniSearchEngine(const MiniSearchEngine&) = delete;
+    MiniSearchEngine& operator=(const MiniSearchEngine&) = delete;
+
+    int addDocument(const string& title, const string& content, const string& url = "");   // Returns the docId
+    bool removeDocument(int docId);     // False if docId is unknown or already removed
+    // Replaces a document; it gets a new docId, which is returned (-1 if docId is not live)
+    int updateDocument(int docId, const string& title, const string& content, const string& url = "");
+    // Bulk build: ids are assigned in batch order, exactly as repeated addDocument calls would
+    void addDocuments(vector<Document> batch, unsigned threadCount = 0);
+    void refresh();     // Publishes pending documents, waiting for the writer if needed
+    // Queries never publish; changes left pending by writers are published
+    // this long after the first of them (0 waits for refresh() or a full
+    // pending segment)
+    void setRefreshInterval(int millis);
+    void waitForMerges();   // Blocks until the merge policy has nothing left to do
+    // Splits expensive queries across threadCount threads (<= 1 disables);
+    // a query is expensive when its terms have minPostings postings or more
+    void setSearchThreads(unsigned threadCount, size_t minPostings = 1 << 18);
+    MergeStats mergeStats();
+    // Switches the ranking function; queries started afterwards use it
+    void setScoring(const ScoringParams& params);
+    // Segments sealed or merged from now on also keep their postings in
+    // impact order, for searchImpacts(); off by default since it costs
+    // about as much memory as the doc-id lists
+    void setImpactOrdering(bool enabled);
+    // Caches up to capacity result lists of search() (0 disables); entries
+    // computed before the index last changed are never returned
+    void setQueryCache(size_t capacity);
+    QueryCacheStats queryCacheStats() const;
+    vector<SearchResult> search(const string& query, int maxResults = 10, bool withSnippets = true);
+    vector<ScoredDocument> searchIds(const string& query, int maxResults = 10);   // Ranking only
+    // Deep pagination: the pageSize results ranking after the cursor, which
+    // starts as SearchCursor() and is then taken from the previous page.
+    // Pages are cut from a ranking of several pages ahead, ranked again from
+    // the cursor once it is used up or the index changes, so a page costs
+    // about the same however deep it is. Over an unchanged index the pages
+    // concatenate to search() with a larger maxResults
+    SearchPage searchAfter(const string& query, const SearchCursor& cursor = SearchCursor(),
+                           int pageSize = 10, bool withSnippets = true);
+    // Runs many queries against one snapshot, looking each distinct term up once.
+    // threadCount 0 uses the search pool, or one thread per core if none is set
+    vector<vector<SearchResult>> searchBatch(const vector<string>& queries, int maxResults = 10,
+                                             bool withSnippets = true, unsigned threadCount = 0);
+    // Sharding: a coordinator gathers termStatistics() from every shard,
+    // ranks each with the sum and fetches the fields of the merged top k.
+    // Each call reads the snapshot current at the time
+    TermStatistics termStatistics(const string& query);
+    vector<ScoredDocument> searchIds(const string& query, int maxResults,
+                                     const TermStatistics& global);
+    vector<SearchResult> fetchResults(const string& query, const vector<ScoredDocument>& ranked,
+                                      bool withSnippets = true);
+    // Queries on a small pool of async threads, which never wait on page
+    // faults of a mapped index: a query first reads its posting pages ahead
+    // and steps aside until they arrive. Results equal those of search();
+    // callbacks must not destroy the engine
+    void searchAsync(const string& query, int maxResults, bool withSnippets, SearchCallback done);
+    future<vector<SearchResult>> searchAsync(const string& query, int maxResults = 10,
+                                             bool withSnippets = true);
+    // Async threads; used if called before the first searchAsync()
+    void setAsyncThreads(unsigned threadCount);
+    AsyncSearchStats asyncSearchStats() const;
+    // Boolean syntax: AND (or adjacency), OR, NOT or '-', parentheses,
+    // "quoted phrases" and prefix* wildcards, which match the most frequent
+    // completions of the prefix. Only matching documents are scored
+    vector<SearchResult> searchBoolean(const string& query, int maxResults = 10,
+                                       bool withSnippets = true);
+    // Top-k ranking by index-time impacts: ImpactScorer's quantized BM25
+    // whatever setScoring() chose, plus the static prior at its weight.
+    // Results are not cached
+    vector<SearchResult> searchImpacts(const string& query, int maxResults = 10,
+                                       const ImpactSearchOptions& options = ImpactSearchOptions());
+    // Indexed terms starting with prefix (a trailing '*' is ignored), most
+    // frequent first; for autocomplete
+    vector<TermSuggestion> prefixSearch(const string& prefix, size_t maxTerms = 10);
     void printResults(const vector<SearchResult>& results, const string& query);
-    void loadFromFile(const string& filename);
+    // Streams a pipe-separated file, indexing it in batches of batchSize lines
+    LoadStats loadFromFile(const string& filename, size_t batchSize = 65536);
+    bool saveIndex(const string& path);     // Writes a versioned binary index file
+    bool openIndex(const string& path);     // Replaces the index with a memory-mapped file
     void printStats();
+    // Query totals, summed over per-thread counters when called. Phases are
+    // timed for one query in every sampleEvery on each thread; the default
+    // of 0 never reads the clock. Batches time ranking and snippets only
+    void setQueryMetricsSampling(uint32_t sampleEvery);
+    void setQueryObserver(QueryObserver observer);  // Called on the query's thread for sampled queries
+    SearchMetrics searchMetrics() const;
+    // Memory of the published index; pending documents count once they are
+    // published, so call refresh() first for up-to-date figures
+    IndexMemoryStats memoryStats();
 };
 
 #endif
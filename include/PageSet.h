@@ -0,0 +1,33 @@
+#ifndef PAGESET_H
+#define PAGESET_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+using namespace std;
+
+/**
+ * PageSet: Pages of mapped memory that a query is about to read. The
+ * kernel can be asked to start reading them in, and polled until they all
+ * are; where neither is possible the pages count as resident.
+ */
+class PageSet {
+private:
+    vector<uintptr_t> ranges;   // Page-aligned [begin, end) pairs
+    size_t pages;
+
+    static size_t pageSize();
+
+public:
+    PageSet() : pages(0) {}
+
+    void add(const void* data, size_t bytes);
+    void clear();
+    bool empty() const { return ranges.empty(); }
+    size_t pageCount() const { return pages; }
+
+    void willNeed() const;      // Starts asynchronous read-ahead of every page
+    bool resident() const;      // True once no page would fault
+};
+
+#endif
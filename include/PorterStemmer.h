@@ -0,0 +1,17 @@
+#ifndef PORTERSTEMMER_H
+#define PORTERSTEMMER_H
+
+#include <cstddef>
+using namespace std;
+
+/**
+ * PorterStemmer: Martin Porter's suffix-stripping stemmer for lowercase
+ * English words, with the departures of his reference implementation. A
+ * stem is never longer than its word, so words are stemmed in place.
+ */
+class PorterStemmer {
+public:
+    static size_t stem(char* word, size_t length);     // Returns the stem's length
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef POSITIONSTORE_H
+#define POSITIONSTORE_H
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include "Tokenizer.h"
+#include "DeletionBitmap.h"
+using namespace std;
+
+/**
+ * TermPositions: Run of positions for one term inside one document
+ */
+struct TermPositions {
+    int termId;
+    uint32_t start;    // First entry in the positions array
+    uint32_t count;
+};
+
+/**
+ * PositionStoreView: Read-only view of a position store, backed either by a
+ * PositionStore or by a mapped index file. Documents are numbered from 0.
+ */
+struct PositionStoreView {
+    uint32_t documentCount;
+    const uint32_t* spanStart;      // Per document, first entry in spans (+ sentinel)
+    const uint32_t* termStart;      // Per document, first entry in terms (+ sentinel)
+    const TokenSpan* spans;
+    const TermPositions* terms;     // Sorted by termId within each document
+    const uint32_t* positions;      // Token indices into the document's spans
+
+    size_t tokenCount(int doc) const { return spanStart[doc + 1] - spanStart[doc]; }
+    const TokenSpan* tokens(int doc) const { return spans + spanStart[doc]; }
+    pair<const uint32_t*, const uint32_t*> termPositions(int doc, int termId) const;
+    pair<const TermPositions*, const TermPositions*> termEntries(int doc) const {
+        return make_pair(terms + termStart[doc], terms + termStart[doc + 1]);
+    }
+    size_t spanCount() const { return spanStart[documentCount]; }
+    size_t termEntryCount() const { return termStart[documentCount]; }
+    size_t positionCount() const;
+    size_t memoryBytes() const;
+};
+
+/**
+ * PositionStore: Per-document token offsets and per-term token positions,
+ * kept in flat arrays shared by all documents
+ */
+class PositionStore {
+private:
+    vector<uint32_t> spanStart;
+    vector<uint32_t> termStart;
+    vector<TokenSpan> spans;
+    vector<TermPositions> terms;
+    vector<uint32_t> positions;
+
+public:
+    PositionStore();
+
+    // Documents must be added in docId order; termIds runs parallel to tokenSpans
+    void addDocument(const vector<TokenSpan>& tokenSpans, const vector<int>& termIds);
+    // Appends every document of other, translating its term ids through termIdMap
+    // Deleted documents of other, if given, are appended with no tokens
+    void append(const PositionStoreView& other, const vector<int>& termIdMap,
+                const DeletionBitmap* deleted = nullptr);
+    // Translates every term id through termIdMap in place
+    void renumberTerms(const vector<int>& termIdMap);
+
+    PositionStoreView view() const;
+};
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef POSTINGLIST_H
+#define POSTINGLIST_H
+
+#include <vector>
+#include <cstdint>
+#include <climits>
+using namespace std;
+
+/**
+ * Posting: A document and how often the term occurs in it, in total and
+ * in the title alone
+ */
+struct Posting {
+    int docId;
+    int tf;
+    int titleTf;        // Title occurrences, included in tf
+};
+
+/**
+ * PostingCodec: Encoding used for the payload of full posting blocks
+ */
+enum class PostingCodec {
+    Raw,        // Fixed 32-bit gaps and frequencies (uncompressed baseline)
+    VarByte,    // Variable-byte (LEB128) gaps and frequencies
+    BitPacked   // Per-block bit width, BP128-style frame of reference
+};
+
+const char* postingCodecName(PostingCodec codec);
+
+/**
+ * PostingBlock: Skip entry for one compressed block of postings
+ */
+struct PostingBlock {
+    int maxDocId;       // Last docId in the block, used to skip it
+    int maxTf;          // Largest tf in the block, bounds its score contribution
+    int maxTitleTf;     // Largest titleTf in the block; 0 means no title stream is stored
+    uint32_t offset;    // Byte offset of the block payload
+};
+
+const int kPostingBlockSize = 128;
+const int kEndDocId = INT_MAX;      // Iterator position once exhausted
+
+/**
+ * PostingListView: Read-only view of an encoded posting list; it can point
+ * into a PostingList or straight into the pages of a mapped index file
+ */
+struct PostingListView {
+    PostingCodec codec;
+    const PostingBlock* blocks;
+    uint32_t blockCount;
+    const uint8_t* data;        // Block payloads, addressed by PostingBlock::offset
+    uint64_t dataSize;
+    const Posting* tail;        // Postings not yet packed into a full block
+    uint32_t tailCount;
+    int tailMaxTf;
+    int tailMaxTitleTf;
+    uint32_t count;
+    int maxTf;
+    int maxTitleTf;
+
+    size_t size() const { return count; }   // Number of documents containing the term
+    int decodeBlock(size_t index, int* docs, int* tfs, int* titleTfs) const;
+};
+
+/**
+ * PostingIterator: Forward cursor that decodes one block at a time and uses
+ * the block headers to skip blocks that cannot contain a target
+ */
+class PostingIterator {
+private:
+    PostingListView list;
+    size_t blockIndex;      // Block currently decoded (blockCount = tail)
+    mutable size_t boundBlock;  // Last block blockMaxima() found, where the next search starts
+    int position;           // Index inside the decoded block
+    int blockCount;
+    size_t decoded;         // Postings loaded so far, for query metrics
+    int docs[kPostingBlockSize];
+    int tfs[kPostingBlockSize];
+    int titleTfs[kPostingBlockSize];
+
+    void loadBlock(size_t index);
+    // First block from index on whose last docId reaches target, or the tail
+    size_t findBlock(size_t index, int target) const;
+
+public:
+    explicit PostingIterator(const PostingListView& list);
+
+    int docId() const { return position < blockCount ? docs[position] : kEndDocId; }
+    int tf() const { return tfs[position]; }
+    int titleTf() const { return titleTfs[position]; }
+    void next();
+    void advance(int target);   // Move to the first posting with docId >= target
+    // Max tf and titleTf of the block that would hold target; cheapest when
+    // targets rise from call to call, as candidates do
+    void blockMaxima(int target, int& maxTf, int& maxTitleTf) const;
+
+    // Rest of the decoded block from the current posting, for block-at-a-time scoring
+    int blockRemaining() const { return blockCount - position; }
+    const int* blockDocIds() const { return docs + position; }
+    const int* blockTfs() const { return tfs + position; }
+    const int* blockTitleTfs() const { return titleTfs + position; }
+    void nextBlock();           // Move to the first posting of the following block
+    size_t postingsDecoded() const { return decoded; }
+};
+
+/**
+ * PostingList: Delta-encoded postings for a single term, split into
+ * fixed-size compressed blocks plus an uncompressed tail still being filled
+ */
+class PostingList {
+private:
+    PostingCodec codec;
+    vector<PostingBlock> blocks;
+    vector<uint8_t> data;
+    vector<Posting> tail;
+    size_t count;
+    int maxTf;
+    int tailMaxTf;
+    int maxTitleTf;
+    int tailMaxTitleTf;
+
+    void flushTail();
+
+public:
+    explicit PostingList(PostingCodec codec = PostingCodec::VarByte);
+
+    // docIds must be appended in increasing order; titleTf counts within tf
+    void add(int docId, int tf, int titleTf = 0);
+    void append(const PostingListView& other);   // other's docIds must all be larger
+    size_t size() const;           // Number of documents containing the term
+    size_t memoryBytes() const;    // Encoded payload plus headers and tail
+    int maxTermFrequency() const;  // Upper bound used for query-time pruning
+
+    PostingListView view() const;
+    PostingIterator iterator() const;
+};
+
+#endif
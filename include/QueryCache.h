@@ -0,0 +1,70 @@
+#ifndef QUERYCACHE_H
+#define QUERYCACHE_H
+
+#include <vector>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include "SearchResult.h"
+using namespace std;
+
+/**
+ * QueryCacheStats: Counters summed over all shards of a QueryCache
+ */
+struct QueryCacheStats {
+    size_t hits;
+    size_t misses;
+    size_t evictions;       // Entries dropped to make room
+    size_t invalidations;   // Entries dropped because the index changed
+    size_t entries;
+
+    double hitRate() const {
+        return (hits + misses) > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0;
+    }
+};
+
+/**
+ * QueryCache: Sharded LRU cache of result lists. Each entry records the
+ * index generation it was computed on and is only returned for that
+ * generation; stale entries are dropped when they are next looked up.
+ */
+class QueryCache {
+private:
+    struct Entry {
+        string key;
+        uint64_t generation;
+        vector<SearchResult> results;
+    };
+
+    struct Shard {
+        mutex lock;
+        list<Entry> entries;    // Most recently used first
+        unordered_map<string, list<Entry>::iterator> index;
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t invalidations;
+    };
+
+    unique_ptr<Shard[]> shards;
+    size_t shardCount;
+    size_t shardCapacity;
+
+    Shard& shardFor(const string& key) const;
+
+public:
+    explicit QueryCache(size_t capacity, size_t shardCount = 16);
+    QueryCache(const QueryCache&) = delete;
+    QueryCache& operator=(const QueryCache&) = delete;
+
+    // Copies the cached results into results; false on a miss or a stale entry
+    bool find(const string& key, uint64_t generation, vector<SearchResult>& results);
+    void insert(const string& key, uint64_t generation, const vector<SearchResult>& results);
+    void clear();
+    QueryCacheStats stats() const;
+};
+
+#endif
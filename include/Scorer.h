@@ -0,0 +1,201 @@
+#ifndef SCORER_H
+#define SCORER_H
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include "Segment.h"
+using namespace std;
+
+/**
+ * ScoringModel: Relevance function used to rank documents
+ */
+enum class ScoringModel {
+    TfIdf,      // Field-weighted tf times idf
+    BM25,       // Okapi BM25 over the whole document
+    BM25F       // BM25 over field-weighted, per-field length-normalized tf
+};
+
+const char* scoringModelName(ScoringModel model);
+
+/**
+ * ScoringParams: Scoring model and its tuning knobs
+ */
+struct ScoringParams {
+    ScoringModel model;
+    double titleWeight;     // TF-IDF and BM25F: weight of one title occurrence
+    double contentWeight;   // TF-IDF and BM25F: weight of one content occurrence
+    double k1;              // BM25 and BM25F: tf saturation
+    double b;               // BM25: document length normalization
+    double titleB;          // BM25F: per-field length normalization
+    double contentB;
+    double priorWeight;     // Added to scores times the document's static prior, 0-1
+
+    explicit ScoringParams(ScoringModel model = ScoringModel::TfIdf);
+};
+
+/**
+ * CollectionStats: Corpus-wide figures that scores are normalized by
+ */
+struct CollectionStats {
+    size_t documentCount;           // Documents still in the postings, for idf
+    double averageTitleLength;
+    double averageContentLength;
+};
+
+double scoringIDF(ScoringModel model, size_t documentFrequency, size_t documentCount);
+
+// What a document's static prior adds to its score, at most priorWeight
+inline double priorScore(const ScoringParams& params, uint8_t prior) {
+    return params.priorWeight * prior / 255.0;
+}
+
+// Scorer policies. Ranking is instantiated once per policy so each gets its
+// own inlined posting loop. A policy is built per segment and provides
+//   static double idf(df, N)
+//   double bound(maxTf, maxTitleTf)   upper bound of score() for those maxima
+//   double score(doc, tf, titleTf)    doc numbered from the segment's base
+// Term weights (idf times query count) multiply both.
+
+/**
+ * TfIdfScorer: Occurrences weighted by field; titleWeight 2 and
+ * contentWeight 1 count a title occurrence twice
+ */
+class TfIdfScorer {
+private:
+    double contentWeight;
+    double titleExtra;      // Added on top of contentWeight for title occurrences
+
+public:
+    TfIdfScorer(const ScoringParams& params, const CollectionStats&, const Segment&)
+        : contentWeight(params.contentWeight), titleExtra(params.titleWeight - params.contentWeight) {}
+
+    static double idf(size_t documentFrequency, size_t documentCount) {
+        return log(static_cast<double>(documentCount) / static_cast<double>(documentFrequency));
+    }
+    double bound(int maxTf, int maxTitleTf) const {
+        return contentWeight * maxTf + max(titleExtra, 0.0) * maxTitleTf;
+    }
+    double score(int, int tf, int titleTf) const {
+        return contentWeight * tf + titleExtra * titleTf;
+    }
+};
+
+/**
+ * BM25Scorer: Okapi BM25 on the total tf, normalized by title plus content length
+ */
+class BM25Scorer {
+private:
+    const DocumentLength* lengths;
+    double k1PlusOne;
+    double lengthBase;      // k1 * (1 - b)
+    double lengthScale;     // k1 * b / average length
+
+public:
+    BM25Scorer(const ScoringParams& params, const CollectionStats& stats, const Segment& segment)
+        : lengths(segment.documentLengths()), k1PlusOne(params.k1 + 1.0),
+          lengthBase(params.k1 * (1.0 - params.b)) {
+        double average = stats.averageTitleLength + stats.averageContentLength;
+        lengthScale = params.k1 * params.b / (average > 0.0 ? average : 1.0);
+    }
+
+    static double idf(size_t documentFrequency, size_t documentCount) {
+        double df = static_cast<double>(documentFrequency);
+        return log(1.0 + (static_cast<double>(documentCount) - df + 0.5) / (df + 0.5));
+    }
+    double bound(int maxTf, int) const {
+        return maxTf * k1PlusOne / (maxTf + lengthBase);
+    }
+    double score(int doc, int tf, int) const {
+        double length = static_cast<double>(lengths[doc].title) + lengths[doc].content;
+        return tf * k1PlusOne / (tf + lengthBase + lengthScale * length);
+    }
+};
+
+/**
+ * BM25FScorer: Title and content frequencies are length-normalized per
+ * field and weighted before one BM25 saturation
+ */
+class BM25FScorer {
+private:
+    const DocumentLength* lengths;
+    double titleWeight;
+    double contentWeight;
+    double k1;
+    double titleBase;       // 1 - b of the field
+    double titleScale;      // b of the field / its average length
+    double contentBase;
+    double contentScale;
+
+public:
+    BM25FScorer(const ScoringParams& params, const CollectionStats& stats, const Segment& segment)
+        : lengths(segment.documentLengths()), titleWeight(params.titleWeight),
+          contentWeight(params.contentWeight), k1(params.k1),
+          titleBase(1.0 - params.titleB), contentBase(1.0 - params.contentB) {
+        titleScale = params.titleB / (stats.averageTitleLength > 0.0 ? stats.averageTitleLength : 1.0);
+        contentScale = params.contentB /
+                       (stats.averageContentLength > 0.0 ? stats.averageContentLength : 1.0);
+    }
+
+    static double idf(size_t documentFrequency, size_t documentCount) {
+        return BM25Scorer::idf(documentFrequency, documentCount);
+    }
+    double bound(int maxTf, int maxTitleTf) const {
+        // Field lengths of 0 give the smallest normalizers, 1 - b
+        if (titleBase <= 0.0 || contentBase <= 0.0) return k1 + 1.0;
+        double tf = titleWeight * maxTitleTf / titleBase + contentWeight * maxTf / contentBase;
+        return tf * (k1 + 1.0) / (tf + k1);
+    }
+    double score(int doc, int tf, int titleTf) const {
+        double weighted = 0.0;
+        if (titleTf > 0) {
+            weighted += titleWeight * titleTf / (titleBase + titleScale * lengths[doc].title);
+        }
+        if (tf > titleTf) {
+            weighted += contentWeight * (tf - titleTf) /
+                        (contentBase + contentScale * lengths[doc].content);
+        }
+        return weighted * (k1 + 1.0) / (weighted + k1);
+    }
+};
+
+/**
+ * ImpactScorer: BM25 with default parameters, fixed when a segment is
+ * frozen and quantized to kLevels steps of its (0, k1 + 1) range so that
+ * postings can be sorted by it. Lengths are normalized by the segment's own
+ * average, the only one known at that point.
+ */
+class ImpactScorer {
+private:
+    const DocumentLength* lengths;
+    double k1PlusOne;
+    double lengthBase;      // k1 * (1 - b)
+    double lengthScale;     // k1 * b / average length
+
+public:
+    static const uint32_t kLevels = 255;
+
+    explicit ImpactScorer(const Segment& segment) : lengths(segment.documentLengths()) {
+        ScoringParams params(ScoringModel::BM25);
+        size_t documents = segment.documentCount();
+        double average = documents ? static_cast<double>(segment.titleTokenCount() +
+                                                         segment.contentTokenCount()) / documents
+                                   : 0.0;
+        k1PlusOne = params.k1 + 1.0;
+        lengthBase = params.k1 * (1.0 - params.b);
+        lengthScale = params.k1 * params.b / (average > 0.0 ? average : 1.0);
+    }
+
+    static double idf(size_t documentFrequency, size_t documentCount) {
+        return BM25Scorer::idf(documentFrequency, documentCount);
+    }
+    uint32_t impact(int doc, int tf) const {
+        double length = static_cast<double>(lengths[doc].title) + lengths[doc].content;
+        double share = tf / (tf + lengthBase + lengthScale * length);
+        long level = lround(share * kLevels);
+        return static_cast<uint32_t>(max(1L, min(static_cast<long>(kLevels), level)));
+    }
+    double value(uint32_t impact) const { return impact * k1PlusOne / kLevels; }
+};
+
+#endif
@@ -2,21 +2,24 @@
 #define SEARCHRESULT_H
 
 #include <string>
+#include "StringRef.h"
 using namespace std;
 
 /**
- * SearchResult: Encapsulates search results with relevance scoring
+ * SearchResult: Encapsulates search results with relevance scoring. Title and
+ * url reference the engine's document store and stay valid until the engine
+ * is destroyed or openIndex() replaces its contents.
  */
 class SearchResult {
 public:
     int documentId;
     double score;      // TF-IDF relevance score
-    string title;
+    StringRef title;
     string snippet;    // Auto-generated content preview
-    string url;
+    StringRef url;
 
     SearchResult();
-    SearchResult(int id, double s, const string& t, const string& snip, const string& u = "");
+    SearchResult(int id, double s, StringRef t, const string& snip, StringRef u = StringRef());
 };
 
 #endif
@@ -0,0 +1,76 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <string>
+#include <vector>
+#include "PostingList.h"
+#include "PositionStore.h"
+#include "ImpactList.h"
+#include "PageSet.h"
+#include "StringRef.h"
+using namespace std;
+
+/**
+ * DocumentLength: Token counts of the indexed fields of one document
+ */
+struct DocumentLength {
+    uint32_t title;
+    uint32_t content;
+};
+
+/**
+ * Segment: Read interface shared by in-memory and memory-mapped index
+ * segments. A segment covers the contiguous doc-id range [base, end).
+ */
+class Segment {
+public:
+    // Terms in at least one document of every kBitmapDensity get a bitmap;
+    // at that density it is no larger than their postings
+    static const size_t kBitmapDensity = 8;
+    static bool wantsBitmap(size_t postings, size_t documents) {
+        return postings * kBitmapDensity >= documents;
+    }
+    static size_t bitmapWords(size_t documents) { return (documents + 63) / 64; }
+    // Static quality of a document, 0-255: shallow URLs and titles of up to
+    // kPriorTitleTokens tokens rate higher. Known at index time only
+    static const size_t kPriorTitleTokens = 8;
+    static uint8_t documentPrior(StringRef url, size_t titleLength);
+
+    virtual ~Segment() {}
+
+    virtual int baseDocId() const = 0;
+    virtual int endDocId() const = 0;
+    virtual PostingCodec postingCodec() const = 0;
+    virtual size_t termCount() const = 0;
+    virtual string term(int termId) const = 0;
+    virtual int findTermId(const string& term) const = 0;    // -1 if the term is not indexed
+    // Appends the ids of every term starting with prefix, in term order
+    virtual void termsWithPrefix(const string& prefix, vector<int>& termIds) const = 0;
+    virtual PostingListView postingList(int termId) const = 0;
+    // Bit per document from base for terms frequent enough to have a bitmap,
+    // null for the rest
+    virtual const uint64_t* termBitmap(int termId) const = 0;
+    // Adds the mapped pages ranking termId reads: its blocks, tail and
+    // bitmap. Segments held in memory add none
+    virtual void termPages(int termId, PageSet& pages) const = 0;
+    virtual PositionStoreView positionStore() const = 0;    // Documents numbered from base
+    virtual const DocumentLength* documentLengths() const = 0;   // Per document, from base
+    virtual const uint8_t* documentPriors() const = 0;   // documentPrior() per document, from base
+    // Postings grouped by ImpactScorer impact; empty unless the segment was
+    // frozen or merged with impact ordering
+    virtual ImpactIndexView impactIndex() const = 0;
+    virtual uint64_t titleTokenCount() const = 0;       // Sums over documentLengths()
+    virtual uint64_t contentTokenCount() const = 0;
+    virtual size_t dictionaryBytes() const = 0;     // Term text and lookup tables
+
+    size_t documentCount() const { return static_cast<size_t>(endDocId() - baseDocId()); }
+    bool containsDocument(int docId) const { return docId >= baseDocId() && docId < endDocId(); }
+
+    size_t postingCount() const;
+    size_t postingBytes() const;    // Encoded payload plus block headers and tails
+    size_t positionBytes() const;
+    size_t bitmapBytes() const;
+    size_t impactBytes() const { return impactIndex().memoryBytes(); }
+};
+
+#endif
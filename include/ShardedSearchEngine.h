@@ -0,0 +1,145 @@
+#ifndef SHARDEDSEARCHENGINE_H
+#define SHARDEDSEARCHENGINE_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include "MiniSearchEngine.h"
+#include "ThreadPool.h"
+using namespace std;
+
+/**
+ * SearchShard: One partition of a sharded index, addressed by its own doc
+ * ids. LocalShard keeps it in this process; a shard on another node
+ * implements the same calls over its transport
+ */
+class SearchShard {
+public:
+    virtual ~SearchShard() {}
+
+    virtual int addDocument(const string& title, const string& content, const string& url) = 0;
+    // Ids are assigned in batch order, following those already given out
+    virtual void addDocuments(vector<Document> batch, unsigned threadCount) = 0;
+    virtual bool removeDocument(int docId) = 0;
+    virtual int updateDocument(int docId, const string& title, const string& content,
+                               const string& url) = 0;
+    virtual void refresh() = 0;
+    virtual void waitForMerges() = 0;
+    virtual void setScoring(const ScoringParams& params) = 0;
+
+    virtual TermStatistics termStatistics(const string& query) = 0;
+    virtual vector<ScoredDocument> searchIds(const string& query, int maxResults,
+                                             const TermStatistics& global) = 0;
+    virtual vector<SearchResult> fetchResults(const string& query,
+                                              const vector<ScoredDocument>& ranked,
+                                              bool withSnippets) = 0;
+};
+
+/**
+ * LocalShard: A shard held by a MiniSearchEngine in this process
+ */
+class LocalShard : public SearchShard {
+private:
+    MiniSearchEngine searchEngine;
+
+public:
+    explicit LocalShard(PostingCodec codec = PostingCodec::VarByte,
+                        const AnalyzerOptions& analysis = AnalyzerOptions());
+
+    MiniSearchEngine& engine() { return searchEngine; }     // For per-shard settings
+
+    int addDocument(const string& title, const string& content, const string& url) override;
+    void addDocuments(vector<Document> batch, unsigned threadCount) override;
+    bool removeDocument(int docId) override;
+    int updateDocument(int docId, const string& title, const string& content,
+                       const string& url) override;
+    void refresh() override;
+    void waitForMerges() override;
+    void setScoring(const ScoringParams& params) override;
+
+    TermStatistics termStatistics(const string& query) override;
+    vector<ScoredDocument> searchIds(const string& query, int maxResults,
+                                     const TermStatistics& global) override;
+    vector<SearchResult> fetchResults(const string& query, const vector<ScoredDocument>& ranked,
+                                      bool withSnippets) override;
+};
+
+/**
+ * ShardedSearchEngine: Coordinator over shards that each hold part of the
+ * documents, chosen by a hash of the document id. A query is scattered in
+ * three rounds: term statistics are gathered and summed, every shard ranks
+ * its documents with the global figures and returns its top k, and the
+ * fields of the merged top k are fetched from the shards that own them.
+ * Scores therefore equal those of one engine holding every document, except
+ * that removed documents leave the statistics when their own shard purges
+ * them. Rounds run on a thread pool, one task per shard.
+ */
+class ShardedSearchEngine {
+private:
+    vector<unique_ptr<SearchShard>> shards;
+    unique_ptr<ThreadPool> pool;        // Null with a single shard or thread
+
+    // Where each global id lives, guarded by writeMutex, which also orders
+    // additions so that shard ids are known before the shard assigns them
+    struct DocumentLocation {
+        uint32_t shard;
+        int docId;
+    };
+    mutex writeMutex;
+    vector<DocumentLocation> locations;
+
+    // Global id of each shard id, read by queries under the shard's own lock
+    struct ShardIds {
+        mutex lock;
+        vector<int> globalIds;
+    };
+    vector<unique_ptr<ShardIds>> shardIds;
+
+    // A document of the merged top k and where to fetch it
+    struct ShardHit {
+        ScoredDocument global;
+        size_t shard;
+        int docId;
+    };
+
+    size_t shardFor(int globalId) const;
+    // Maps the id shard will give its next document to a new global id,
+    // before the shard can publish it; requires writeMutex
+    int record(size_t shard);
+    void unrecord(size_t shard);    // Takes back the last record() after a failed add
+    void forEachShard(const function<void(size_t)>& task);
+    vector<ShardHit> rank(const string& query, int maxResults);
+
+public:
+    // shardCount in-process shards; threadCount 0 runs one thread per shard
+    explicit ShardedSearchEngine(size_t shardCount, unsigned threadCount = 0,
+                                 PostingCodec codec = PostingCodec::VarByte,
+                                 const AnalyzerOptions& analysis = AnalyzerOptions());
+    // Adopts empty shards, which must all analyze text the same way
+    explicit ShardedSearchEngine(vector<unique_ptr<SearchShard>> shards,
+                                 unsigned threadCount = 0);
+    ShardedSearchEngine(const ShardedSearchEngine&) = delete;
+    ShardedSearchEngine& operator=(const ShardedSearchEngine&) = delete;
+
+    size_t shardCount() const { return shards.size(); }
+    SearchShard& shard(size_t index) { return *shards[index]; }
+
+    int addDocument(const string& title, const string& content, const string& url = "");
+    // Ids are assigned in batch order; shards index their parts in parallel
+    void addDocuments(vector<Document> batch);
+    bool removeDocument(int docId);
+    // The document keeps its shard, so the update is atomic; -1 if not live
+    int updateDocument(int docId, const string& title, const string& content,
+                       const string& url = "");
+    void refresh();
+    void waitForMerges();
+    void setScoring(const ScoringParams& params);
+
+    TermStatistics termStatistics(const string& query);     // Summed over shards
+    vector<ScoredDocument> searchIds(const string& query, int maxResults = 10);
+    vector<SearchResult> search(const string& query, int maxResults = 10, bool withSnippets = true);
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef STRINGREF_H
+#define STRINGREF_H
+
+#include <string>
+#include <cstring>
+#include <ostream>
+using namespace std;
+
+/**
+ * StringRef: Non-owning view of a byte range, used where fields are read in
+ * place from index storage instead of being copied into std::string
+ */
+struct StringRef {
+    const char* data;
+    size_t size;
+
+    StringRef() : data(""), size(0) {}
+    StringRef(const char* data, size_t size) : data(data), size(size) {}
+    StringRef(const string& text) : data(text.data()), size(text.size()) {}
+
+    bool empty() const { return size == 0; }
+    string str() const { return string(data, size); }
+
+    int compare(const StringRef& other) const {
+        size_t common = (size < other.size) ? size : other.size;
+        int result = (common > 0) ? memcmp(data, other.data, common) : 0;
+        if (result != 0) return result;
+        return (size < other.size) ? -1 : (size > other.size ? 1 : 0);
+    }
+};
+
+inline ostream& operator<<(ostream& out, const StringRef& text) {
+    return out.write(text.data, static_cast<streamsize>(text.size));
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef TERMDICTIONARY_H
+#define TERMDICTIONARY_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "StringRef.h"
+using namespace std;
+
+/**
+ * TermDictionary: Immutable sorted term dictionary mapping each term to its
+ * ordinal. Terms are front-coded in blocks of kBlockTerms: a block starts
+ * with one whole term and every later term stores only the bytes it does
+ * not share with the one before it. Lookups binary search the block heads
+ * and scan a single block, without allocating.
+ */
+class TermDictionary {
+public:
+    static const size_t kBlockTerms = 16;
+
+    TermDictionary();
+    explicit TermDictionary(const vector<string>& sortedTerms);    // Sorted, no duplicates
+
+    size_t size() const { return count; }
+    int find(StringRef term) const;             // -1 if the term is absent
+    string term(int termId) const;
+    size_t lowerBound(StringRef key) const;     // Ordinal of the first term not below key
+    // Terms starting with prefix are the ordinals [first, last)
+    void prefixRange(StringRef prefix, size_t& first, size_t& last) const;
+    size_t memoryBytes() const;
+
+private:
+    vector<uint8_t> data;           // Front-coded blocks
+    vector<uint32_t> blockOffsets;  // Start of each block in data
+    size_t count;
+
+    size_t seek(StringRef key, bool& exact) const;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+using namespace std;
+
+/**
+ * ThreadPool: Fixed set of workers with one task deque each. A worker takes
+ * from the back of its own deque and steals from the front of the others
+ * when it runs dry, so uneven tasks still keep every thread busy.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threadCount = 0);     // 0 means one per core
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    void submit(function<void()> task);
+    // Runs task(0) .. task(count - 1) and returns once all are done. The
+    // caller runs queued tasks while it waits, so nested calls never deadlock
+    void parallelFor(size_t count, const function<void(size_t)>& task);
+
+private:
+    struct WorkQueue {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<WorkQueue>> queues;
+    vector<thread> workers;
+    mutex sleepMutex;
+    condition_variable wakeup;
+    atomic<size_t> queued;
+    atomic<size_t> nextQueue;
+    bool stopping;
+
+    void push(size_t queue, function<void()> task);
+    bool runOne(size_t home);   // Runs one task, preferring queue home
+    size_t homeQueue();         // The worker's own queue, or round robin for other threads
+    void workerLoop(size_t index);
+};
+
+#endif
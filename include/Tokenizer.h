@@ -0,0 +1,46 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+/**
+ * TokenSpan: Byte range of one token; normalization maps byte for byte, so
+ * the same span addresses the token in the original text
+ */
+struct TokenSpan {
+    uint32_t offset;
+    uint32_t length;
+};
+
+/**
+ * Tokenizer: Table-driven normalizer and splitter that reuses its buffers,
+ * so tokenizing does not allocate once the buffers have grown
+ */
+class Tokenizer {
+private:
+    string buffer;              // Normalized copy of the last input
+    vector<TokenSpan> spans;
+
+    static const unsigned char* foldTable();
+
+public:
+    static const size_t kMinTokenLength = 3;
+
+    // ASCII letters and digits fold to lowercase; every other byte becomes 0
+    static unsigned char fold(unsigned char c) { return foldTable()[c]; }
+    static void normalize(const char* text, size_t length, char* out);        // SIMD when available
+    static void normalizeScalar(const char* text, size_t length, char* out);  // Portable fallback
+    static const char* normalizeKernelName();
+
+    const vector<TokenSpan>& tokenize(const char* text, size_t length);
+    const vector<TokenSpan>& tokenize(const string& text);
+
+    const char* data() const { return buffer.data(); }   // Normalized text of the last call
+    const vector<TokenSpan>& tokens() const { return spans; }   // Tokens of the last call
+    string tokenText(const TokenSpan& span) const;
+};
+
+#endif
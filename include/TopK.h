@@ -0,0 +1,45 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <vector>
+using namespace std;
+
+/**
+ * ScoredDocument: Lightweight (docId, score) pair produced while ranking
+ */
+struct ScoredDocument {
+    int documentId;
+    double score;
+};
+
+/**
+ * TopKHeap: Bounded min-heap keeping the k best documents seen so far.
+ * Higher scores rank first; ties go to the lower docId.
+ */
+class TopKHeap {
+private:
+    size_t k;
+    vector<ScoredDocument> heap;   // Worst retained document at the front
+    bool bounded;                  // Only documents ranking after cursor are kept
+    ScoredDocument cursor;
+
+    // Storage reserved up front at most; a larger k grows the heap as it fills
+    static const size_t kReserveLimit = 1024;
+
+public:
+    explicit TopKHeap(size_t k);
+
+    void reset(size_t k);               // Empties the heap, keeping its storage
+    // Until the next reset, keeps only documents that rank after cursor, for
+    // search-after pagination
+    void startAfter(const ScoredDocument& cursor);
+
+    bool full() const;
+    double threshold() const;           // Score to beat, -infinity until full
+    bool push(int docId, double score); // Returns true if the document was kept
+    vector<ScoredDocument> sortedResults() const;
+
+    static bool ranksBefore(const ScoredDocument& a, const ScoredDocument& b);
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "../include/Analyzer.h"
+#include "../include/PorterStemmer.h"
+#include <algorithm>
+#include <utility>
+
+vector<string> AnalyzerOptions::englishStopWords() {
+    // Shorter words never become tokens
+    static const char* const words[] = {
+        "about", "above", "after", "again", "against", "all", "and", "any", "are", "because",
+        "been", "before", "being", "below", "between", "both", "but", "can", "did", "does",
+        "doing", "down", "during", "each", "few", "for", "from", "further", "had", "has",
+        "have", "having", "her", "here", "hers", "herself", "him", "himself", "his", "how",
+        "into", "its", "itself", "just", "more", "most", "nor", "not", "now", "off", "once",
+        "only", "other", "our", "ours", "ourselves", "out", "over", "own", "same", "she",
+        "should", "some", "such", "than", "that", "the", "their", "theirs", "them",
+        "themselves", "then", "there", "these", "they", "this", "those", "through", "too",
+        "under", "until", "very", "was", "were", "what", "when", "where", "which", "while",
+        "who", "whom", "why", "will", "with", "would", "you", "your", "yours", "yourself",
+        "yourselves"
+    };
+    return vector<string>(words, words + sizeof(words) / sizeof(words[0]));
+}
+
+// FNV-1a with a final avalanche, so both halves of the hash are usable
+uint64_t StopWordSet::hash(StringRef term) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < term.size; ++i) {
+        hash ^= static_cast<unsigned char>(term.data[i]);
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+size_t StopWordSet::slotOf(uint64_t hash, uint32_t seed, size_t mask) {
+    uint64_t mixed = (hash ^ (seed * 0x9E3779B97F4A7C15ULL)) * 0xc4ceb9fe1a85ec53ULL;
+    return static_cast<size_t>(mixed ^ (mixed >> 29)) & mask;
+}
+
+StopWordSet::StopWordSet(vector<string> input) : words(move(input)) {
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+    vector<uint64_t> hashes;
+    for (const string& word : words) hashes.push_back(hash(word));
+
+    // Buckets of about four words in a table at most half full; the largest
+    // buckets are placed first, while most slots are still free
+    const uint32_t maxSeed = 1 << 16;
+    seeds.assign(max<size_t>(1, (words.size() + 3) / 4), 0);
+    vector<vector<int>> buckets(seeds.size());
+    for (size_t w = 0; w < words.size(); ++w) buckets[bucketOf(hashes[w])].push_back(static_cast<int>(w));
+    vector<size_t> order(buckets.size());
+    for (size_t b = 0; b < order.size(); ++b) order[b] = b;
+    stable_sort(order.begin(), order.end(),
+                [&buckets](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); });
+
+    size_t slotCount = 1;
+    while (slotCount < 2 * words.size()) slotCount *= 2;
+    for (bool placed = false; !placed; slotCount *= 2) {
+        slots.assign(slotCount, -1);
+        placed = true;
+        vector<size_t> targets;
+        for (size_t b = 0; b < order.size() && placed; ++b) {
+            const vector<int>& bucket = buckets[order[b]];
+            placed = false;
+            for (uint32_t seed = 0; seed < maxSeed && !placed; ++seed) {
+                targets.clear();
+                placed = true;
+                for (size_t i = 0; i < bucket.size() && placed; ++i) {
+                    size_t slot = slotOf(hashes[bucket[i]], seed, slotCount - 1);
+                    placed = slots[slot] < 0 && find(targets.begin(), targets.end(), slot) == targets.end();
+                    targets.push_back(slot);
+                }
+                if (!placed) continue;
+                seeds[order[b]] = seed;
+                for (size_t i = 0; i < bucket.size(); ++i) slots[targets[i]] = bucket[i];
+            }
+        }
+        if (placed) return;
+    }
+}
+
+bool StopWordSet::contains(StringRef term) const {
+    uint64_t termHash = hash(term);
+    int word = slots[slotOf(termHash, seeds[bucketOf(termHash)], slots.size() - 1)];
+    return word >= 0 && StringRef(words[static_cast<size_t>(word)]).compare(term) == 0;
+}
+
+Analyzer::Analyzer(const AnalyzerOptions& options) : stemming(options.stemming), id(0) {
+    // Stop words are normalized the way text is; one may yield several tokens
+    vector<string> normalized;
+    for (const string& word : options.stopWords) {
+        for (const TokenSpan& span : tokenizer.tokenize(word)) normalized.push_back(tokenizer.tokenText(span));
+    }
+    if (!normalized.empty()) stopWords = make_shared<const StopWordSet>(normalized);
+    if (!filtering()) return;
+
+    sort(normalized.begin(), normalized.end());
+    normalized.erase(unique(normalized.begin(), normalized.end()), normalized.end());
+    id = 14695981039346656037ULL;
+    auto mix = [this](unsigned char byte) {
+        id ^= byte;
+        id *= 1099511628211ULL;
+    };
+    mix(stemming ? 1 : 0);
+    for (const string& word : normalized) {
+        for (char c : word) mix(static_cast<unsigned char>(c));
+        mix(0);
+    }
+    if (id == 0) id = 1;
+}
+
+void Analyzer::copySettings(const Analyzer& other) {
+    stopWords = other.stopWords;
+    stemming = other.stemming;
+    id = other.id;
+}
+
+const vector<TokenSpan>& Analyzer::analyze(const char* text, size_t length) {
+    const vector<TokenSpan>& tokens = tokenizer.tokenize(text, length);
+    if (!filtering()) return tokens;
+
+    kept.clear();
+    stemLengths.clear();
+    if (stemming) stemmed.assign(tokenizer.data(), length);
+    for (const TokenSpan& span : tokens) {
+        if (isStopWord(StringRef(tokenizer.data() + span.offset, span.length))) continue;
+        kept.push_back(span);
+        if (stemming) {
+            stemLengths.push_back(static_cast<uint32_t>(
+                PorterStemmer::stem(&stemmed[span.offset], span.length)));
+        }
+    }
+    return kept;
+}
+
+StringRef Analyzer::term(size_t i) const {
+    if (!filtering()) {
+        const TokenSpan& span = tokenizer.tokens()[i];
+        return StringRef(tokenizer.data() + span.offset, span.length);
+    }
+    const TokenSpan& span = kept[i];
+    if (stemming) return StringRef(stemmed.data() + span.offset, stemLengths[i]);
+    return StringRef(tokenizer.data() + span.offset, span.length);
+}
@@ -0,0 +1,428 @@
+#include "../include/BooleanQuery.h"
+#include <algorithm>
+
+bool QueryNode::blank() const {
+    switch (type) {
+        case QueryNodeType::Term:
+        case QueryNodeType::Phrase:
+        case QueryNodeType::Prefix:
+            return terms.empty();
+        case QueryNodeType::Not:
+            return children.empty() || children[0].blank();
+        default:
+            for (const QueryNode& child : children) {
+                if (!child.blank()) return false;
+            }
+            return true;
+    }
+}
+
+static QueryNode makeNode(QueryNodeType type) {
+    QueryNode node;
+    node.type = type;
+    return node;
+}
+
+BooleanQueryParser::BooleanQueryParser(const Analyzer& analyzer) : next(0), analyzer(analyzer) {}
+
+void BooleanQueryParser::lex(const string& query) {
+    // Lexemes are words, "(", ")", "-" and quoted phrases, which keep their
+    // opening quote so they cannot be mistaken for operators
+    lexemes.clear();
+    size_t i = 0;
+    while (i < query.size()) {
+        char c = query[i];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            i++;
+        } else if (c == '(' || c == ')') {
+            lexemes.push_back(string(1, c));
+            i++;
+        } else if (c == '"') {
+            size_t close = query.find('"', i + 1);
+            if (close == string::npos) close = query.size();
+            lexemes.push_back(query.substr(i, close - i));
+            i = close + 1;
+        } else if (c == '-' && (i == 0 || query[i - 1] == ' ' || query[i - 1] == '\t' ||
+                                query[i - 1] == '(' || query[i - 1] == '-')) {
+            lexemes.push_back("-");
+            i++;
+        } else {
+            size_t end = i;
+            while (end < query.size() && query[end] != ' ' && query[end] != '\t' &&
+                   query[end] != '(' && query[end] != ')' && query[end] != '"') {
+                end++;
+            }
+            lexemes.push_back(query.substr(i, end - i));
+            i = end;
+        }
+    }
+}
+
+QueryNode BooleanQueryParser::parse(const string& query) {
+    lex(query);
+    next = 0;
+    QueryNode root = makeNode(QueryNodeType::And);
+    // Unbalanced ")" ends an expression early; keep parsing after it
+    while (next < lexemes.size()) {
+        QueryNode part = parseOr();
+        if (!part.blank()) root.children.push_back(part);
+        if (next < lexemes.size()) next++;
+    }
+    return root.children.size() == 1 ? root.children[0] : root;
+}
+
+bool BooleanQueryParser::atOperand() const {
+    return next < lexemes.size() && lexemes[next] != ")" && lexemes[next] != "OR";
+}
+
+QueryNode BooleanQueryParser::parseOr() {
+    QueryNode node = makeNode(QueryNodeType::Or);
+    for (;;) {
+        QueryNode operand = parseAnd();
+        if (!operand.blank()) node.children.push_back(operand);
+        if (next < lexemes.size() && lexemes[next] == "OR") {
+            next++;
+            continue;
+        }
+        break;
+    }
+    return node.children.size() == 1 ? node.children[0] : node;
+}
+
+QueryNode BooleanQueryParser::parseAnd() {
+    QueryNode node = makeNode(QueryNodeType::And);
+    while (atOperand()) {
+        if (lexemes[next] == "AND") {
+            next++;
+            continue;
+        }
+        QueryNode operand = parseUnary();
+        if (!operand.blank()) node.children.push_back(operand);
+    }
+    return node.children.size() == 1 ? node.children[0] : node;
+}
+
+QueryNode BooleanQueryParser::parseUnary() {
+    if (lexemes[next] == "NOT" || lexemes[next] == "-") {
+        next++;
+        QueryNode node = makeNode(QueryNodeType::Not);
+        if (atOperand()) node.children.push_back(parseUnary());
+        return node;
+    }
+    return parsePrimary();
+}
+
+QueryNode BooleanQueryParser::parsePrimary() {
+    const string& lexeme = lexemes[next++];
+    if (lexeme == "(") {
+        QueryNode node = parseOr();
+        if (next < lexemes.size() && lexemes[next] == ")") next++;
+        return node;
+    }
+    if (lexeme[0] == '"') return wordsNode(lexeme.substr(1));
+    string prefix;
+    if (lexeme.size() > 1 && lexeme.back() == '*' &&
+        normalizePrefix(lexeme.substr(0, lexeme.size() - 1), prefix)) {
+        QueryNode node = makeNode(QueryNodeType::Prefix);
+        node.terms.push_back(prefix);
+        return node;
+    }
+    return wordsNode(lexeme);
+}
+
+QueryNode BooleanQueryParser::wordsNode(const string& text) {
+    QueryNode node = makeNode(QueryNodeType::Phrase);
+    size_t count = analyzer.analyze(text).size();
+    for (size_t i = 0; i < count; ++i) node.terms.push_back(analyzer.termText(i));
+    if (node.terms.size() == 1) node.type = QueryNodeType::Term;
+    return node;
+}
+
+void BooleanQueryParser::scoringTerms(const QueryNode& node, vector<string>& terms) {
+    switch (node.type) {
+        case QueryNodeType::Term:
+        case QueryNodeType::Phrase:
+            terms.insert(terms.end(), node.terms.begin(), node.terms.end());
+            break;
+        case QueryNodeType::Prefix:
+        case QueryNodeType::Not:
+            break;
+        default:
+            for (const QueryNode& child : node.children) scoringTerms(child, terms);
+            break;
+    }
+}
+
+static void collectTerms(const QueryNode& node, vector<string>& terms) {
+    if (node.type == QueryNodeType::Term || node.type == QueryNodeType::Phrase) {
+        terms.insert(terms.end(), node.terms.begin(), node.terms.end());
+    }
+    for (const QueryNode& child : node.children) collectTerms(child, terms);
+}
+
+static void assignSlots(QueryNode& node, const vector<string>& table) {
+    node.slots.clear();
+    if (node.type == QueryNodeType::Term || node.type == QueryNodeType::Phrase) {
+        for (const string& term : node.terms) {
+            node.slots.push_back(static_cast<size_t>(
+                lower_bound(table.begin(), table.end(), term) - table.begin()));
+        }
+    }
+    for (QueryNode& child : node.children) assignSlots(child, table);
+}
+
+void BooleanQueryParser::indexTerms(QueryNode& root, vector<string>& table) {
+    table.clear();
+    collectTerms(root, table);
+    sort(table.begin(), table.end());
+    table.erase(unique(table.begin(), table.end()), table.end());
+    assignSlots(root, table);
+}
+
+bool BooleanQueryParser::normalizePrefix(const string& text, string& prefix) {
+    prefix.resize(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        prefix[i] = static_cast<char>(Tokenizer::fold(static_cast<unsigned char>(text[i])));
+        if (prefix[i] == 0) return false;
+    }
+    return !prefix.empty();
+}
+
+BooleanMatcher::BooleanMatcher(const Segment& segment, const int* termIds)
+    : segment(segment), positions(segment.positionStore()), termIds(termIds), visited(0) {}
+
+size_t BooleanMatcher::cost(const QueryNode& node) const {
+    switch (node.type) {
+        case QueryNodeType::Term: {
+            int id = termId(node, 0);
+            return id < 0 ? 0 : segment.postingList(id).size();
+        }
+        case QueryNodeType::Phrase: {
+            size_t lowest = segment.documentCount();
+            for (size_t i = 0; i < node.terms.size(); ++i) {
+                int id = termId(node, i);
+                lowest = min(lowest, id < 0 ? 0 : segment.postingList(id).size());
+            }
+            return lowest;
+        }
+        case QueryNodeType::And: {
+            size_t lowest = segment.documentCount();
+            for (const QueryNode& child : node.children) {
+                if (child.type != QueryNodeType::Not) lowest = min(lowest, cost(child));
+            }
+            return lowest;
+        }
+        case QueryNodeType::Or: {
+            size_t total = 0;
+            for (const QueryNode& child : node.children) {
+                if (child.type != QueryNodeType::Not) total += cost(child);
+            }
+            return min(total, segment.documentCount());
+        }
+        case QueryNodeType::Prefix:
+            return 0;
+        case QueryNodeType::Not:
+            break;
+    }
+    return segment.documentCount();
+}
+
+DocSet BooleanMatcher::match(const QueryNode& node) {
+    switch (node.type) {
+        case QueryNodeType::Term: return matchTerm(termId(node, 0));
+        case QueryNodeType::Phrase: return matchPhrase(node);
+        case QueryNodeType::And: return matchAnd(node);
+        case QueryNodeType::Or: return matchOr(node);
+        case QueryNodeType::Prefix:
+        case QueryNodeType::Not: break;
+    }
+    // A bare exclusion has nothing to exclude from
+    return emptySet();
+}
+
+DocSet BooleanMatcher::matchTerm(int termId) {
+    if (termId < 0) return emptySet();
+    const uint64_t* bitmap = segment.termBitmap(termId);
+    if (bitmap) return DocSet(segment.baseDocId(), segment.documentCount(), bitmap);
+
+    vector<int> docs;
+    PostingListView list = segment.postingList(termId);
+    docs.reserve(list.size());
+    for (PostingIterator it(list); it.docId() != kEndDocId; it.next()) docs.push_back(it.docId());
+    visited += docs.size();
+    return DocSet(segment.baseDocId(), segment.documentCount(), move(docs));
+}
+
+DocSet BooleanMatcher::matchPhrase(const QueryNode& node) {
+    vector<int> phraseIds;
+    size_t rarest = 0;
+    for (size_t i = 0; i < node.terms.size(); ++i) {
+        int id = termId(node, i);
+        if (id < 0) return emptySet();
+        phraseIds.push_back(id);
+        if (segment.postingList(id).size() < segment.postingList(phraseIds[rarest]).size()) {
+            rarest = i;
+        }
+    }
+    DocSet candidates = matchTerm(phraseIds[rarest]);
+    for (size_t i = 0; i < phraseIds.size() && !candidates.empty(); ++i) {
+        if (phraseIds[i] != phraseIds[rarest]) filterTerm(candidates, phraseIds[i], true);
+    }
+    verifyPhrase(candidates.sortedDocs(), phraseIds);
+    return candidates;
+}
+
+DocSet BooleanMatcher::matchAnd(const QueryNode& node) {
+    // Start from the cheapest operand; the others only probe its matches
+    vector<const QueryNode*> operands;
+    for (const QueryNode& child : node.children) operands.push_back(&child);
+    stable_sort(operands.begin(), operands.end(),
+        [this](const QueryNode* a, const QueryNode* b) {
+            bool aNot = a->type == QueryNodeType::Not;
+            bool bNot = b->type == QueryNodeType::Not;
+            if (aNot != bNot) return bNot;
+            return !aNot && cost(*a) < cost(*b);
+        });
+    if (operands.empty() || operands[0]->type == QueryNodeType::Not) return emptySet();
+
+    DocSet candidates = match(*operands[0]);
+    for (size_t i = 1; i < operands.size() && !candidates.empty(); ++i) {
+        filter(candidates, *operands[i], true);
+    }
+    return candidates;
+}
+
+DocSet BooleanMatcher::matchOr(const QueryNode& node) {
+    // An exclusion inside a disjunction has nothing to exclude from
+    DocSet docs = emptySet();
+    for (const QueryNode& child : node.children) {
+        if (child.type != QueryNodeType::Not) docs.unite(match(child));
+    }
+    return docs;
+}
+
+void BooleanMatcher::filter(DocSet& candidates, const QueryNode& node, bool keep) {
+    if (!keep) {
+        if (node.type == QueryNodeType::Term) {
+            int id = termId(node, 0);
+            if (id >= 0) filterTerm(candidates, id, false);
+            return;
+        }
+        DocSet matched = candidates;
+        filter(matched, node, true);
+        candidates.subtract(matched);
+        return;
+    }
+
+    switch (node.type) {
+        case QueryNodeType::Term: {
+            int id = termId(node, 0);
+            if (id < 0) candidates.clear();
+            else filterTerm(candidates, id, true);
+            break;
+        }
+        case QueryNodeType::Phrase: {
+            vector<int> phraseIds;
+            for (size_t i = 0; i < node.terms.size(); ++i) {
+                int id = termId(node, i);
+                if (id < 0) {
+                    candidates.clear();
+                    return;
+                }
+                phraseIds.push_back(id);
+                filterTerm(candidates, id, true);
+            }
+            verifyPhrase(candidates.sortedDocs(), phraseIds);
+            break;
+        }
+        case QueryNodeType::And: {
+            bool positive = false;
+            for (const QueryNode& child : node.children) {
+                if (child.type == QueryNodeType::Not) continue;
+                filter(candidates, child, true);
+                positive = true;
+            }
+            if (!positive) candidates.clear();
+            for (const QueryNode& child : node.children) {
+                if (child.type == QueryNodeType::Not) filter(candidates, child, true);
+            }
+            break;
+        }
+        case QueryNodeType::Or: {
+            // Materialize the union only when it is smaller than the candidates
+            if (cost(node) < candidates.size()) {
+                candidates.intersect(matchOr(node));
+                break;
+            }
+            DocSet kept = emptySet();
+            for (const QueryNode& child : node.children) {
+                if (child.type == QueryNodeType::Not) continue;
+                DocSet matched = candidates;
+                filter(matched, child, true);
+                kept.unite(matched);
+            }
+            candidates = move(kept);
+            break;
+        }
+        case QueryNodeType::Prefix:
+            candidates.clear();
+            break;
+        case QueryNodeType::Not:
+            filter(candidates, node.children[0], false);
+            break;
+    }
+}
+
+void BooleanMatcher::filterTerm(DocSet& candidates, int termId, bool keep) {
+    // A bitmap answers membership directly; a bitset of candidates is better
+    // combined with the term's documents than probed one bit at a time
+    const uint64_t* bitmap = segment.termBitmap(termId);
+    if (bitmap) {
+        if (keep) candidates.intersect(bitmap);
+        else candidates.subtract(bitmap);
+        return;
+    }
+    if (candidates.isDense()) {
+        DocSet docs = matchTerm(termId);
+        if (keep) candidates.intersect(docs);
+        else candidates.subtract(docs);
+        return;
+    }
+
+    vector<int>& docs = candidates.sortedDocs();
+    PostingIterator it(segment.postingList(termId));
+    size_t out = 0;
+    for (int doc : docs) {
+        it.advance(doc);
+        bool found = it.docId() == doc;
+        if (found == keep) docs[out++] = doc;
+    }
+    visited += docs.size();
+    docs.resize(out);
+}
+
+void BooleanMatcher::verifyPhrase(vector<int>& candidates, const vector<int>& termIds) {
+    // Positions cover the content only, so phrases match content text
+    int base = segment.baseDocId();
+    vector<pair<const uint32_t*, const uint32_t*>> ranges(termIds.size());
+    size_t out = 0;
+    for (int doc : candidates) {
+        bool present = true;
+        for (size_t i = 0; i < termIds.size() && present; ++i) {
+            ranges[i] = positions.termPositions(doc - base, termIds[i]);
+            present = ranges[i].first != nullptr;
+        }
+
+        bool found = false;
+        for (const uint32_t* start = ranges[0].first; present && !found && start != ranges[0].second;
+             ++start) {
+            found = true;
+            for (size_t i = 1; i < termIds.size() && found; ++i) {
+                found = binary_search(ranges[i].first, ranges[i].second,
+                                      *start + static_cast<uint32_t>(i));
+            }
+        }
+        if (found) candidates[out++] = doc;
+    }
+    candidates.resize(out);
+}
@@ -0,0 +1,28 @@
+#include "../include/DeletionBitmap.h"
+
+DeletionBitmap::DeletionBitmap(size_t documentCount)
+    : words((documentCount + 63) / 64, 0), documents(documentCount), deleted(0) {}
+
+DeletionBitmap::DeletionBitmap(const uint64_t* data, size_t documentCount)
+    : words(data, data + (documentCount + 63) / 64), documents(documentCount), deleted(0) {
+    for (uint64_t word : words) {
+        for (; word != 0; word &= word - 1) deleted++;
+    }
+}
+
+bool DeletionBitmap::insert(size_t doc) {
+    uint64_t bit = uint64_t(1) << (doc & 63);
+    if (words[doc >> 6] & bit) return false;
+    words[doc >> 6] |= bit;
+    deleted++;
+    return true;
+}
+
+void DeletionBitmap::insertAll(const DeletionBitmap& other, size_t offset) {
+    for (size_t w = 0; w < other.words.size(); ++w) {
+        uint64_t word = other.words[w];
+        for (size_t bit = 0; word != 0; ++bit, word >>= 1) {
+            if (word & 1) insert(offset + w * 64 + bit);
+        }
+    }
+}
@@ -0,0 +1,214 @@
+#include "../include/DocSet.h"
+#include "../include/BitOps.h"
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+// First index at or after from whose value is >= target: doubling steps
+// bracket it and a binary search finds it, O(log distance)
+static size_t gallop(const vector<int>& docs, size_t from, int target) {
+    size_t low = from;
+    size_t step = 1;
+    size_t high = from;
+    while (high < docs.size() && docs[high] < target) {
+        low = high + 1;
+        high += step;
+        step *= 2;
+    }
+    high = min(high, docs.size());
+    return static_cast<size_t>(lower_bound(docs.begin() + low, docs.begin() + high, target) -
+                               docs.begin());
+}
+
+// Keeps the candidates that are (keep) or are not (!keep) in others
+static void gallopFilter(vector<int>& candidates, const vector<int>& others, bool keep) {
+    size_t out = 0;
+    size_t at = 0;
+    for (int doc : candidates) {
+        at = gallop(others, at, doc);
+        bool found = at < others.size() && others[at] == doc;
+        if (found == keep) candidates[out++] = doc;
+    }
+    candidates.resize(out);
+}
+
+DocSet::DocSet(int base, size_t documents)
+    : base(base), documents(documents), dense(false), count(0) {}
+
+DocSet::DocSet(int base, size_t documents, vector<int> docs)
+    : base(base), documents(documents), dense(false), count(0), docs(move(docs)) {
+    settle();
+}
+
+DocSet::DocSet(int base, size_t documents, const uint64_t* words)
+    : base(base), documents(documents), dense(true), count(0),
+      words(words, words + (documents + 63) / 64) {
+    recount();
+    settle();
+}
+
+bool DocSet::contains(int docId) const {
+    if (docId < base || static_cast<size_t>(docId - base) >= documents) return false;
+    if (dense) return testBit(words.data(), docId);
+    return binary_search(docs.begin(), docs.end(), docId);
+}
+
+void DocSet::clear() {
+    dense = false;
+    count = 0;
+    docs.clear();
+    words.clear();
+}
+
+void DocSet::intersect(const DocSet& other) {
+    if (dense && other.dense) {
+        for (size_t w = 0; w < words.size(); ++w) words[w] &= other.words[w];
+        recount();
+    } else if (dense) {
+        // The result is a subset of the sparse side
+        vector<int> kept;
+        kept.reserve(other.docs.size());
+        for (int doc : other.docs) {
+            if (testBit(words.data(), doc)) kept.push_back(doc);
+        }
+        words.clear();
+        dense = false;
+        docs.swap(kept);
+    } else if (other.dense) {
+        intersect(other.words.data());
+        return;
+    } else if (other.docs.size() < docs.size()) {
+        // Probe the larger set with the smaller one
+        vector<int> kept = other.docs;
+        gallopFilter(kept, docs, true);
+        docs.swap(kept);
+    } else {
+        gallopFilter(docs, other.docs, true);
+    }
+    settle();
+}
+
+void DocSet::intersect(const uint64_t* bits) {
+    if (dense) {
+        for (size_t w = 0; w < words.size(); ++w) words[w] &= bits[w];
+        recount();
+        settle();
+        return;
+    }
+    size_t out = 0;
+    for (int doc : docs) {
+        if (testBit(bits, doc)) docs[out++] = doc;
+    }
+    docs.resize(out);
+}
+
+void DocSet::unite(const DocSet& other) {
+    if (other.empty()) return;
+    if (!dense && !other.dense) {
+        vector<int> merged;
+        merged.reserve(docs.size() + other.docs.size());
+        set_union(docs.begin(), docs.end(), other.docs.begin(), other.docs.end(),
+                  back_inserter(merged));
+        docs.swap(merged);
+        settle();
+        return;
+    }
+    if (!dense) {
+        // Copy the bitset and add the array to it
+        vector<int> mine;
+        mine.swap(docs);
+        words = other.words;
+        dense = true;
+        for (int doc : mine) {
+            size_t bit = static_cast<size_t>(doc - base);
+            words[bit >> 6] |= uint64_t(1) << (bit & 63);
+        }
+    } else if (other.dense) {
+        for (size_t w = 0; w < words.size(); ++w) words[w] |= other.words[w];
+    } else {
+        for (int doc : other.docs) {
+            size_t bit = static_cast<size_t>(doc - base);
+            words[bit >> 6] |= uint64_t(1) << (bit & 63);
+        }
+    }
+    recount();
+}
+
+void DocSet::subtract(const DocSet& other) {
+    if (other.empty()) return;
+    if (other.dense) {
+        subtract(other.words.data());
+        return;
+    }
+    if (dense) {
+        for (int doc : other.docs) {
+            size_t bit = static_cast<size_t>(doc - base);
+            words[bit >> 6] &= ~(uint64_t(1) << (bit & 63));
+        }
+        recount();
+        settle();
+        return;
+    }
+    gallopFilter(docs, other.docs, false);
+}
+
+void DocSet::subtract(const uint64_t* bits) {
+    if (dense) {
+        for (size_t w = 0; w < words.size(); ++w) words[w] &= ~bits[w];
+        recount();
+        settle();
+        return;
+    }
+    size_t out = 0;
+    for (int doc : docs) {
+        if (!testBit(bits, doc)) docs[out++] = doc;
+    }
+    docs.resize(out);
+}
+
+vector<int>& DocSet::sortedDocs() {
+    if (dense) makeSparse();
+    return docs;
+}
+
+vector<int> DocSet::toVector() const {
+    if (!dense) return docs;
+    vector<int> out;
+    out.reserve(count);
+    for (size_t w = 0; w < words.size(); ++w) {
+        for (uint64_t bits = words[w]; bits; bits &= bits - 1) {
+            out.push_back(base + static_cast<int>(w * 64 + countTrailingZeros(bits)));
+        }
+    }
+    return out;
+}
+
+void DocSet::recount() {
+    count = 0;
+    for (uint64_t word : words) count += countBits(word);
+}
+
+void DocSet::settle() {
+    // The gap between the two thresholds keeps a set near the boundary from
+    // converting back and forth
+    if (dense && count * kDenseRatio * 2 < documents) makeSparse();
+    else if (!dense && docs.size() * kDenseRatio >= documents && documents >= 64) makeDense();
+}
+
+void DocSet::makeDense() {
+    words.assign(wordCount(), 0);
+    for (int doc : docs) {
+        size_t bit = static_cast<size_t>(doc - base);
+        words[bit >> 6] |= uint64_t(1) << (bit & 63);
+    }
+    count = docs.size();
+    vector<int>().swap(docs);
+    dense = true;
+}
+
+void DocSet::makeSparse() {
+    docs = toVector();
+    vector<uint64_t>().swap(words);
+    count = 0;
+    dense = false;
+}
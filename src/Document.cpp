@@ -2,3 +2,7 @@
 
 Document::Document(int id, const string& title, const string& content, const string& url)
     : id(id), title(title), content(content), url(url) {}
+
+Document::Document(int id, StringRef title, StringRef content, StringRef url)
+    : id(id), title(title.data, title.size), content(content.data, content.size),
+      url(url.data, url.size) {}
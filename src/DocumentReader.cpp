@@ -0,0 +1,90 @@
+#include "../include/DocumentReader.h"
+
+LoadStats::LoadStats()
+    : opened(false), bytes(0), lines(0), documents(0), malformedLines(0),
+      firstMalformedLine(0), seconds(0.0) {}
+
+double LoadStats::megabytesPerSecond() const {
+    return (seconds > 0.0) ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+DocumentReader::DocumentReader(const string& path)
+    : file(path, ios::binary), buffer(kChunkSize), begin(0), end(0), exhausted(false) {
+    stats.opened = file.is_open();
+    exhausted = !stats.opened;
+}
+
+bool DocumentReader::fill() {
+    if (exhausted) return false;
+
+    // Keep the partial line, growing the buffer only if it fills it entirely
+    size_t pending = end - begin;
+    if (begin > 0) {
+        memmove(buffer.data(), buffer.data() + begin, pending);
+        begin = 0;
+        end = pending;
+    }
+    if (end == buffer.size()) buffer.resize(buffer.size() * 2);
+
+    file.read(buffer.data() + end, static_cast<streamsize>(buffer.size() - end));
+    size_t count = static_cast<size_t>(file.gcount());
+    end += count;
+    stats.bytes += count;
+    if (count == 0) exhausted = true;
+    return count > 0;
+}
+
+bool DocumentReader::nextLine(StringRef& line) {
+    size_t scanned = begin;
+    while (true) {
+        const char* newline = static_cast<const char*>(
+            memchr(buffer.data() + scanned, '\n', end - scanned));
+        if (newline != nullptr) {
+            size_t lineEnd = static_cast<size_t>(newline - buffer.data());
+            line = StringRef(buffer.data() + begin, lineEnd - begin);
+            begin = lineEnd + 1;
+            break;
+        }
+
+        size_t offset = end - begin;
+        if (!fill()) {
+            // Last line without a trailing newline
+            if (begin == end) return false;
+            line = StringRef(buffer.data() + begin, end - begin);
+            begin = end;
+            break;
+        }
+        scanned = begin + offset;
+    }
+
+    if (line.size > 0 && line.data[line.size - 1] == '\r') line.size--;
+    stats.lines++;
+    return true;
+}
+
+bool DocumentReader::next(DocumentFields& fields) {
+    StringRef line;
+    while (nextLine(line)) {
+        if (line.empty()) continue;
+
+        const char* first = static_cast<const char*>(memchr(line.data, '|', line.size));
+        if (first == nullptr) {
+            if (stats.malformedLines++ == 0) stats.firstMalformedLine = stats.lines;
+            continue;
+        }
+
+        const char* lineEnd = line.data + line.size;
+        const char* second = static_cast<const char*>(
+            memchr(first + 1, '|', static_cast<size_t>(lineEnd - first - 1)));
+        const char* contentEnd = (second != nullptr) ? second : lineEnd;
+
+        fields.title = StringRef(line.data, static_cast<size_t>(first - line.data));
+        fields.content = StringRef(first + 1, static_cast<size_t>(contentEnd - first - 1));
+        fields.url = (second != nullptr)
+            ? StringRef(second + 1, static_cast<size_t>(lineEnd - second - 1))
+            : StringRef();
+        stats.documents++;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,118 @@
+#include "../include/DocumentStore.h"
+
+namespace {
+
+uint64_t hashBytes(StringRef text) {
+    // FNV-1a
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < text.size; ++i) {
+        hash ^= static_cast<unsigned char>(text.data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+}
+
+DocumentStore::DocumentStore(int docBase)
+    : docBase(docBase), count(0), cursor(nullptr), remaining(0), allocatedBytes(0), savedBytes(0),
+      internTable(64, StringRef(nullptr, 0)), internCount(0) {}
+
+StringRef DocumentStore::copy(StringRef text) {
+    if (text.empty()) return StringRef();
+
+    if (text.size > remaining) {
+        // Large fields get an exact-size block so the current one keeps its space
+        if (text.size > kBlockSize / 4) {
+            blocks.emplace_back(new char[text.size]);
+            allocatedBytes += text.size;
+            memcpy(blocks.back().get(), text.data, text.size);
+            return StringRef(blocks.back().get(), text.size);
+        }
+        blocks.emplace_back(new char[kBlockSize]);
+        allocatedBytes += kBlockSize;
+        cursor = blocks.back().get();
+        remaining = kBlockSize;
+    }
+
+    memcpy(cursor, text.data, text.size);
+    StringRef stored(cursor, text.size);
+    cursor += text.size;
+    remaining -= text.size;
+    return stored;
+}
+
+StringRef DocumentStore::intern(StringRef text) {
+    if (text.empty()) return StringRef();
+
+    size_t mask = internTable.size() - 1;
+    size_t slot = static_cast<size_t>(hashBytes(text)) & mask;
+    while (internTable[slot].data != nullptr) {
+        if (internTable[slot].compare(text) == 0) {
+            savedBytes += text.size;
+            return internTable[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    StringRef stored = copy(text);
+    internTable[slot] = stored;
+    if (++internCount * 2 > internTable.size()) growInternTable();
+    return stored;
+}
+
+void DocumentStore::growInternTable() {
+    vector<StringRef> previous(internTable.size() * 2, StringRef(nullptr, 0));
+    previous.swap(internTable);
+    size_t mask = internTable.size() - 1;
+    for (const StringRef& text : previous) {
+        if (text.data == nullptr) continue;
+        size_t slot = static_cast<size_t>(hashBytes(text)) & mask;
+        while (internTable[slot].data != nullptr) slot = (slot + 1) & mask;
+        internTable[slot] = text;
+    }
+}
+
+int DocumentStore::chunkOf(size_t index) {
+    // Chunk k covers indexes whose value plus kFirstChunkSize has its top
+    // bit at kFirstChunkBits + k
+    size_t shifted = (index + kFirstChunkSize) >> (kFirstChunkBits + 1);
+    int chunk = 0;
+    while (shifted != 0) {
+        shifted >>= 1;
+        chunk++;
+    }
+    return chunk;
+}
+
+DocumentStore::Entry& DocumentStore::entry(size_t index) const {
+    int chunk = chunkOf(index);
+    return chunks[chunk][index + kFirstChunkSize - (kFirstChunkSize << chunk)];
+}
+
+int DocumentStore::add(StringRef title, StringRef content, StringRef url) {
+    int chunk = chunkOf(count);
+    if (!chunks[chunk]) chunks[chunk].reset(new Entry[kFirstChunkSize << chunk]);
+
+    Entry& stored = entry(count);
+    stored.title = intern(title);
+    stored.content = copy(content);
+    stored.url = intern(url);
+    count++;
+    return endDocId() - 1;
+}
+
+DocumentView DocumentStore::document(int docId) const {
+    const Entry& stored = entry(static_cast<size_t>(docId - docBase));
+    return DocumentView{docId, stored.title, stored.content, stored.url};
+}
+
+size_t DocumentStore::memoryBytes() const {
+    size_t entryCapacity = 0;
+    for (int chunk = 0; chunk < kChunkCount && chunks[chunk]; ++chunk) {
+        entryCapacity += kFirstChunkSize << chunk;
+    }
+    return allocatedBytes + entryCapacity * sizeof(Entry) +
+           internTable.capacity() * sizeof(StringRef) +
+           blocks.capacity() * sizeof(unique_ptr<char[]>);
+}
@@ -0,0 +1,80 @@
+#include "../include/ImpactList.h"
+#include <algorithm>
+
+void ImpactListView::decodeGroup(size_t g, vector<int>& docs) const {
+    const ImpactGroup& group = groups[g];
+    const uint8_t* in = data + group.offset;
+    uint32_t doc = 0;
+    for (uint32_t i = 0; i < group.count; ++i) {
+        uint32_t gap = 0;
+        int shift = 0;
+        while (*in & 0x80) {
+            gap |= static_cast<uint32_t>(*in++ & 0x7F) << shift;
+            shift += 7;
+        }
+        gap |= static_cast<uint32_t>(*in++) << shift;
+        doc += gap;
+        docs.push_back(static_cast<int>(doc));
+    }
+}
+
+ImpactListView ImpactIndexView::list(int termId) const {
+    ImpactListView view;
+    view.groups = groups + termStart[termId];
+    view.groupCount = termStart[termId + 1] - termStart[termId];
+    view.data = data;
+    return view;
+}
+
+size_t ImpactIndexView::memoryBytes() const {
+    if (empty()) return 0;
+    return (termCount + 1) * sizeof(uint32_t) + groupTotal() * sizeof(ImpactGroup) +
+           static_cast<size_t>(dataSize);
+}
+
+ImpactIndex::ImpactIndex() : termStart(1, 0) {}
+
+void ImpactIndex::add(int doc, uint32_t impact) {
+    // Sorting the keys orders by falling impact, then by rising doc
+    entries.push_back(static_cast<uint64_t>(~impact) << 32 | static_cast<uint32_t>(doc));
+}
+
+void ImpactIndex::endTerm() {
+    sort(entries.begin(), entries.end());
+    uint32_t previous = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        uint32_t impact = ~static_cast<uint32_t>(entries[i] >> 32);
+        uint32_t doc = static_cast<uint32_t>(entries[i]);
+        if (i == 0 || impact != groups.back().impact) {
+            groups.push_back(ImpactGroup{impact, 0, data.size()});
+            previous = 0;
+        }
+        groups.back().count++;
+        uint32_t gap = doc - previous;
+        previous = doc;
+        while (gap >= 0x80) {
+            data.push_back(static_cast<uint8_t>(gap | 0x80));
+            gap >>= 7;
+        }
+        data.push_back(static_cast<uint8_t>(gap));
+    }
+    termStart.push_back(static_cast<uint32_t>(groups.size()));
+    entries.clear();
+}
+
+void ImpactIndex::clear() {
+    termStart.assign(1, 0);
+    vector<ImpactGroup>().swap(groups);
+    vector<uint8_t>().swap(data);
+    vector<uint64_t>().swap(entries);
+}
+
+ImpactIndexView ImpactIndex::view() const {
+    ImpactIndexView view;
+    view.termCount = static_cast<uint32_t>(termStart.size() - 1);
+    view.termStart = termStart.data();
+    view.groups = groups.data();
+    view.data = data.data();
+    view.dataSize = data.size();
+    return view;
+}
@@ -0,0 +1,534 @@
+#include "../include/IndexFile.h"
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+#include <cstdio>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Layout: a fixed header followed by 8-byte aligned sections. All integers
+ * are stored in the byte order of the machine that wrote the file; the
+ * header records it so a foreign file is rejected instead of misread.
+ */
+enum IndexSection {
+    TermOffsetsSection,     // uint64 per term + 1, into TermTextSection
+    TermTextSection,        // Terms concatenated in sorted order
+    TermInfoSection,        // IndexFile::TermInfo per term
+    BlockSection,           // PostingBlock headers of every list
+    PostingDataSection,     // Encoded block payloads
+    TailSection,            // Unpacked Posting tails
+    DocOffsetsSection,      // uint64 per field (title, content, url) + 1
+    DocTextSection,
+    DocLengthSection,       // DocumentLength per document
+    SpanStartSection,       // PositionStoreView arrays
+    TermStartSection,
+    SpanSection,
+    PositionTermSection,
+    PositionSection,
+    DeletionSection,        // DeletionBitmap words, empty if nothing is deleted
+    BitmapSection,          // Bitmaps of frequent terms, in term order
+    DocPriorSection,        // uint8 static prior per document
+    ImpactStartSection,     // ImpactIndexView arrays, all empty without impact ordering
+    ImpactGroupSection,
+    ImpactDataSection,
+    SectionCount
+};
+
+static const char kIndexMagic[8] = {'M', 'S', 'E', 'I', 'N', 'D', 'E', 'X'};
+static const uint32_t kByteOrderMark = 0x01020304;
+
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t codec;
+    int32_t docBase;
+    uint32_t documentCount;
+    uint32_t termCount;
+    uint64_t analyzer;          // Analyzer::fingerprint() of the indexing analyzer
+    uint64_t sectionOffset[SectionCount];
+    uint64_t sectionSize[SectionCount];
+};
+
+struct IndexFile::TermInfo {
+    uint64_t dataOffset;    // First payload byte of the list in PostingDataSection
+    uint32_t firstBlock;
+    uint32_t blockCount;
+    uint32_t firstTail;
+    uint32_t tailCount;
+    uint32_t count;
+    int32_t maxTf;
+    int32_t tailMaxTf;
+    int32_t maxTitleTf;
+    int32_t tailMaxTitleTf;
+    uint32_t bitmap;        // 1 + index in BitmapSection, 0 if the term has none
+};
+
+/**
+ * SectionWriter: Appends aligned sections to the output and records where
+ * each one starts and how long it is
+ */
+struct SectionWriter {
+    ofstream& out;
+    IndexFileHeader& header;
+    uint64_t position;
+
+    SectionWriter(ofstream& out, IndexFileHeader& header)
+        : out(out), header(header), position(sizeof(IndexFileHeader)) {}
+
+    void begin(IndexSection section) {
+        static const char padding[8] = {0};
+        uint64_t aligned = (position + 7) & ~static_cast<uint64_t>(7);
+        out.write(padding, static_cast<streamsize>(aligned - position));
+        position = aligned;
+        header.sectionOffset[section] = position;
+    }
+
+    void write(const void* data, size_t bytes) {
+        if (bytes == 0) return;
+        out.write(static_cast<const char*>(data), static_cast<streamsize>(bytes));
+        position += bytes;
+    }
+
+    void end(IndexSection section) {
+        header.sectionSize[section] = position - header.sectionOffset[section];
+    }
+
+    template <typename T>
+    void writeSection(IndexSection section, const T* data, size_t count) {
+        begin(section);
+        write(data, count * sizeof(T));
+        end(section);
+    }
+};
+
+// End of a group's bytes: where the next group of any term starts
+static uint64_t impactGroupEnd(const ImpactIndexView& impacts, const ImpactGroup* group) {
+    const ImpactGroup* next = group + 1;
+    return (next < impacts.groups + impacts.groupTotal()) ? next->offset : impacts.dataSize;
+}
+
+bool IndexFile::write(const string& path, const Segment& segment,
+                      const vector<DocumentView>& documents,
+                      const DeletionBitmap* deleted, uint64_t analyzer) {
+    if (documents.size() != segment.documentCount()) return false;
+    if (deleted && deleted->size() != documents.size()) return false;
+
+    // Terms are stored in sorted order so open() can binary search them;
+    // the position store is rewritten to use the sorted ordinals
+    size_t termTotal = segment.termCount();
+    vector<string> texts(termTotal);
+    for (size_t i = 0; i < termTotal; ++i) texts[i] = segment.term(static_cast<int>(i));
+    vector<int> order(termTotal);
+    iota(order.begin(), order.end(), 0);
+    if (!is_sorted(texts.begin(), texts.end())) {
+        sort(order.begin(), order.end(), [&texts](int a, int b) { return texts[a] < texts[b]; });
+    }
+    vector<int> ordinalOf(termTotal);
+    for (size_t i = 0; i < termTotal; ++i) ordinalOf[order[i]] = static_cast<int>(i);
+
+    PositionStore sortedPositions;
+    sortedPositions.append(segment.positionStore(), ordinalOf);
+    PositionStoreView positionView = sortedPositions.view();
+
+    vector<uint64_t> termOffsets(1, 0);
+    vector<TermInfo> termInfos(termTotal);
+    uint64_t dataOffset = 0;
+    uint32_t blockTotal = 0;
+    uint32_t tailTotal = 0;
+    uint32_t bitmapTotal = 0;
+    for (size_t i = 0; i < termTotal; ++i) {
+        termOffsets.push_back(termOffsets.back() + texts[order[i]].size());
+
+        PostingListView list = segment.postingList(order[i]);
+        TermInfo& info = termInfos[i];
+        memset(&info, 0, sizeof(info));
+        info.dataOffset = dataOffset;
+        info.firstBlock = blockTotal;
+        info.blockCount = list.blockCount;
+        info.firstTail = tailTotal;
+        info.tailCount = list.tailCount;
+        info.count = list.count;
+        info.maxTf = list.maxTf;
+        info.maxTitleTf = list.maxTitleTf;
+        info.tailMaxTitleTf = list.tailMaxTitleTf;
+        info.tailMaxTf = list.tailMaxTf;
+        if (wantsBitmap(list.count, documents.size())) info.bitmap = ++bitmapTotal;
+        dataOffset += list.dataSize;
+        blockTotal += list.blockCount;
+        tailTotal += list.tailCount;
+    }
+
+    vector<uint64_t> docOffsets(1, 0);
+    for (const DocumentView& doc : documents) {
+        docOffsets.push_back(docOffsets.back() + doc.title.size);
+        docOffsets.push_back(docOffsets.back() + doc.content.size);
+        docOffsets.push_back(docOffsets.back() + doc.url.size);
+    }
+
+    // Write to a temporary file and rename it so readers never see a partial index
+    string tempPath = path + ".tmp";
+    ofstream out(tempPath, ios::binary | ios::trunc);
+    if (!out) return false;
+
+    IndexFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.version = kFormatVersion;
+    header.byteOrder = kByteOrderMark;
+    header.codec = static_cast<uint32_t>(segment.postingCodec());
+    header.docBase = segment.baseDocId();
+    header.documentCount = static_cast<uint32_t>(documents.size());
+    header.termCount = static_cast<uint32_t>(termTotal);
+    header.analyzer = analyzer;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    SectionWriter writer(out, header);
+    writer.writeSection(TermOffsetsSection, termOffsets.data(), termOffsets.size());
+    writer.begin(TermTextSection);
+    for (size_t i = 0; i < termTotal; ++i) {
+        const string& text = texts[order[i]];
+        writer.write(text.data(), text.size());
+    }
+    writer.end(TermTextSection);
+    writer.writeSection(TermInfoSection, termInfos.data(), termInfos.size());
+
+    writer.begin(BlockSection);
+    for (size_t i = 0; i < termTotal; ++i) {
+        PostingListView list = segment.postingList(order[i]);
+        writer.write(list.blocks, list.blockCount * sizeof(PostingBlock));
+    }
+    writer.end(BlockSection);
+    writer.begin(PostingDataSection);
+    for (size_t i = 0; i < termTotal; ++i) {
+        PostingListView list = segment.postingList(order[i]);
+        writer.write(list.data, list.dataSize);
+    }
+    writer.end(PostingDataSection);
+    writer.begin(TailSection);
+    for (size_t i = 0; i < termTotal; ++i) {
+        PostingListView list = segment.postingList(order[i]);
+        writer.write(list.tail, list.tailCount * sizeof(Posting));
+    }
+    writer.end(TailSection);
+
+    writer.writeSection(DocOffsetsSection, docOffsets.data(), docOffsets.size());
+    writer.begin(DocTextSection);
+    for (const DocumentView& doc : documents) {
+        writer.write(doc.title.data, doc.title.size);
+        writer.write(doc.content.data, doc.content.size);
+        writer.write(doc.url.data, doc.url.size);
+    }
+    writer.end(DocTextSection);
+    writer.writeSection(DocLengthSection, segment.documentLengths(), documents.size());
+    writer.writeSection(DocPriorSection, segment.documentPriors(), documents.size());
+
+    writer.writeSection(SpanStartSection, positionView.spanStart, positionView.documentCount + 1);
+    writer.writeSection(TermStartSection, positionView.termStart, positionView.documentCount + 1);
+    writer.writeSection(SpanSection, positionView.spans, positionView.spanCount());
+    writer.writeSection(PositionTermSection, positionView.terms, positionView.termEntryCount());
+    writer.writeSection(PositionSection, positionView.positions, positionView.positionCount());
+    if (deleted && deleted->count() > 0) {
+        writer.writeSection(DeletionSection, deleted->data(), deleted->wordCount());
+    } else {
+        writer.writeSection(DeletionSection, static_cast<const uint64_t*>(nullptr), 0);
+    }
+
+    // A segment that has not built its bitmaps, e.g. one still growing, has
+    // them built here from its postings
+    size_t wordCount = bitmapWords(documents.size());
+    vector<uint64_t> built;
+    writer.begin(BitmapSection);
+    for (size_t i = 0; i < termTotal; ++i) {
+        if (!termInfos[i].bitmap) continue;
+        const uint64_t* bits = segment.termBitmap(order[i]);
+        if (!bits) {
+            built.assign(wordCount, 0);
+            for (PostingIterator it(segment.postingList(order[i])); it.docId() != kEndDocId; it.next()) {
+                size_t doc = static_cast<size_t>(it.docId() - segment.baseDocId());
+                built[doc >> 6] |= uint64_t(1) << (doc & 63);
+            }
+            bits = built.data();
+        }
+        writer.write(bits, wordCount * sizeof(uint64_t));
+    }
+    writer.end(BitmapSection);
+
+    // Impact lists follow the sorted term order too; each term's data is
+    // copied whole and its group offsets moved along with it
+    ImpactIndexView impacts = segment.impactIndex();
+    vector<uint32_t> impactStart;
+    vector<ImpactGroup> impactGroups;
+    vector<pair<uint64_t, uint64_t>> impactRanges;     // Data bytes of each sorted term
+    uint64_t impactOffset = 0;
+    for (size_t i = 0; i < termTotal && !impacts.empty(); ++i) {
+        if (i == 0) impactStart.push_back(0);
+        ImpactListView list = impacts.list(order[i]);
+        uint64_t first = list.groupCount ? list.groups[0].offset : 0;
+        uint64_t last = list.groupCount
+            ? impactGroupEnd(impacts, list.groups + list.groupCount - 1) : 0;
+        for (uint32_t g = 0; g < list.groupCount; ++g) {
+            impactGroups.push_back(list.groups[g]);
+            impactGroups.back().offset = impactOffset + list.groups[g].offset - first;
+        }
+        impactStart.push_back(static_cast<uint32_t>(impactGroups.size()));
+        impactRanges.push_back(make_pair(first, last));
+        impactOffset += last - first;
+    }
+    writer.writeSection(ImpactStartSection, impactStart.data(), impactStart.size());
+    writer.writeSection(ImpactGroupSection, impactGroups.data(), impactGroups.size());
+    writer.begin(ImpactDataSection);
+    for (const pair<uint64_t, uint64_t>& range : impactRanges) {
+        writer.write(impacts.data + range.first, static_cast<size_t>(range.second - range.first));
+    }
+    writer.end(ImpactDataSection);
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    if (!out) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+IndexFile::IndexFile()
+    : base(nullptr), size(0), codec(PostingCodec::VarByte), docBase(0), docCount(0), terms(0), analyzer(0),
+      termOffsets(nullptr), termText(nullptr), termInfos(nullptr), blocks(nullptr),
+      postingData(nullptr), postingDataSize(0), tails(nullptr), docOffsets(nullptr), docText(nullptr),
+      lengths(nullptr), priors(nullptr), titleTokens(0), contentTokens(0), deletionWords(nullptr),
+      bitmaps(nullptr) {
+    memset(&positions, 0, sizeof(positions));
+    memset(&impacts, 0, sizeof(impacts));
+}
+
+IndexFile::~IndexFile() {
+#if !defined(_WIN32)
+    if (base && buffer.empty()) munmap(const_cast<uint8_t*>(base), size);
+#endif
+}
+
+unique_ptr<IndexFile> IndexFile::open(const string& path) {
+    unique_ptr<IndexFile> file(new IndexFile());
+    if (!file->map(path) || !file->attach()) return nullptr;
+    return file;
+}
+
+bool IndexFile::map(const string& path) {
+#if !defined(_WIN32)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(IndexFileHeader))) {
+        close(fd);
+        return false;
+    }
+    size = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+    base = static_cast<const uint8_t*>(mapping);
+    return true;
+#else
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in) return false;
+    size = static_cast<size_t>(in.tellg());
+    if (size < sizeof(IndexFileHeader)) return false;
+    buffer.resize(size);
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(&buffer[0]), static_cast<streamsize>(size));
+    if (!in) return false;
+    base = buffer.data();
+    return true;
+#endif
+}
+
+bool IndexFile::attach() {
+    // Structural checks only: sections must lie inside the file and agree
+    // with the header counts. Contents are trusted, as with any index file.
+    IndexFileHeader header;
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0) return false;
+    if (header.version != kFormatVersion || header.byteOrder != kByteOrderMark) return false;
+    if (header.codec > static_cast<uint32_t>(PostingCodec::BitPacked)) return false;
+
+    for (int section = 0; section < SectionCount; ++section) {
+        uint64_t offset = header.sectionOffset[section];
+        uint64_t length = header.sectionSize[section];
+        if (offset % 8 != 0 || offset > size || length > size - offset) return false;
+    }
+
+    uint64_t termEntries = static_cast<uint64_t>(header.termCount) + 1;
+    uint64_t docEntries = static_cast<uint64_t>(header.documentCount) + 1;
+    if (header.sectionSize[TermOffsetsSection] != termEntries * sizeof(uint64_t) ||
+        header.sectionSize[TermInfoSection] != header.termCount * sizeof(TermInfo) ||
+        header.sectionSize[DocOffsetsSection] !=
+            (3 * static_cast<uint64_t>(header.documentCount) + 1) * sizeof(uint64_t) ||
+        header.sectionSize[DocLengthSection] !=
+            static_cast<uint64_t>(header.documentCount) * sizeof(DocumentLength) ||
+        header.sectionSize[DocPriorSection] != header.documentCount ||
+        header.sectionSize[SpanStartSection] != docEntries * sizeof(uint32_t) ||
+        header.sectionSize[TermStartSection] != docEntries * sizeof(uint32_t) ||
+        (header.sectionSize[DeletionSection] != 0 &&
+         header.sectionSize[DeletionSection] !=
+             (static_cast<uint64_t>(header.documentCount) + 63) / 64 * sizeof(uint64_t))) {
+        return false;
+    }
+    uint64_t bitmapBytes = bitmapWords(header.documentCount) * sizeof(uint64_t);
+    uint64_t bitmapSection = header.sectionSize[BitmapSection];
+    if (bitmapBytes == 0 ? bitmapSection != 0 : bitmapSection % bitmapBytes != 0) return false;
+    uint64_t impactStarts = header.sectionSize[ImpactStartSection];
+    if (impactStarts != 0 && impactStarts != termEntries * sizeof(uint32_t)) return false;
+    if (header.sectionSize[ImpactGroupSection] % sizeof(ImpactGroup) != 0) return false;
+
+    codec = static_cast<PostingCodec>(header.codec);
+    docBase = header.docBase;
+    docCount = header.documentCount;
+    terms = header.termCount;
+    analyzer = header.analyzer;
+
+    const uint8_t* sections[SectionCount];
+    for (int section = 0; section < SectionCount; ++section) {
+        sections[section] = base + header.sectionOffset[section];
+    }
+    termOffsets = reinterpret_cast<const uint64_t*>(sections[TermOffsetsSection]);
+    termText = reinterpret_cast<const char*>(sections[TermTextSection]);
+    termInfos = reinterpret_cast<const TermInfo*>(sections[TermInfoSection]);
+    blocks = reinterpret_cast<const PostingBlock*>(sections[BlockSection]);
+    postingData = sections[PostingDataSection];
+    postingDataSize = header.sectionSize[PostingDataSection];
+    tails = reinterpret_cast<const Posting*>(sections[TailSection]);
+    docOffsets = reinterpret_cast<const uint64_t*>(sections[DocOffsetsSection]);
+    docText = reinterpret_cast<const char*>(sections[DocTextSection]);
+    lengths = reinterpret_cast<const DocumentLength*>(sections[DocLengthSection]);
+    for (uint32_t doc = 0; doc < docCount; ++doc) {
+        titleTokens += lengths[doc].title;
+        contentTokens += lengths[doc].content;
+    }
+    if (header.sectionSize[DeletionSection] != 0) {
+        deletionWords = reinterpret_cast<const uint64_t*>(sections[DeletionSection]);
+    }
+
+    bitmaps = reinterpret_cast<const uint64_t*>(sections[BitmapSection]);
+    priors = sections[DocPriorSection];
+    if (impactStarts != 0) {
+        impacts.termCount = terms;
+        impacts.termStart = reinterpret_cast<const uint32_t*>(sections[ImpactStartSection]);
+        impacts.groups = reinterpret_cast<const ImpactGroup*>(sections[ImpactGroupSection]);
+        impacts.data = sections[ImpactDataSection];
+        impacts.dataSize = header.sectionSize[ImpactDataSection];
+        if (impacts.groupTotal() * sizeof(ImpactGroup) != header.sectionSize[ImpactGroupSection]) {
+            return false;
+        }
+    }
+
+    positions.documentCount = docCount;
+    positions.spanStart = reinterpret_cast<const uint32_t*>(sections[SpanStartSection]);
+    positions.termStart = reinterpret_cast<const uint32_t*>(sections[TermStartSection]);
+    positions.spans = reinterpret_cast<const TokenSpan*>(sections[SpanSection]);
+    positions.terms = reinterpret_cast<const TermPositions*>(sections[PositionTermSection]);
+    positions.positions = reinterpret_cast<const uint32_t*>(sections[PositionSection]);
+
+    return termOffsets[terms] <= header.sectionSize[TermTextSection] &&
+           docOffsets[3 * static_cast<uint64_t>(docCount)] <= header.sectionSize[DocTextSection] &&
+           positions.spanCount() * sizeof(TokenSpan) <= header.sectionSize[SpanSection] &&
+           positions.termEntryCount() * sizeof(TermPositions) <=
+               header.sectionSize[PositionTermSection];
+}
+
+StringRef IndexFile::termRef(int termId) const {
+    return StringRef(termText + termOffsets[termId],
+                     static_cast<size_t>(termOffsets[termId + 1] - termOffsets[termId]));
+}
+
+size_t IndexFile::lowerBound(StringRef key) const {
+    size_t low = 0, high = terms;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (termRef(static_cast<int>(mid)).compare(key) < 0) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+int IndexFile::findTermId(const string& text) const {
+    size_t termId = lowerBound(text);
+    if (termId < terms && termRef(static_cast<int>(termId)).compare(text) == 0) {
+        return static_cast<int>(termId);
+    }
+    return -1;
+}
+
+void IndexFile::termsWithPrefix(const string& prefix, vector<int>& termIds) const {
+    for (size_t termId = lowerBound(prefix); termId < terms; ++termId) {
+        StringRef text = termRef(static_cast<int>(termId));
+        if (text.size < prefix.size() || memcmp(text.data, prefix.data(), prefix.size()) != 0) break;
+        termIds.push_back(static_cast<int>(termId));
+    }
+}
+
+PostingListView IndexFile::postingList(int termId) const {
+    const TermInfo& info = termInfos[termId];
+    PostingListView view;
+    view.codec = codec;
+    view.blocks = blocks + info.firstBlock;
+    view.blockCount = info.blockCount;
+    view.data = postingData + info.dataOffset;
+    view.dataSize = ((termId + 1 < static_cast<int>(terms)) ?
+                     termInfos[termId + 1].dataOffset : postingDataSize) - info.dataOffset;
+    view.tail = tails + info.firstTail;
+    view.tailCount = info.tailCount;
+    view.tailMaxTf = info.tailMaxTf;
+    view.count = info.count;
+    view.maxTf = info.maxTf;
+    view.maxTitleTf = info.maxTitleTf;
+    view.tailMaxTitleTf = info.tailMaxTitleTf;
+    return view;
+}
+
+const uint64_t* IndexFile::termBitmap(int termId) const {
+    uint32_t bitmap = termInfos[termId].bitmap;
+    if (bitmap == 0) return nullptr;
+    return bitmaps + (bitmap - 1) * bitmapWords(docCount);
+}
+
+void IndexFile::termPages(int termId, PageSet& pages) const {
+    PostingListView list = postingList(termId);
+    pages.add(list.blocks, list.blockCount * sizeof(PostingBlock));
+    pages.add(list.data, static_cast<size_t>(list.dataSize));
+    pages.add(list.tail, list.tailCount * sizeof(Posting));
+    const uint64_t* bitmap = termBitmap(termId);
+    if (bitmap) pages.add(bitmap, bitmapWords(docCount) * sizeof(uint64_t));
+}
+
+DocumentView IndexFile::document(int docId) const {
+    const uint64_t* field = docOffsets + 3 * static_cast<size_t>(docId - docBase);
+    DocumentView view;
+    view.id = docId;
+    view.title = StringRef(docText + field[0], static_cast<size_t>(field[1] - field[0]));
+    view.content = StringRef(docText + field[1], static_cast<size_t>(field[2] - field[1]));
+    view.url = StringRef(docText + field[2], static_cast<size_t>(field[3] - field[2]));
+    return view;
+}
+
+size_t IndexFile::documentBytes() const {
+    return (3 * static_cast<size_t>(docCount) + 1) * sizeof(uint64_t) +
+           static_cast<size_t>(docOffsets[3 * static_cast<size_t>(docCount)]);
+}
+
+size_t IndexFile::dictionaryBytes() const {
+    return (static_cast<size_t>(terms) + 1) * sizeof(uint64_t) +
+           static_cast<size_t>(termOffsets[terms]) + terms * sizeof(TermInfo);
+}
+
+DeletionBitmap IndexFile::deletions() const {
+    return deletionWords ? DeletionBitmap(deletionWords, docCount) : DeletionBitmap(docCount);
+}
@@ -0,0 +1,344 @@
+#include "../include/IndexSegment.h"
+#include "../include/Scorer.h"
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+
+IndexSegment::IndexSegment(PostingCodec codec, int docBase, const Analyzer& analyzer)
+    : codec(codec), docBase(docBase), docCount(0), termOffsets(1, 0), frozen(false),
+      titleTokens(0), contentTokens(0), analyzer(analyzer) {}
+
+// FNV-1a; terms are short, so a byte loop is as fast as anything wider
+static size_t hashTerm(StringRef term) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < term.size; ++i) {
+        hash ^= static_cast<unsigned char>(term.data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash ^ (hash >> 32));
+}
+
+size_t IndexSegment::findSlot(StringRef term) const {
+    size_t mask = termSlots.size() - 1;
+    for (size_t slot = hashTerm(term) & mask;; slot = (slot + 1) & mask) {
+        int termId = termSlots[slot];
+        if (termId < 0 || termRef(termId).compare(term) == 0) return slot;
+    }
+}
+
+void IndexSegment::growSlots() {
+    // Kept at most half full so probe runs stay short
+    termSlots.assign(max<size_t>(1024, termSlots.size() * 2), -1);
+    for (size_t termId = 0; termId < postings.size(); ++termId) {
+        termSlots[findSlot(termRef(static_cast<int>(termId)))] = static_cast<int>(termId);
+    }
+}
+
+int IndexSegment::termIdFor(StringRef term) {
+    if (2 * (postings.size() + 1) > termSlots.size()) growSlots();
+    size_t slot = findSlot(term);
+    if (termSlots[slot] >= 0) return termSlots[slot];
+
+    int termId = static_cast<int>(postings.size());
+    termText.append(term.data, term.size);
+    termOffsets.push_back(static_cast<uint32_t>(termText.size()));
+    termSlots[slot] = termId;
+    postings.push_back(PostingList(codec));
+    return termId;
+}
+
+// Sets bit offset + (docId - base) for every document of list, skipping those
+// in deleted, which is numbered from base as well
+static void setBits(uint64_t* bits, size_t offset, PostingListView list, int base,
+                    const DeletionBitmap* deleted) {
+    for (PostingIterator it(list); it.docId() != kEndDocId; it.next()) {
+        size_t doc = static_cast<size_t>(it.docId() - base);
+        if (deleted && deleted->contains(doc)) continue;
+        size_t bit = offset + doc;
+        bits[bit >> 6] |= uint64_t(1) << (bit & 63);
+    }
+}
+
+// ORs source, a bitmap over documents documents, into bits from bit offset on
+static void orShifted(uint64_t* bits, size_t wordCount, const uint64_t* source, size_t documents,
+                      size_t offset) {
+    size_t shift = offset & 63;
+    uint64_t* out = bits + (offset >> 6);
+    for (size_t w = 0; w < Segment::bitmapWords(documents); ++w) {
+        out[w] |= source[w] << shift;
+        if (shift && (offset >> 6) + w + 1 < wordCount) out[w + 1] |= source[w] >> (64 - shift);
+    }
+}
+
+string IndexSegment::term(int termId) const {
+    return frozen ? dictionary.term(termId) : termRef(termId).str();
+}
+
+int IndexSegment::findTermId(const string& term) const {
+    if (frozen) return dictionary.find(term);
+    if (termSlots.empty()) return -1;
+    return termSlots[findSlot(term)];
+}
+
+void IndexSegment::termsWithPrefix(const string& prefix, vector<int>& matches) const {
+    if (frozen) {
+        size_t first, last;
+        dictionary.prefixRange(prefix, first, last);
+        for (size_t termId = first; termId < last; ++termId) matches.push_back(static_cast<int>(termId));
+        return;
+    }
+
+    size_t start = matches.size();
+    for (size_t termId = 0; termId < postings.size(); ++termId) {
+        StringRef text = termRef(static_cast<int>(termId));
+        if (text.size >= prefix.size() && memcmp(text.data, prefix.data(), prefix.size()) == 0) {
+            matches.push_back(static_cast<int>(termId));
+        }
+    }
+    sort(matches.begin() + static_cast<ptrdiff_t>(start), matches.end(),
+         [this](int a, int b) { return termRef(a).compare(termRef(b)) < 0; });
+}
+
+void IndexSegment::freeze(bool impactOrdered) {
+    if (frozen) return;
+
+    size_t termTotal = postings.size();
+    vector<int> order(termTotal);
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(),
+         [this](int a, int b) { return termRef(a).compare(termRef(b)) < 0; });
+
+    vector<int> termIdMap(termTotal);
+    vector<string> sortedTerms;
+    vector<PostingList> sortedPostings;
+    sortedTerms.reserve(termTotal);
+    sortedPostings.reserve(termTotal);
+    for (size_t i = 0; i < termTotal; ++i) {
+        termIdMap[order[i]] = static_cast<int>(i);
+        sortedTerms.push_back(termRef(order[i]).str());
+        sortedPostings.push_back(move(postings[order[i]]));
+    }
+    positions.renumberTerms(termIdMap);
+    postings.swap(sortedPostings);
+    dictionary = TermDictionary(sortedTerms);
+
+    size_t documents = static_cast<size_t>(docCount);
+    bitmapSlots.assign(termTotal, 0);
+    for (size_t termId = 0; termId < termTotal; ++termId) {
+        if (!wantsBitmap(postings[termId].size(), documents)) continue;
+        setBits(addBitmap(documents), 0, postings[termId].view(), docBase, nullptr);
+        bitmapSlots[termId] = static_cast<uint32_t>(bitmaps.size() / bitmapWords(documents));
+    }
+
+    string().swap(termText);
+    vector<uint32_t>().swap(termOffsets);
+    vector<int>().swap(termSlots);
+    frozen = true;
+    if (impactOrdered) buildImpacts();
+}
+
+void IndexSegment::buildImpacts() {
+    // From the finished lengths, so every list is quantized the same way
+    ImpactScorer scorer(*this);
+    impacts.clear();
+    for (const PostingList& list : postings) {
+        for (PostingIterator it(list.view()); it.docId() != kEndDocId; it.next()) {
+            int doc = it.docId() - docBase;
+            impacts.add(doc, scorer.impact(doc, it.tf()));
+        }
+        impacts.endTerm();
+    }
+}
+
+const uint64_t* IndexSegment::termBitmap(int termId) const {
+    if (bitmapSlots.empty() || bitmapSlots[termId] == 0) return nullptr;
+    return bitmaps.data() + (bitmapSlots[termId] - 1) * bitmapWords(static_cast<size_t>(docCount));
+}
+
+uint64_t* IndexSegment::addBitmap(size_t documents) {
+    size_t words = bitmapWords(documents);
+    bitmaps.resize(bitmaps.size() + words, 0);
+    return bitmaps.data() + bitmaps.size() - words;
+}
+
+size_t IndexSegment::dictionaryBytes() const {
+    if (frozen) return dictionary.memoryBytes();
+    return termText.capacity() + termOffsets.capacity() * sizeof(uint32_t) +
+           termSlots.capacity() * sizeof(int);
+}
+
+int IndexSegment::addDocument(StringRef title, StringRef content, StringRef url) {
+    int docId = docBase + docCount++;
+
+    docTermIds.clear();
+    contentTermIds.clear();
+
+    // Each occurrence is stored as termId * 2 plus 1 for the title, so one
+    // sort groups a term's content and title occurrences together
+    uint32_t titleLength = static_cast<uint32_t>(analyzer.analyze(title.data, title.size).size());
+    for (size_t i = 0; i < titleLength; ++i) {
+        docTermIds.push_back(termIdFor(analyzer.term(i)) * 2 + 1);
+    }
+
+    const vector<TokenSpan>& contentSpans = analyzer.analyze(content.data, content.size);
+    for (size_t i = 0; i < contentSpans.size(); ++i) {
+        int termId = termIdFor(analyzer.term(i));
+        docTermIds.push_back(termId * 2);
+        contentTermIds.push_back(termId);
+    }
+    positions.addDocument(contentSpans, contentTermIds);
+    lengths.push_back(DocumentLength{titleLength, static_cast<uint32_t>(contentSpans.size())});
+    priors.push_back(documentPrior(url, titleLength));
+    titleTokens += titleLength;
+    contentTokens += contentSpans.size();
+
+    // Sorting groups repeated terms; each run becomes one posting. docIds
+    // only grow, so every posting list stays sorted without re-sorting
+    sort(docTermIds.begin(), docTermIds.end());
+    for (size_t i = 0; i < docTermIds.size();) {
+        int termId = docTermIds[i] / 2;
+        int tf = 0;
+        int titleTf = 0;
+        for (; i < docTermIds.size() && docTermIds[i] / 2 == termId; ++i) {
+            tf++;
+            titleTf += docTermIds[i] & 1;
+        }
+        postings[termId].add(docId, tf, titleTf);
+    }
+    return docId;
+}
+
+void IndexSegment::append(const Segment& next, const DeletionBitmap* deleted) {
+    // Every docId in next is larger than ours, so appending each of its
+    // posting lists keeps ours sorted and document frequencies simply add up
+    vector<int> termIdMap(next.termCount(), -1);
+    int nextBase = next.baseDocId();
+    for (size_t i = 0; i < termIdMap.size(); ++i) {
+        PostingListView list = next.postingList(static_cast<int>(i));
+        if (!deleted) {
+            int termId = termIdFor(next.term(static_cast<int>(i)));
+            termIdMap[i] = termId;
+            postings[termId].append(list);
+            continue;
+        }
+
+        // Terms left with no live postings are not carried over
+        for (PostingIterator it(list); it.docId() != kEndDocId; it.next()) {
+            if (deleted->contains(static_cast<size_t>(it.docId() - nextBase))) continue;
+            if (termIdMap[i] < 0) termIdMap[i] = termIdFor(next.term(static_cast<int>(i)));
+            postings[termIdMap[i]].add(it.docId(), it.tf(), it.titleTf());
+        }
+    }
+    positions.append(next.positionStore(), termIdMap, deleted);
+    appendLengths(next, deleted);
+}
+
+void IndexSegment::appendLengths(const Segment& next, const DeletionBitmap* deleted) {
+    const DocumentLength* nextLengths = next.documentLengths();
+    const uint8_t* nextPriors = next.documentPriors();
+    for (size_t doc = 0; doc < next.documentCount(); ++doc) {
+        bool live = !deleted || !deleted->contains(doc);
+        lengths.push_back(live ? nextLengths[doc] : DocumentLength{0, 0});
+        priors.push_back(live ? nextPriors[doc] : 0);
+        titleTokens += lengths.back().title;
+        contentTokens += lengths.back().content;
+    }
+    docCount += static_cast<int>(next.documentCount());
+}
+
+void IndexSegment::merge(const vector<const Segment*>& inputs,
+                         const vector<const DeletionBitmap*>& deleted, bool impactOrdered) {
+    // Each input's terms in sorted order; frozen and mapped segments need no sort
+    size_t inputCount = inputs.size();
+    vector<vector<string>> texts(inputCount);
+    vector<vector<int>> orders(inputCount);
+    vector<vector<int>> termIdMaps(inputCount);
+    for (size_t i = 0; i < inputCount; ++i) {
+        size_t termTotal = inputs[i]->termCount();
+        texts[i].resize(termTotal);
+        for (size_t t = 0; t < termTotal; ++t) texts[i][t] = inputs[i]->term(static_cast<int>(t));
+        orders[i].resize(termTotal);
+        iota(orders[i].begin(), orders[i].end(), 0);
+        if (!is_sorted(texts[i].begin(), texts[i].end())) {
+            const vector<string>& inputTexts = texts[i];
+            sort(orders[i].begin(), orders[i].end(),
+                 [&inputTexts](int a, int b) { return inputTexts[a] < inputTexts[b]; });
+        }
+        termIdMaps[i].assign(termTotal, -1);
+    }
+
+    size_t documents = 0;
+    for (const Segment* input : inputs) documents += input->documentCount();
+    size_t wordCount = bitmapWords(documents);
+
+    // Repeatedly take the smallest next term of any input and concatenate its
+    // posting lists in input order, which is doc-id order
+    vector<size_t> next(inputCount, 0);
+    vector<string> sortedTerms;
+    vector<pair<size_t, int>> sources;      // (input, its term id) of the current term
+    for (;;) {
+        const string* lowest = nullptr;
+        for (size_t i = 0; i < inputCount; ++i) {
+            if (next[i] == orders[i].size()) continue;
+            const string& text = texts[i][orders[i][next[i]]];
+            if (!lowest || text < *lowest) lowest = &text;
+        }
+        if (!lowest) break;
+
+        string text = *lowest;
+        int termId = static_cast<int>(postings.size());
+        PostingList list(codec);
+        sources.clear();
+        for (size_t i = 0; i < inputCount; ++i) {
+            if (next[i] == orders[i].size() || texts[i][orders[i][next[i]]] != text) continue;
+            int inputTermId = orders[i][next[i]++];
+            sources.push_back(make_pair(i, inputTermId));
+            PostingListView view = inputs[i]->postingList(inputTermId);
+            if (!deleted[i]) {
+                list.append(view);
+                termIdMaps[i][inputTermId] = termId;
+                continue;
+            }
+
+            // Terms left with no live postings are not carried over
+            int inputBase = inputs[i]->baseDocId();
+            for (PostingIterator it(view); it.docId() != kEndDocId; it.next()) {
+                if (deleted[i]->contains(static_cast<size_t>(it.docId() - inputBase))) continue;
+                termIdMaps[i][inputTermId] = termId;
+                list.add(it.docId(), it.tf(), it.titleTf());
+            }
+        }
+        if (list.size() == 0) continue;
+
+        // Input bitmaps are shifted into place; only inputs where the term was
+        // too rare for one, or that lose documents, are decoded
+        uint32_t slot = 0;
+        if (wantsBitmap(list.size(), documents)) {
+            uint64_t* bits = addBitmap(documents);
+            for (const pair<size_t, int>& source : sources) {
+                const Segment& input = *inputs[source.first];
+                size_t offset = static_cast<size_t>(input.baseDocId() - docBase);
+                const uint64_t* inputBits = input.termBitmap(source.second);
+                if (inputBits && !deleted[source.first]) {
+                    orShifted(bits, wordCount, inputBits, input.documentCount(), offset);
+                } else {
+                    setBits(bits, offset, input.postingList(source.second), input.baseDocId(),
+                            deleted[source.first]);
+                }
+            }
+            slot = static_cast<uint32_t>(bitmaps.size() / wordCount);
+        }
+        bitmapSlots.push_back(slot);
+        postings.push_back(move(list));
+        sortedTerms.push_back(move(text));
+    }
+
+    for (size_t i = 0; i < inputCount; ++i) {
+        positions.append(inputs[i]->positionStore(), termIdMaps[i], deleted[i]);
+        appendLengths(*inputs[i], deleted[i]);
+    }
+    dictionary = TermDictionary(sortedTerms);
+    frozen = true;
+    // Impacts depend on the merged average length, so inputs' are not reused
+    if (impactOrdered) buildImpacts();
+}
@@ -0,0 +1,141 @@
+#include "../include/Metrics.h"
+#include <utility>
+
+const char* queryPhaseName(QueryPhase phase) {
+    switch (phase) {
+        case QueryPhase::Tokenize: return "tokenize";
+        case QueryPhase::Lookup: return "lookup";
+        case QueryPhase::Rank: return "rank";
+        case QueryPhase::Sort: return "sort";
+        case QueryPhase::Snippets: return "snippets";
+    }
+    return "unknown";
+}
+
+QueryMetrics::QueryMetrics()
+    : postingsScanned(0), candidatesScored(0), results(0), cacheHit(false), sampled(false) {
+    for (size_t p = 0; p < kQueryPhaseCount; ++p) phaseNanos[p] = 0;
+}
+
+uint64_t QueryMetrics::totalNanos() const {
+    uint64_t total = 0;
+    for (size_t p = 0; p < kQueryPhaseCount; ++p) total += phaseNanos[p];
+    return total;
+}
+
+SearchMetrics::SearchMetrics()
+    : queries(0), cacheHits(0), sampledQueries(0), postingsScanned(0), candidatesScored(0),
+      results(0) {
+    for (size_t p = 0; p < kQueryPhaseCount; ++p) phaseNanos[p] = 0;
+}
+
+double SearchMetrics::averagePhaseMicros(QueryPhase phase) const {
+    if (sampledQueries == 0) return 0.0;
+    return phaseNanos[static_cast<size_t>(phase)] / 1000.0 / static_cast<double>(sampledQueries);
+}
+
+QueryTimer::QueryTimer(QueryMetrics& metrics) : metrics(metrics) {
+    if (metrics.sampled) last = chrono::steady_clock::now();
+}
+
+void QueryTimer::lap(QueryPhase phase) {
+    if (!metrics.sampled) return;
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    metrics.phaseNanos[static_cast<size_t>(phase)] += static_cast<uint64_t>(
+        chrono::duration_cast<chrono::nanoseconds>(now - last).count());
+    last = now;
+}
+
+/**
+ * ThreadCounters: One thread's totals. Written with relaxed stores by that
+ * thread only and read with relaxed loads by snapshot()
+ */
+struct MetricsRegistry::ThreadCounters {
+    atomic<uint64_t> queries;
+    atomic<uint64_t> cacheHits;
+    atomic<uint64_t> sampledQueries;
+    atomic<uint64_t> phaseNanos[kQueryPhaseCount];
+    atomic<uint64_t> postingsScanned;
+    atomic<uint64_t> candidatesScored;
+    atomic<uint64_t> results;
+    uint32_t untilSample;       // Queries left before the next sampled one
+
+    ThreadCounters()
+        : queries(0), cacheHits(0), sampledQueries(0), postingsScanned(0), candidatesScored(0),
+          results(0), untilSample(0) {
+        for (size_t p = 0; p < kQueryPhaseCount; ++p) phaseNanos[p].store(0);
+    }
+};
+
+static void add(atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+static atomic<uint64_t> nextRegistryId(1);
+
+MetricsRegistry::MetricsRegistry() : id(nextRegistryId++), sampleEvery(0) {}
+
+MetricsRegistry::~MetricsRegistry() {}
+
+MetricsRegistry::ThreadCounters& MetricsRegistry::local() {
+    // Registry ids are never reused, so entries of destroyed registries are
+    // never matched again
+    static thread_local vector<pair<uint64_t, ThreadCounters*>> owned;
+    for (const pair<uint64_t, ThreadCounters*>& entry : owned) {
+        if (entry.first == id) return *entry.second;
+    }
+    lock_guard<mutex> lock(threadsMutex);
+    threads.push_back(unique_ptr<ThreadCounters>(new ThreadCounters()));
+    owned.push_back(make_pair(id, threads.back().get()));
+    return *threads.back();
+}
+
+void MetricsRegistry::setSampling(uint32_t every) {
+    sampleEvery.store(every, memory_order_relaxed);
+}
+
+void MetricsRegistry::setObserver(QueryObserver callback) {
+    shared_ptr<const QueryObserver> next;
+    if (callback) next = make_shared<const QueryObserver>(move(callback));
+    atomic_store(&observer, next);
+}
+
+bool MetricsRegistry::sampleNext() {
+    uint32_t every = sampleEvery.load(memory_order_relaxed);
+    if (every == 0) return false;
+    ThreadCounters& counters = local();
+    if (counters.untilSample == 0 || counters.untilSample > every) counters.untilSample = every;
+    return --counters.untilSample == 0;
+}
+
+void MetricsRegistry::record(const string& query, const QueryMetrics& metrics) {
+    ThreadCounters& counters = local();
+    add(counters.queries, 1);
+    if (metrics.cacheHit) add(counters.cacheHits, 1);
+    add(counters.postingsScanned, metrics.postingsScanned);
+    add(counters.candidatesScored, metrics.candidatesScored);
+    add(counters.results, metrics.results);
+    if (!metrics.sampled) return;
+
+    add(counters.sampledQueries, 1);
+    for (size_t p = 0; p < kQueryPhaseCount; ++p) add(counters.phaseNanos[p], metrics.phaseNanos[p]);
+    shared_ptr<const QueryObserver> callback = atomic_load(&observer);
+    if (callback) (*callback)(query, metrics);
+}
+
+SearchMetrics MetricsRegistry::snapshot() const {
+    SearchMetrics total;
+    lock_guard<mutex> lock(threadsMutex);
+    for (const unique_ptr<ThreadCounters>& counters : threads) {
+        total.queries += counters->queries.load(memory_order_relaxed);
+        total.cacheHits += counters->cacheHits.load(memory_order_relaxed);
+        total.sampledQueries += counters->sampledQueries.load(memory_order_relaxed);
+        for (size_t p = 0; p < kQueryPhaseCount; ++p) {
+            total.phaseNanos[p] += counters->phaseNanos[p].load(memory_order_relaxed);
+        }
+        total.postingsScanned += counters->postingsScanned.load(memory_order_relaxed);
+        total.candidatesScored += counters->candidatesScored.load(memory_order_relaxed);
+        total.results += counters->results.load(memory_order_relaxed);
+    }
+    return total;
+}
@@ -1,121 +1,1899 @@
 #include "../include/MiniSearchEngine.h"
 
-string MiniSearchEngine::preprocessText(const string& text) {
-    string result;
-    for (char c : text) {
-        if (isalnum(c) || isspace(c)) {
-            result += tolower(c);
-        } else {
-            result += ' ';
+static size_t segmentIndex(const vector<shared_ptr<const Segment>>& segments, int docId) {
+    auto it = upper_bound(segments.begin(), segments.end(), docId,
+        [](int id, const shared_ptr<const Segment>& segment) {
+            return id < segment->baseDocId();
+        });
+    return static_cast<size_t>(it - segments.begin()) - 1;
+}
+
+const Segment& IndexSnapshot::segmentFor(int docId) const {
+    return *segments[segmentIndex(segments, docId)];
+}
+
+DocumentView IndexSnapshot::document(int docId) const {
+    if (file && file->containsDocument(docId)) return file->document(docId);
+    return store->document(docId);
+}
+
+static CollectionStats collectionStatsFor(size_t documents, uint64_t titleTokens,
+                                          uint64_t contentTokens) {
+    double divisor = documents > 0 ? static_cast<double>(documents) : 1.0;
+    return CollectionStats{documents, titleTokens / divisor, contentTokens / divisor};
+}
+
+CollectionStats IndexSnapshot::collectionStats() const {
+    // Like the document count, lengths include removed documents until purged
+    return collectionStatsFor(postedDocumentCount(), titleTokens, contentTokens);
+}
+
+TermStatistics::TermStatistics() : documentCount(0), titleTokens(0), contentTokens(0) {}
+
+void TermStatistics::add(const TermStatistics& other) {
+    if (terms.empty() && documentFrequencies.empty()) {
+        terms = other.terms;
+        documentFrequencies.assign(terms.size(), 0);
+    }
+    for (size_t t = 0; t < documentFrequencies.size() && t < other.documentFrequencies.size(); ++t) {
+        documentFrequencies[t] += other.documentFrequencies[t];
+    }
+    documentCount += other.documentCount;
+    titleTokens += other.titleTokens;
+    contentTokens += other.contentTokens;
+}
+
+bool IndexSnapshot::isDeleted(int docId) const {
+    size_t index = segmentIndex(segments, docId);
+    const DeletionBitmap* deleted = deletions[index].get();
+    return deleted && deleted->contains(static_cast<size_t>(docId - segments[index]->baseDocId()));
+}
+
+SearchCursor::SearchCursor() : score(0.0), documentId(-1), batchScore(0.0), batchDocumentId(-1) {}
+
+AsyncSearchStats::AsyncSearchStats() : queries(0), waited(0), timedOut(0), pagesRequested(0) {}
+
+MergeStats::MergeStats()
+    : segmentsSealed(0), merges(0), segmentsMerged(0), documentsMerged(0), bytesSealed(0), bytesMerged(0),
+      seconds(0.0) {}
+
+double MergeStats::writeAmplification() const {
+    if (bytesSealed == 0) return 1.0;
+    return static_cast<double>(bytesSealed + bytesMerged) / static_cast<double>(bytesSealed);
+}
+
+MiniSearchEngine::MiniSearchEngine(PostingCodec codec, const AnalyzerOptions& analysis)
+    : codec(codec), impactOrdered(false), analyzer(analysis), store(new DocumentStore(0)),
+      pending(new IndexSegment(codec, 0, analyzer)),
+      deletionsPending(false), flushScheduled(false),
+      refreshMillis(static_cast<int>(kDefaultRefreshMillis)), generation(0), parallelMinPostings(0),
+      cursorCache(kCursorCacheEntries), asyncThreads(0),
+      asyncStopping(false), asyncQueries(0), asyncWaited(0), asyncTimedOut(0), asyncPages(0),
+      mergeRunning(false), stopping(false) {
+    publish();
+    mergeThread = thread(&MiniSearchEngine::mergeLoop, this);
+}
+
+MiniSearchEngine::~MiniSearchEngine() {
+    // Parked queries go back to the pool, whose destructor runs what is queued
+    {
+        lock_guard<mutex> lock(asyncMutex);
+        asyncStopping = true;
+    }
+    asyncWakeup.notify_all();
+    if (pagerThread.joinable()) pagerThread.join();
+    asyncPool.reset();
+    {
+        lock_guard<mutex> lock(writeMutex);
+        stopping = true;
+    }
+    mergeWakeup.notify_all();
+    mergeThread.join();
+}
+
+void MiniSearchEngine::publish() {
+    sealPending();
+    installSnapshot();
+}
+
+void MiniSearchEngine::sealPending() {
+    if (pending->documentCount() == 0) return;
+
+    int endDocId = pending->endDocId();
+    mergeTotals.segmentsSealed++;
+    mergeTotals.bytesSealed += pending->postingBytes() + pending->positionBytes();
+    pending->freeze(impactOrdered);
+    sealed.push_back(SealedSegment{shared_ptr<const Segment>(move(pending)), nullptr, false, 0});
+    pending.reset(new IndexSegment(codec, endDocId, analyzer));
+}
+
+void MiniSearchEngine::installSnapshot() {
+    shared_ptr<IndexSnapshot> next(new IndexSnapshot);
+    next->deletedCount = 0;
+    next->purgedCount = 0;
+    next->titleTokens = 0;
+    next->contentTokens = 0;
+    for (SealedSegment& entry : sealed) {
+        next->titleTokens += entry.segment->titleTokenCount();
+        next->contentTokens += entry.segment->contentTokenCount();
+        next->segments.push_back(entry.segment);
+        next->deletions.push_back(entry.deleted);
+        if (entry.deleted) next->deletedCount += entry.deleted->count();
+        next->purgedCount += entry.purged;
+        entry.published = true;
+    }
+    next->file = baseIndex;
+    next->store = store;
+    next->storeBytes = store->memoryBytes();
+    next->endDocId = pending->baseDocId();
+    next->generation = ++generation;
+    next->scoring = scoring;
+    atomic_store(&current, shared_ptr<const IndexSnapshot>(move(next)));
+    deletionsPending = false;
+    flushScheduled = false;
+    mergeWakeup.notify_one();
+}
+
+void MiniSearchEngine::scheduleFlush() {
+    if (flushScheduled || refreshMillis <= 0) return;
+    flushScheduled = true;
+    flushDeadline = chrono::steady_clock::now() + chrono::milliseconds(refreshMillis);
+    mergeWakeup.notify_one();
+}
+
+bool MiniSearchEngine::deleteDocument(int docId) {
+    if (docId < 0 || docId >= pending->endDocId()) return false;
+    // Pending documents have no bitmap yet, so seal them first
+    if (pending->containsDocument(docId)) sealPending();
+
+    auto it = upper_bound(sealed.begin(), sealed.end(), docId,
+        [](int id, const SealedSegment& entry) { return id < entry.segment->baseDocId(); }) - 1;
+    size_t local = static_cast<size_t>(docId - it->segment->baseDocId());
+    if (it->deleted && it->deleted->contains(local)) return false;
+
+    // Copy on write: published bitmaps are being read by queries
+    if (!it->deleted) {
+        it->deleted.reset(new DeletionBitmap(it->segment->documentCount()));
+    } else if (it->published) {
+        it->deleted.reset(new DeletionBitmap(*it->deleted));
+    }
+    it->published = false;
+    it->deleted->insert(local);
+    deletionsPending = true;
+    scheduleFlush();
+    return true;
+}
+
+bool MiniSearchEngine::findMerge(size_t& first, size_t& count) const {
+    // The mapped base file is never rewritten into memory
+    size_t start = (baseIndex && !sealed.empty() && sealed[0].segment == baseIndex) ? 1 : 0;
+
+    // Segments with many unpurged deletions are rewritten alone to drop them
+    for (size_t i = start; i < sealed.size(); ++i) {
+        const SealedSegment& entry = sealed[i];
+        size_t unpurged = entry.deleted ? entry.deleted->count() - entry.purged : 0;
+        if (unpurged * 100 > entry.segment->documentCount() * kRewriteDeletedPercent) {
+            first = i;
+            count = 1;
+            return true;
+        }
+    }
+
+    // Tiered policy: merge the oldest run of kMergeFactor adjacent segments
+    // that fall in the same size tier. Only neighbours are merged so every
+    // segment keeps a contiguous doc-id range
+    size_t runStart = start;
+    int runTier = -1;
+    for (size_t i = start; i < sealed.size(); ++i) {
+        int tier = 0;
+        for (size_t docs = sealed[i].segment->documentCount() / kMergeBaseDocuments;
+             docs >= kMergeFactor; docs /= kMergeFactor) {
+            tier++;
+        }
+        if (tier != runTier) {
+            runStart = i;
+            runTier = tier;
+        }
+        if (i + 1 - runStart == kMergeFactor) {
+            first = runStart;
+            count = kMergeFactor;
+            return true;
         }
     }
-    return result;
+    return false;
 }
 
-vector<string> MiniSearchEngine::tokenize(const string& text) {
-    vector<string> tokens;
-    istringstream iss(preprocessText(text));
-    string word;
-    while (iss >> word) {
-        if (word.length() > 2) {
-            tokens.push_back(word);
+void MiniSearchEngine::mergeLoop() {
+    unique_lock<mutex> lock(writeMutex);
+    while (!stopping) {
+        if (flushScheduled && chrono::steady_clock::now() >= flushDeadline) publish();
+        size_t first = 0;
+        size_t count = 0;
+        if (!findMerge(first, count)) {
+            mergeIdle.notify_all();
+            if (flushScheduled) {
+                mergeWakeup.wait_until(lock, flushDeadline);
+            } else {
+                mergeWakeup.wait(lock);
+            }
+            continue;
+        }
+
+        // Inputs are immutable, so the merge itself runs without the lock.
+        // Marking their bitmaps published makes new deletes copy them
+        vector<SealedSegment> inputs(sealed.begin() + first, sealed.begin() + first + count);
+        for (size_t i = first; i < first + count; ++i) sealed[i].published = true;
+        PostingCodec mergeCodec = codec;
+        bool mergeImpacts = impactOrdered;
+        mergeRunning = true;
+        lock.unlock();
+
+        auto started = chrono::steady_clock::now();
+        shared_ptr<IndexSegment> merged(new IndexSegment(mergeCodec, inputs[0].segment->baseDocId()));
+        vector<const Segment*> mergeInputs;
+        vector<const DeletionBitmap*> mergeDeleted;
+        size_t purged = 0;
+        for (const SealedSegment& input : inputs) {
+            mergeInputs.push_back(input.segment.get());
+            mergeDeleted.push_back(input.deleted.get());
+            if (input.deleted) purged += input.deleted->count();
+        }
+        merged->merge(mergeInputs, mergeDeleted, mergeImpacts);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+        lock.lock();
+        mergeRunning = false;
+
+        // Writers only append to sealed, but openIndex() may have replaced it
+        bool unchanged = first + count <= sealed.size();
+        for (size_t i = 0; unchanged && i < count; ++i) {
+            unchanged = sealed[first + i].segment == inputs[i].segment;
         }
+        if (!unchanged) continue;
+
+        // Deletes that arrived during the merge are carried over as bits;
+        // the bits of purged documents are kept so live counts stay exact
+        shared_ptr<DeletionBitmap> deleted;
+        for (size_t i = 0; i < count; ++i) {
+            const SealedSegment& entry = sealed[first + i];
+            if (!entry.deleted) continue;
+            if (!deleted) deleted.reset(new DeletionBitmap(merged->documentCount()));
+            deleted->insertAll(*entry.deleted,
+                               static_cast<size_t>(entry.segment->baseDocId() - merged->baseDocId()));
+        }
+
+        mergeTotals.merges++;
+        mergeTotals.segmentsMerged += count;
+        mergeTotals.documentsMerged += merged->documentCount();
+        mergeTotals.bytesMerged += merged->postingBytes() + merged->positionBytes();
+        mergeTotals.seconds += seconds;
+
+        sealed.erase(sealed.begin() + first + 1, sealed.begin() + first + count);
+        sealed[first] = SealedSegment{merged, deleted, false, purged};
+        installSnapshot();
     }
-    return tokens;
+    mergeIdle.notify_all();
+}
+
+void MiniSearchEngine::waitForMerges() {
+    unique_lock<mutex> lock(writeMutex);
+    size_t first = 0;
+    size_t count = 0;
+    // Deletes do not wake the merger until they are published
+    mergeWakeup.notify_one();
+    mergeIdle.wait(lock, [&]() { return stopping || (!mergeRunning && !findMerge(first, count)); });
 }
 
-double MiniSearchEngine::calculateTFIDF(const string& term, int docId) {
-    auto termIter = termFrequency[docId].find(term);
-    if (termIter == termFrequency[docId].end()) {
-        return 0.0;
+MergeStats MiniSearchEngine::mergeStats() {
+    lock_guard<mutex> lock(writeMutex);
+    return mergeTotals;
+}
+
+shared_ptr<const IndexSnapshot> MiniSearchEngine::snapshot() {
+    // Publishing is left to writers and the flush timer, so queries never
+    // seal small segments or wait for ingestion
+    return atomic_load(&current);
+}
+
+void MiniSearchEngine::refresh() {
+    lock_guard<mutex> lock(writeMutex);
+    publish();
+}
+
+void MiniSearchEngine::setRefreshInterval(int millis) {
+    lock_guard<mutex> lock(writeMutex);
+    refreshMillis = millis;
+    flushScheduled = false;
+    if (pending->documentCount() > 0 || deletionsPending) scheduleFlush();
+}
+
+vector<QueryTerm> MiniSearchEngine::resolveQuery(const string& query) const {
+    // One analyzer per thread keeps its buffers across queries
+    static thread_local Analyzer queryAnalyzer;
+    queryAnalyzer.copySettings(analyzer);
+    vector<string> texts;
+    size_t count = queryAnalyzer.analyze(query).size();
+    for (size_t i = 0; i < count; ++i) texts.push_back(queryAnalyzer.termText(i));
+    return countTerms(texts);
+}
+
+vector<QueryTerm> MiniSearchEngine::countTerms(vector<string>& texts) {
+    // Repeated terms collapse into one entry whose count makes them weigh more
+    sort(texts.begin(), texts.end());
+
+    vector<QueryTerm> terms;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        if (terms.empty() || terms.back().text != texts[i]) {
+            terms.push_back(QueryTerm{texts[i], 0});
+        }
+        terms.back().count++;
     }
-    double tf = static_cast<double>(termFrequency[docId][term]);
-    double idf = log(static_cast<double>(documents.size()) /
-                    static_cast<double>(documentFrequency[term]));
-    return tf * idf;
+    return terms;
 }
 
-string MiniSearchEngine::generateSnippet(const Document& doc, const vector<string>& queryTerms) {
-    string text = doc.content;
-    string lowerText = preprocessText(text);
+string MiniSearchEngine::generateSnippet(const IndexSnapshot& index, const DocumentView& doc,
+                                         const QueryPlan& plan) {
+    const size_t snippetLength = 150;
+    const StringRef& text = doc.content;
+    size_t s = segmentIndex(index.segments, doc.id);
+    const Segment& segment = *index.segments[s];
+    const int* termIds = plan.termIds.data() + s * plan.termCount;
+    PositionStoreView positions = segment.positionStore();
+    int localDoc = doc.id - segment.baseDocId();
+    const TokenSpan* spans = positions.tokens(localDoc);
+    const TokenSpan* spansEnd = spans + positions.tokenCount(localDoc);
 
-    size_t bestPos = 0;
-    for (const string& term : queryTerms) {
-        size_t pos = lowerText.find(term);
-        if (pos != string::npos) {
-            bestPos = pos;
-            break;
+    // Whole-token occurrences of the query terms, in document order
+    vector<uint32_t> hits;
+    for (size_t t = 0; t < plan.termCount; ++t) {
+        int termId = termIds[t];
+        if (termId < 0) continue;
+        auto range = positions.termPositions(localDoc, termId);
+        hits.insert(hits.end(), range.first, range.second);
+    }
+    sort(hits.begin(), hits.end());
+
+    size_t start = 0;
+    if (!hits.empty()) {
+        // Densest window: the most occurrences that fit in one snippet
+        size_t bestFirst = 0, bestLast = 0, last = 0;
+        for (size_t first = 0; first < hits.size(); ++first) {
+            last = max(last, first);
+            size_t windowStart = spans[hits[first]].offset;
+            while (last + 1 < hits.size() &&
+                   spans[hits[last + 1]].offset + spans[hits[last + 1]].length <=
+                       windowStart + snippetLength) {
+                last++;
+            }
+            if (last - first > bestLast - bestFirst) {
+                bestFirst = first;
+                bestLast = last;
+            }
         }
+
+        // Center the window, keep the snippet full near the end of the text
+        // and snap its start to a token boundary
+        size_t windowBegin = spans[hits[bestFirst]].offset;
+        size_t windowEnd = spans[hits[bestLast]].offset + spans[hits[bestLast]].length;
+        size_t slack = (windowEnd - windowBegin < snippetLength) ?
+                       (snippetLength - (windowEnd - windowBegin)) / 2 : 0;
+        start = (windowBegin > slack) ? windowBegin - slack : 0;
+        start = min(start, (text.size > snippetLength) ? text.size - snippetLength : 0);
+        start = lower_bound(spans, spansEnd, start,
+            [](const TokenSpan& span, size_t offset) { return span.offset < offset; })->offset;
     }
 
-    size_t start = (bestPos > 75) ? bestPos - 75 : 0;
-    size_t length = min(static_cast<size_t>(150), text.length() - start);
+    size_t length = min(snippetLength, text.size - start);
 
-    string snippet = text.substr(start, length);
+    string snippet(text.data + start, length);
     if (start > 0) snippet = "..." + snippet;
-    if (start + length < text.length()) snippet += "...";
+    if (start + length < text.size) snippet += "...";
 
     return snippet;
 }
 
-void MiniSearchEngine::addDocument(const string& title, const string& content, const string& url) {
-    int docId = static_cast<int>(documents.size());
-    documents.emplace_back(docId, title, content, url);
+int MiniSearchEngine::addDocument(const string& title, const string& content, const string& url) {
+    lock_guard<mutex> lock(writeMutex);
+    int docId = pending->addDocument(title, content, url);
+    store->add(title, content, url);
+    if (pending->documentCount() >= kMaxPendingDocuments) {
+        publish();
+    } else {
+        scheduleFlush();
+    }
+    return docId;
+}
+
+bool MiniSearchEngine::removeDocument(int docId) {
+    // Only a bit is set; postings are dropped when the segment is next merged
+    lock_guard<mutex> lock(writeMutex);
+    return deleteDocument(docId);
+}
+
+int MiniSearchEngine::updateDocument(int docId, const string& title, const string& content,
+                                     const string& url) {
+    // Both halves become visible in the same snapshot
+    lock_guard<mutex> lock(writeMutex);
+    if (!deleteDocument(docId)) return -1;
+    int newId = pending->addDocument(title, content, url);
+    store->add(title, content, url);
+    scheduleFlush();
+    return newId;
+}
+
+void MiniSearchEngine::addDocuments(vector<Document> batch, unsigned threadCount) {
+    lock_guard<mutex> lock(writeMutex);
+    vector<DocumentView> views;
+    views.reserve(batch.size());
+    for (const Document& doc : batch) {
+        views.push_back(store->document(store->add(doc.title, doc.content, doc.url)));
+    }
+    batch.clear();
+    batch.shrink_to_fit();
+    indexDocuments(views, threadCount);
+    publish();
+}
+
+void MiniSearchEngine::indexDocuments(const vector<DocumentView>& batch, unsigned threadCount) {
+    // Small batches are not worth a thread each
+    const size_t minDocsPerThread = 256;
+    if (threadCount == 0) threadCount = max(1u, thread::hardware_concurrency());
+    size_t workers = min(static_cast<size_t>(threadCount),
+                         max(static_cast<size_t>(1), batch.size() / minDocsPerThread));
+    int firstId = pending->endDocId();
+
+    if (workers == 1) {
+        for (const DocumentView& doc : batch) pending->addDocument(doc.title, doc.content, doc.url);
+    } else {
+        // Each worker indexes a contiguous slice into a private segment;
+        // merging the segments in slice order reproduces the sequential index
+        vector<IndexSegment> segments;
+        vector<size_t> sliceStart;
+        for (size_t w = 0; w <= workers; ++w) sliceStart.push_back(batch.size() * w / workers);
+        for (size_t w = 0; w < workers; ++w) {
+            segments.emplace_back(codec, firstId + static_cast<int>(sliceStart[w]), analyzer);
+        }
+
+        vector<thread> threads;
+        for (size_t w = 0; w < workers; ++w) {
+            threads.emplace_back([&, w]() {
+                for (size_t i = sliceStart[w]; i < sliceStart[w + 1]; ++i) {
+                    segments[w].addDocument(batch[i].title, batch[i].content, batch[i].url);
+                }
+            });
+        }
+        for (thread& worker : threads) worker.join();
+        for (const IndexSegment& segment : segments) pending->append(segment);
+    }
+
+}
+
+/**
+ * QueryTermCursor: Posting iterator plus the per-query weight of one term
+ */
+struct QueryTermCursor {
+    PostingIterator it;
+    size_t term;        // Position of the term in the query
+    double weight;      // idf times the number of occurrences in the query
+    double maxScore;    // weight times the largest tf in the posting list
+};
+
+/**
+ * ImpactStep: One impact group of a query term, weighted for the query
+ */
+struct ImpactStep {
+    double score;       // Weight times the group's impact value
+    size_t term;
+    uint32_t group;
+};
+
+/**
+ * RankScratch: Buffers reused by every query ranked on a thread, so ranking
+ * does not allocate once they have grown
+ */
+struct RankScratch {
+    vector<QueryTermCursor> cursors;
+    vector<double> prefixBounds;
+    vector<double> blockBounds;
+    vector<double> contributions;
+    vector<size_t> documentFrequency;
+    vector<PostingListView> lists;      // Per cursor, for block bounds of boolean matches
+    vector<size_t> boundBlocks;         // Per cursor, first block that may hold the next match
+    vector<const uint64_t*> bitmaps;    // Per cursor, the term's bitmap or null
+    vector<ImpactListView> impactLists; // Per query term, for impact ranking
+    vector<ImpactStep> impactSteps;
+    vector<double> accumulators;        // Per document of the segment
+    vector<uint32_t> credited;          // Per document, the terms added to its accumulator
+    vector<int> touched;                // Documents with an accumulator, from the base
+    vector<int> groupDocs;
+    QueryPlan plan;         // Plan of a search() call
+    QueryPlan batchPlan;    // Plan of a searchBatch() query; may run inside a search() call
+    TopKHeap heap;
+    uint64_t postingsScanned;   // Of the query running on this thread
+    uint64_t candidatesScored;
+
+    RankScratch() : heap(0), postingsScanned(0), candidatesScored(0) {}
+};
+
+static thread_local RankScratch rankScratch;
+
+static void startRankCounters() {
+    rankScratch.postingsScanned = 0;
+    rankScratch.candidatesScored = 0;
+}
+
+static void takeRankCounters(QueryMetrics& metrics) {
+    metrics.postingsScanned = rankScratch.postingsScanned;
+    metrics.candidatesScored = rankScratch.candidatesScored;
+}
+
+template <class Scorer>
+void MiniSearchEngine::rankSegmentWith(const Segment& segment, const DeletionBitmap* deleted,
+                                       const QueryPlan& plan, size_t segmentIndex,
+                                       int fromDoc, int toDoc, TopKHeap& heap) {
+    int base = segment.baseDocId();
+    size_t termCount = plan.termCount;
+    const int* termIds = plan.termIds.data() + segmentIndex * termCount;
+    const double* weights = plan.weights.data();
+    Scorer scorer(plan.scoring, plan.stats, segment);
+    // The prior counts towards every bound at its largest, priorWeight
+    const uint8_t* priors = segment.documentPriors();
+    double priorBound = plan.scoring.priorWeight;
+
+    vector<QueryTermCursor>& cursors = rankScratch.cursors;
+    cursors.clear();
+    for (size_t i = 0; i < termCount; ++i) {
+        if (termIds[i] < 0) continue;
+        PostingListView postings = segment.postingList(termIds[i]);
+        cursors.push_back(QueryTermCursor{PostingIterator(postings), i, weights[i],
+                                          weights[i] * scorer.bound(postings.maxTf, postings.maxTitleTf)});
+        if (fromDoc > base) cursors.back().it.advance(fromDoc);
+    }
+    sort(cursors.begin(), cursors.end(),
+        [](const QueryTermCursor& a, const QueryTermCursor& b) {
+            return a.maxScore < b.maxScore;
+        });
+
+    // MaxScore: the lowest-bound lists whose combined bound cannot beat the
+    // heap threshold are non-essential and only probed for candidates
+    // produced by the remaining (essential) lists
+    size_t n = cursors.size();
+    vector<double>& prefixBounds = rankScratch.prefixBounds;
+    vector<double>& blockBounds = rankScratch.blockBounds;
+    vector<double>& contributions = rankScratch.contributions;
+    prefixBounds.resize(n);
+    blockBounds.resize(n);
+    contributions.assign(termCount, 0.0);
+    double runningBound = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        runningBound += cursors[i].maxScore;
+        prefixBounds[i] = runningBound;
+    }
+
+    // The heap may already be full from earlier segments
+    size_t firstEssential = 0;
+    while (firstEssential < n && prefixBounds[firstEssential] + priorBound < heap.threshold()) {
+        firstEssential++;
+    }
+
+    // Finishes a candidate whose essential contributions are recorded:
+    // probes the non-essential lists unless the bounds rule it out
+    uint64_t scored = 0;
+    auto evaluate = [&](int docId, double score) {
+        double prior = priorScore(plan.scoring, priors[docId - base]);
+        score += prior;
+        double threshold = heap.threshold();
+        double remaining = (firstEssential > 0) ? prefixBounds[firstEssential - 1] : 0.0;
+        if (score + remaining <= threshold ||
+            (deleted && deleted->contains(static_cast<size_t>(docId - base)))) {
+            fill(contributions.begin(), contributions.end(), 0.0);
+            return;
+        }
+
+        // Tighten the bound with block maxima before decoding any block
+        remaining = 0.0;
+        for (size_t i = 0; i < firstEssential; ++i) {
+            int maxTf, maxTitleTf;
+            cursors[i].it.blockMaxima(docId, maxTf, maxTitleTf);
+            blockBounds[i] = cursors[i].weight * scorer.bound(maxTf, maxTitleTf);
+            remaining += blockBounds[i];
+        }
+
+        bool pruned = false;
+        for (size_t i = firstEssential; i-- > 0;) {
+            if (score + remaining <= threshold) {
+                pruned = true;
+                break;
+            }
+            remaining -= blockBounds[i];
+            cursors[i].it.advance(docId);
+            if (cursors[i].it.docId() == docId) {
+                contributions[cursors[i].term] = cursors[i].weight *
+                    scorer.score(docId - base, cursors[i].it.tf(), cursors[i].it.titleTf());
+                score += contributions[cursors[i].term];
+            }
+        }
+
+        // Sum in query order so the score does not depend on how the
+        // cursors were sorted, which differs from segment to segment
+        if (!pruned) {
+            score = 0.0;
+            for (double contribution : contributions) score += contribution;
+            score += prior;
+        }
+        fill(contributions.begin(), contributions.end(), 0.0);
+
+        if (pruned) return;
+        scored++;
+        if (heap.push(docId, score)) {
+            threshold = heap.threshold();
+            while (firstEssential < n && prefixBounds[firstEssential] + priorBound < threshold) {
+                firstEssential++;
+            }
+        }
+    };
+
+    double blockScores[kPostingBlockSize];
+    while (firstEssential < n) {
+        if (firstEssential == n - 1) {
+            // One essential list left: score the rest of its decoded block in
+            // one loop over the frequency arrays and only evaluate documents
+            // that can still beat the threshold
+            QueryTermCursor& essential = cursors[n - 1];
+            int count = essential.it.blockRemaining();
+            if (count == 0) break;
+            const int* docs = essential.it.blockDocIds();
+            const int* tfs = essential.it.blockTfs();
+            const int* titleTfs = essential.it.blockTitleTfs();
+            bool rangeEnds = docs[count - 1] >= toDoc;
+            if (rangeEnds) count = static_cast<int>(lower_bound(docs, docs + count, toDoc) - docs);
+
+            double weight = essential.weight;
+            for (int i = 0; i < count; ++i) {
+                blockScores[i] = weight * scorer.score(docs[i] - base, tfs[i], titleTfs[i]);
+            }
+
+            double remaining = (n > 1) ? prefixBounds[n - 2] : 0.0;
+            for (int i = 0; i < count && firstEssential < n; ++i) {
+                if (blockScores[i] + remaining + priorBound <= heap.threshold()) continue;
+                contributions[essential.term] = blockScores[i];
+                evaluate(docs[i], blockScores[i]);
+            }
+            if (rangeEnds) break;
+            essential.it.nextBlock();
+            continue;
+        }
+
+        int docId = kEndDocId;
+        for (size_t i = firstEssential; i < n; ++i) {
+            docId = min(docId, cursors[i].it.docId());
+        }
+        if (docId >= toDoc) break;
+
+        double score = 0.0;
+        for (size_t i = firstEssential; i < n; ++i) {
+            if (cursors[i].it.docId() == docId) {
+                contributions[cursors[i].term] = cursors[i].weight *
+                    scorer.score(docId - base, cursors[i].it.tf(), cursors[i].it.titleTf());
+                score += contributions[cursors[i].term];
+                cursors[i].it.next();
+            }
+        }
+        evaluate(docId, score);
+    }
+
+    rankScratch.candidatesScored += scored;
+    for (const QueryTermCursor& cursor : cursors) {
+        rankScratch.postingsScanned += cursor.it.postingsDecoded();
+    }
+}
+
+void MiniSearchEngine::rankSegment(const Segment& segment, const DeletionBitmap* deleted,
+                                   const QueryPlan& plan, size_t segmentIndex,
+                                   int fromDoc, int toDoc, TopKHeap& heap) {
+    switch (plan.scoring.model) {
+        case ScoringModel::TfIdf:
+            rankSegmentWith<TfIdfScorer>(segment, deleted, plan, segmentIndex, fromDoc, toDoc, heap);
+            break;
+        case ScoringModel::BM25:
+            rankSegmentWith<BM25Scorer>(segment, deleted, plan, segmentIndex, fromDoc, toDoc, heap);
+            break;
+        case ScoringModel::BM25F:
+            rankSegmentWith<BM25FScorer>(segment, deleted, plan, segmentIndex, fromDoc, toDoc, heap);
+            break;
+    }
+}
+
+static bool hasBit(const uint64_t* bits, size_t doc) {
+    return (bits[doc >> 6] >> (doc & 63)) & 1;
+}
+
+// First document at or after docId whose bit is set, kEndDocId if none
+static int nextSetBit(const uint64_t* bits, int base, size_t documents, int docId) {
+    size_t doc = static_cast<size_t>(docId - base);
+    size_t words = Segment::bitmapWords(documents);
+    size_t w = doc >> 6;
+    uint64_t word = bits[w] & (~uint64_t(0) << (doc & 63));
+    while (!word) {
+        if (++w == words) return kEndDocId;
+        word = bits[w];
+    }
+    return base + static_cast<int>(w * 64 + countTrailingZeros(word));
+}
 
-    vector<string> titleTokens = tokenize(title);
-    vector<string> contentTokens = tokenize(content);
+template <class Scorer>
+void MiniSearchEngine::rankConjunction(const Segment& segment, const DeletionBitmap* deleted,
+                                       const QueryPlan& plan, size_t segmentIndex,
+                                       const vector<int>& excludedIds, TopKHeap& heap) {
+    int base = segment.baseDocId();
+    size_t termCount = plan.termCount;
+    const int* termIds = plan.termIds.data() + segmentIndex * termCount;
+    Scorer scorer(plan.scoring, plan.stats, segment);
+    const uint8_t* priors = segment.documentPriors();
+
+    // Every query term is required, so a term missing here rules the segment out
+    vector<QueryTermCursor>& cursors = rankScratch.cursors;
+    vector<PostingListView>& lists = rankScratch.lists;
+    vector<size_t>& boundBlocks = rankScratch.boundBlocks;
+    vector<const uint64_t*>& bitmaps = rankScratch.bitmaps;
+    cursors.clear();
+    lists.clear();
+    bitmaps.clear();
+    size_t lead = 0;
+    for (size_t t = 0; t < termCount; ++t) {
+        if (termIds[t] < 0) return;
+        lists.push_back(segment.postingList(termIds[t]));
+        bitmaps.push_back(segment.termBitmap(termIds[t]));
+        cursors.push_back(QueryTermCursor{PostingIterator(lists[t]), t, plan.weights[t],
+            plan.weights[t] * scorer.bound(lists[t].maxTf, lists[t].maxTitleTf)});
+        if (lists[t].size() < lists[lead].size()) lead = t;
+    }
+    if (cursors.empty()) return;
+    boundBlocks.assign(cursors.size(), 0);
+    double othersBound = 0.0;
+    for (size_t i = 0; i < cursors.size(); ++i) {
+        if (i != lead) othersBound += cursors[i].maxScore;
+    }
+
+    // Excluded terms with a bitmap cost a bit test per match
+    vector<PostingIterator> excluded;
+    vector<const uint64_t*> excludedBitmaps;
+    for (int termId : excludedIds) {
+        const uint64_t* bits = segment.termBitmap(termId);
+        if (bits) excludedBitmaps.push_back(bits);
+        else excluded.push_back(PostingIterator(segment.postingList(termId)));
+    }
+    size_t documents = segment.documentCount();
+
+    // The rarest list leads; the others gallop to its candidates and, when
+    // past one, name the next candidate (leapfrog intersection)
+    PostingIterator& leader = cursors[lead].it;
+    int docId = leader.docId();
+    while (docId != kEndDocId) {
+        if (heap.full()) {
+            double threshold = heap.threshold();
+            int maxTf, maxTitleTf;
+            leader.blockMaxima(docId, maxTf, maxTitleTf);
+            double leadBound = cursors[lead].weight * scorer.bound(maxTf, maxTitleTf);
+            if (leadBound + othersBound + plan.scoring.priorWeight <= threshold) {
+                leader.nextBlock();
+                docId = leader.docId();
+                continue;
+            }
+
+            // Exact for the leading list and the prior, block maxima from the
+            // skip headers for the rest
+            double bound = priorScore(plan.scoring, priors[docId - base]) + cursors[lead].weight *
+                scorer.score(docId - base, leader.tf(), leader.titleTf());
+            for (size_t i = 0; i < cursors.size(); ++i) {
+                if (i == lead) continue;
+                const PostingListView& list = lists[i];
+                size_t& block = boundBlocks[i];
+                while (block < list.blockCount && list.blocks[block].maxDocId < docId) block++;
+                bound += cursors[i].weight * (block < list.blockCount
+                    ? scorer.bound(list.blocks[block].maxTf, list.blocks[block].maxTitleTf)
+                    : scorer.bound(list.tailMaxTf, list.tailMaxTitleTf));
+            }
+            if (bound <= threshold) {
+                leader.next();
+                docId = leader.docId();
+                continue;
+            }
+        }
 
-    vector<string> allTokens = titleTokens;
-    allTokens.insert(allTokens.end(), titleTokens.begin(), titleTokens.end());
-    allTokens.insert(allTokens.end(), contentTokens.begin(), contentTokens.end());
+        // Bitmaps reject a candidate, and name the next one, without decoding
+        int candidate = docId;
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            if (i == lead || !bitmaps[i] || hasBit(bitmaps[i], static_cast<size_t>(docId - base))) continue;
+            candidate = max(candidate, nextSetBit(bitmaps[i], base, documents, docId));
+        }
+        for (size_t i = 0; i < cursors.size() && candidate == docId; ++i) {
+            if (i == lead) continue;
+            cursors[i].it.advance(docId);
+            candidate = max(candidate, cursors[i].it.docId());
+        }
+        if (candidate != docId) {
+            if (candidate == kEndDocId) break;
+            leader.advance(candidate);
+            docId = leader.docId();
+            continue;
+        }
 
-    unordered_set<string> uniqueTerms;
-    for (const string& token : allTokens) {
-        invertedIndex[token].insert(docId);
-        termFrequency[docId][token]++;
-        uniqueTerms.insert(token);
+        bool skip = deleted && deleted->contains(static_cast<size_t>(docId - base));
+        for (size_t i = 0; i < excludedBitmaps.size() && !skip; ++i) {
+            skip = hasBit(excludedBitmaps[i], static_cast<size_t>(docId - base));
+        }
+        for (size_t i = 0; i < excluded.size() && !skip; ++i) {
+            excluded[i].advance(docId);
+            skip = excluded[i].docId() == docId;
+        }
+        if (!skip) {
+            double score = 0.0;
+            for (QueryTermCursor& cursor : cursors) {
+                score += cursor.weight *
+                    scorer.score(docId - base, cursor.it.tf(), cursor.it.titleTf());
+            }
+            score += priorScore(plan.scoring, priors[docId - base]);
+            heap.push(docId, score);
+            rankScratch.candidatesScored++;
+        }
+        leader.next();
+        docId = leader.docId();
     }
 
-    for (const string& term : uniqueTerms) {
-        documentFrequency[term]++;
+    for (const QueryTermCursor& cursor : cursors) {
+        rankScratch.postingsScanned += cursor.it.postingsDecoded();
     }
+    for (const PostingIterator& it : excluded) rankScratch.postingsScanned += it.postingsDecoded();
 }
 
-vector<SearchResult> MiniSearchEngine::search(const string& query, int maxResults) {
-    vector<string> queryTerms = tokenize(query);
-    unordered_map<int, double> scores;
+template <class Scorer>
+void MiniSearchEngine::scoreMatches(const Segment& segment, const QueryPlan& plan,
+                                    size_t segmentIndex, const vector<int>& matches,
+                                    TopKHeap& heap) {
+    int base = segment.baseDocId();
+    size_t termCount = plan.termCount;
+    const int* termIds = plan.termIds.data() + segmentIndex * termCount;
+    Scorer scorer(plan.scoring, plan.stats, segment);
+    const uint8_t* priors = segment.documentPriors();
 
-    for (const string& term : queryTerms) {
-        auto indexIter = invertedIndex.find(term);
-        if (indexIter != invertedIndex.end()) {
-            for (int docId : indexIter->second) {
-                scores[docId] += calculateTFIDF(term, docId);
+    // One cursor per query term, so contributions add up in query order
+    vector<QueryTermCursor>& cursors = rankScratch.cursors;
+    vector<PostingListView>& lists = rankScratch.lists;
+    vector<size_t>& boundBlocks = rankScratch.boundBlocks;
+    vector<const uint64_t*>& bitmaps = rankScratch.bitmaps;
+    cursors.clear();
+    lists.clear();
+    bitmaps.clear();
+    for (size_t t = 0; t < termCount; ++t) {
+        if (termIds[t] < 0) continue;
+        lists.push_back(segment.postingList(termIds[t]));
+        bitmaps.push_back(segment.termBitmap(termIds[t]));
+        cursors.push_back(QueryTermCursor{PostingIterator(lists.back()), t, plan.weights[t], 0.0});
+    }
+    boundBlocks.assign(cursors.size(), 0);
+
+    for (int docId : matches) {
+        // Once the heap is full, a match whose block maxima cannot beat its
+        // threshold is skipped by reading skip headers only, never decoding
+        double prior = priorScore(plan.scoring, priors[docId - base]);
+        if (heap.full()) {
+            double bound = prior;
+            for (size_t i = 0; i < cursors.size(); ++i) {
+                const PostingListView& list = lists[i];
+                size_t& block = boundBlocks[i];
+                while (block < list.blockCount && list.blocks[block].maxDocId < docId) block++;
+                bound += cursors[i].weight * (block < list.blockCount
+                    ? scorer.bound(list.blocks[block].maxTf, list.blocks[block].maxTitleTf)
+                    : scorer.bound(list.tailMaxTf, list.tailMaxTitleTf));
+            }
+            if (bound <= heap.threshold()) continue;
+        }
+
+        // A term whose bitmap lacks the match is not decoded up to it
+        double score = 0.0;
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            if (bitmaps[i] && !hasBit(bitmaps[i], static_cast<size_t>(docId - base))) continue;
+            PostingIterator& it = cursors[i].it;
+            it.advance(docId);
+            if (it.docId() == docId) {
+                score += cursors[i].weight * scorer.score(docId - base, it.tf(), it.titleTf());
             }
         }
+        score += prior;
+        heap.push(docId, score);
+        rankScratch.candidatesScored++;
     }
 
-    vector<SearchResult> results;
-    for (const auto& scorePair : scores) {
-        int docId = scorePair.first;
-        double score = scorePair.second;
-        const Document& doc = documents[docId];
+    for (const QueryTermCursor& cursor : cursors) {
+        rankScratch.postingsScanned += cursor.it.postingsDecoded();
+    }
+}
 
-        string snippet = generateSnippet(doc, queryTerms);
-        results.emplace_back(docId, score, doc.title, snippet, doc.url);
+void MiniSearchEngine::rankBoolean(const Segment& segment, const DeletionBitmap* deleted,
+                                   const QueryPlan& plan, size_t segmentIndex,
+                                   const QueryNode& root, const int* tableIds, bool conjunction,
+                                   TopKHeap& heap) {
+    vector<int> matches;
+    vector<int> excludedIds;
+    if (conjunction) {
+        for (const QueryNode& child : root.children) {
+            if (child.type != QueryNodeType::Not) continue;
+            int termId = tableIds[child.children[0].slots[0]];
+            if (termId >= 0) excludedIds.push_back(termId);
+        }
+    } else {
+        BooleanMatcher matcher(segment, tableIds);
+        DocSet matched = matcher.match(root);
+        rankScratch.postingsScanned += matcher.postingsVisited();
+        if (deleted) matched.subtract(deleted->data());
+        matches = matched.toVector();
     }
 
-    sort(results.begin(), results.end(),
-        [](const SearchResult& a, const SearchResult& b) {
-            return a.score > b.score;
+    switch (plan.scoring.model) {
+        case ScoringModel::TfIdf:
+            if (conjunction) {
+                rankConjunction<TfIdfScorer>(segment, deleted, plan, segmentIndex, excludedIds, heap);
+            } else {
+                scoreMatches<TfIdfScorer>(segment, plan, segmentIndex, matches, heap);
+            }
+            break;
+        case ScoringModel::BM25:
+            if (conjunction) {
+                rankConjunction<BM25Scorer>(segment, deleted, plan, segmentIndex, excludedIds, heap);
+            } else {
+                scoreMatches<BM25Scorer>(segment, plan, segmentIndex, matches, heap);
+            }
+            break;
+        case ScoringModel::BM25F:
+            if (conjunction) {
+                rankConjunction<BM25FScorer>(segment, deleted, plan, segmentIndex, excludedIds, heap);
+            } else {
+                scoreMatches<BM25FScorer>(segment, plan, segmentIndex, matches, heap);
+            }
+            break;
+    }
+}
+
+// True if every operand is a term or an excluded term, as in "rust async -java"
+static bool isTermConjunction(const QueryNode& root) {
+    if (root.type == QueryNodeType::Term) return true;
+    if (root.type != QueryNodeType::And) return false;
+    bool positive = false;
+    for (const QueryNode& child : root.children) {
+        const QueryNode& operand = (child.type == QueryNodeType::Not) ? child.children[0] : child;
+        if (operand.type != QueryNodeType::Term) return false;
+        if (child.type != QueryNodeType::Not) positive = true;
+    }
+    return positive;
+}
+
+void MiniSearchEngine::rankImpacts(const Segment& segment, const DeletionBitmap* deleted,
+                                   const QueryPlan& plan, size_t segmentIndex, size_t k,
+                                   double postingFraction, TopKHeap& heap) {
+    int base = segment.baseDocId();
+    size_t termCount = plan.termCount;
+    const int* termIds = plan.termIds.data() + segmentIndex * termCount;
+    const double* weights = plan.weights.data();
+    const uint8_t* priors = segment.documentPriors();
+    double priorBound = plan.scoring.priorWeight;
+    ImpactScorer scorer(segment);
+    ImpactIndexView impacts = segment.impactIndex();
+
+    // A document's accumulator starts at its prior when it is first touched;
+    // bit t of its mask records that term t (t < 31) has been added, and
+    // bit 31 that it is touched at all
+    vector<double>& accumulators = rankScratch.accumulators;
+    vector<uint32_t>& credited = rankScratch.credited;
+    vector<int>& touched = rankScratch.touched;
+    if (accumulators.size() < segment.documentCount()) {
+        accumulators.resize(segment.documentCount(), 0.0);
+        credited.resize(segment.documentCount(), 0);
+    }
+    touched.clear();
+    const uint32_t kTouched = uint32_t(1) << 31;
+    auto credit = [&](int doc, size_t term, double score) {
+        if (!credited[doc]) {
+            touched.push_back(doc);
+            credited[doc] = kTouched;
+            accumulators[doc] = priorScore(plan.scoring, priors[doc]);
+        }
+        if (term < 31) credited[doc] |= uint32_t(1) << term;
+        accumulators[doc] += score;
+    };
+    auto ranksFirst = [&accumulators](int a, int b) {
+        double scoreA = accumulators[a], scoreB = accumulators[b];
+        return scoreA != scoreB ? scoreA > scoreB : a < b;
+    };
+
+    uint64_t scanned = 0;
+    if (impacts.empty()) {
+        for (size_t t = 0; t < termCount; ++t) {
+            if (termIds[t] < 0) continue;
+            PostingIterator it(segment.postingList(termIds[t]));
+            for (; it.docId() != kEndDocId; it.next()) {
+                int doc = it.docId() - base;
+                if (deleted && deleted->contains(static_cast<size_t>(doc))) continue;
+                credit(doc, t, weights[t] * scorer.value(scorer.impact(doc, it.tf())));
+            }
+            scanned += it.postingsDecoded();
+        }
+    } else {
+        // Every group of every term, best first; a term's groups keep their order
+        vector<ImpactListView>& lists = rankScratch.impactLists;
+        vector<ImpactStep>& steps = rankScratch.impactSteps;
+        vector<double>& next = rankScratch.contributions;     // Per term, its next step's score
+        lists.assign(termCount, ImpactListView());
+        next.assign(termCount, 0.0);
+        steps.clear();
+        size_t postings = 0;
+        for (size_t t = 0; t < termCount; ++t) {
+            if (termIds[t] < 0) continue;
+            lists[t] = impacts.list(termIds[t]);
+            for (uint32_t g = 0; g < lists[t].groupCount; ++g) {
+                double score = weights[t] * scorer.value(lists[t].groups[g].impact);
+                steps.push_back(ImpactStep{score, t, g});
+                postings += lists[t].groups[g].count;
+                if (g == 0) next[t] = score;
+            }
+        }
+        sort(steps.begin(), steps.end(), [](const ImpactStep& a, const ImpactStep& b) {
+            if (a.score != b.score) return a.score > b.score;
+            return a.term != b.term ? a.term < b.term : a.group < b.group;
         });
+        uint64_t budget = UINT64_MAX;
+        if (postingFraction < 1.0) {
+            double share = max(postingFraction, 0.0) * static_cast<double>(postings);
+            budget = static_cast<uint64_t>(ceil(share));
+        }
+        // What a document can still gain from the terms it has not had yet
+        auto unscored = [&](uint32_t mask) {
+            double sum = 0.0;
+            for (size_t t = 0; t < termCount; ++t) {
+                if (t >= 31 || !(mask & (uint32_t(1) << t))) sum += next[t];
+            }
+            return sum;
+        };
 
-    if (results.size() > static_cast<size_t>(maxResults)) {
-        results.resize(maxResults);
+        // Ranking stops once neither a document not yet seen, which reaches at
+        // most remaining + priorBound, nor a seen one outside the k best can
+        // pass floor, the k-th best score or the heap's threshold if higher.
+        // A check costs a pass over the touched documents, so it waits until
+        // postings for a quarter of them have been scored since the last one,
+        // and for the stale floor, which scores only ever raise, to allow it
+        vector<int>& docs = rankScratch.groupDocs;
+        double floor = heap.threshold();
+        uint64_t lastCheck = 0;
+        for (const ImpactStep& step : steps) {
+            docs.clear();
+            lists[step.term].decodeGroup(step.group, docs);
+            size_t count = static_cast<size_t>(min<uint64_t>(docs.size(), budget - scanned));
+            for (size_t i = 0; i < count; ++i) {
+                if (deleted && deleted->contains(static_cast<size_t>(docs[i]))) continue;
+                credit(docs[i], step.term, step.score);
+            }
+            scanned += count;
+            if (scanned >= budget) break;
+
+            const ImpactListView& list = lists[step.term];
+            next[step.term] = step.group + 1 < list.groupCount
+                ? weights[step.term] * scorer.value(list.groups[step.group + 1].impact) : 0.0;
+            double remaining = 0.0;
+            for (double bound : next) remaining += bound;
+            uint64_t since = scanned - lastCheck;
+            bool hopeless = remaining + priorBound >= floor;
+            if (since <= touched.size() / 4 || (hopeless && since < touched.size())) continue;
+
+            lastCheck = scanned;
+            floor = heap.threshold();
+            size_t inside = min(k, touched.size());
+            if (inside == k) {
+                nth_element(touched.begin(), touched.begin() + static_cast<ptrdiff_t>(k - 1),
+                            touched.end(), ranksFirst);
+                floor = max(floor, accumulators[touched[k - 1]]);
+            }
+            if (remaining + priorBound >= floor) continue;
+            // One with nothing left to gain already ranks below the k-th
+            bool settled = true;
+            for (size_t i = inside; i < touched.size() && settled; ++i) {
+                double gain = unscored(credited[touched[i]]);
+                settled = gain == 0.0 || accumulators[touched[i]] + gain < floor;
+            }
+            if (settled) break;
+        }
+    }
+
+    // The k best by accumulator are rescored from their doc-id lists, summing
+    // in query order, so scores do not depend on where ranking stopped
+    size_t chosen = min(k, touched.size());
+    partial_sort(touched.begin(), touched.begin() + static_cast<ptrdiff_t>(chosen), touched.end(),
+                 ranksFirst);
+    for (int doc : touched) credited[doc] = 0;
+    touched.resize(chosen);
+    sort(touched.begin(), touched.end());
+    vector<double>& scores = rankScratch.prefixBounds;
+    scores.assign(chosen, 0.0);
+    for (size_t t = 0; t < termCount; ++t) {
+        if (termIds[t] < 0) continue;
+        PostingIterator it(segment.postingList(termIds[t]));
+        for (size_t i = 0; i < chosen; ++i) {
+            it.advance(base + touched[i]);
+            if (it.docId() == base + touched[i]) {
+                scores[i] += weights[t] * scorer.value(scorer.impact(touched[i], it.tf()));
+            }
+        }
+        scanned += it.postingsDecoded();
+    }
+    for (size_t i = 0; i < chosen; ++i) {
+        heap.push(base + touched[i], scores[i] + priorScore(plan.scoring, priors[touched[i]]));
+    }
+    rankScratch.postingsScanned += scanned;
+    rankScratch.candidatesScored += chosen;
+}
+
+void MiniSearchEngine::planQuery(const IndexSnapshot& index, const vector<QueryTerm>& queryTerms,
+                                 QueryPlan& plan, const TermStatistics* global) {
+    const vector<shared_ptr<const Segment>>& parts = index.segments;
+    size_t termCount = queryTerms.size();
+
+    // Document frequencies are summed over all segments so scores match
+    // those of a single combined index
+    vector<size_t>& documentFrequency = rankScratch.documentFrequency;
+    documentFrequency.assign(termCount, 0);
+    plan.termCount = termCount;
+    plan.termIds.assign(parts.size() * termCount, -1);
+    for (size_t s = 0; s < parts.size(); ++s) {
+        for (size_t t = 0; t < termCount; ++t) {
+            int termId = parts[s]->findTermId(queryTerms[t].text);
+            plan.termIds[s * termCount + t] = termId;
+            if (termId >= 0) documentFrequency[t] += parts[s]->postingList(termId).size();
+        }
+    }
+
+    plan.scoring = index.scoring;
+    plan.stats = global ? collectionStatsFor(static_cast<size_t>(global->documentCount),
+                                             global->titleTokens, global->contentTokens)
+                        : index.collectionStats();
+    plan.postingTotal = 0;
+    plan.paged = false;
+    plan.weights.assign(termCount, 0.0);
+    for (size_t t = 0; t < termCount; ++t) {
+        plan.postingTotal += documentFrequency[t];
+        if (documentFrequency[t] == 0) continue;
+        size_t frequency = documentFrequency[t];
+        if (global) {
+            const vector<string>& terms = global->terms;
+            auto it = lower_bound(terms.begin(), terms.end(), queryTerms[t].text);
+            size_t g = static_cast<size_t>(it - terms.begin());
+            if (it != terms.end() && *it == queryTerms[t].text &&
+                g < global->documentFrequencies.size()) {
+                frequency = static_cast<size_t>(global->documentFrequencies[g]);
+            }
+        }
+        plan.weights[t] = queryTerms[t].count * scoringIDF(plan.scoring.model, frequency,
+                                                           plan.stats.documentCount);
+    }
+}
+
+vector<ScoredDocument> MiniSearchEngine::rankPlan(const IndexSnapshot& index, const QueryPlan& plan,
+                                                  size_t k, bool allowParallel,
+                                                  QueryTimer& timer) const {
+    const vector<shared_ptr<const Segment>>& parts = index.segments;
+    k = index.resultLimit(k);
+
+    shared_ptr<ThreadPool> pool;
+    if (allowParallel) pool = atomic_load(&searchPool);
+    if (!pool || plan.postingTotal < parallelMinPostings) {
+        // Segments are visited in doc-id order, which keeps the heap's
+        // lower-docId tie-breaking valid across segments
+        TopKHeap& heap = rankScratch.heap;
+        heap.reset(k);
+        if (plan.paged) heap.startAfter(plan.after);
+        for (size_t s = 0; s < parts.size(); ++s) {
+            rankSegment(*parts[s], index.deletions[s].get(), plan, s, parts[s]->baseDocId(),
+                        kEndDocId, heap);
+        }
+        timer.lap(QueryPhase::Rank);
+        vector<ScoredDocument> ranked = heap.sortedResults();
+        timer.lap(QueryPhase::Sort);
+        return ranked;
+    }
+
+    // Each doc-id range keeps its own top k. A document in the global top k
+    // is also in the top k of its range, so merging the ranges is exact
+    size_t ranges = pool->size() * kRangesPerSearchThread;
+    vector<TopKHeap> heaps(ranges, TopKHeap(k));
+    if (plan.paged) {
+        for (TopKHeap& heap : heaps) heap.startAfter(plan.after);
+    }
+    atomic<uint64_t> postingsScanned(0);
+    atomic<uint64_t> candidatesScored(0);
+    pool->parallelFor(ranges, [&](size_t r) {
+        // Whichever thread runs the range may be in the middle of its own
+        // query, so its counters are put back once this range's are taken
+        uint64_t postingsBefore = rankScratch.postingsScanned;
+        uint64_t candidatesBefore = rankScratch.candidatesScored;
+        int fromDoc = static_cast<int>(static_cast<int64_t>(index.endDocId) * r / ranges);
+        int toDoc = static_cast<int>(static_cast<int64_t>(index.endDocId) * (r + 1) / ranges);
+        for (size_t s = 0; s < parts.size(); ++s) {
+            if (parts[s]->endDocId() <= fromDoc || parts[s]->baseDocId() >= toDoc) continue;
+            rankSegment(*parts[s], index.deletions[s].get(), plan, s, fromDoc, toDoc, heaps[r]);
+        }
+        postingsScanned += rankScratch.postingsScanned - postingsBefore;
+        candidatesScored += rankScratch.candidatesScored - candidatesBefore;
+        rankScratch.postingsScanned = postingsBefore;
+        rankScratch.candidatesScored = candidatesBefore;
+    });
+    rankScratch.postingsScanned += postingsScanned;
+    rankScratch.candidatesScored += candidatesScored;
+    timer.lap(QueryPhase::Rank);
+
+    TopKHeap heap(k);
+    for (const TopKHeap& partial : heaps) {
+        for (const ScoredDocument& scored : partial.sortedResults()) {
+            heap.push(scored.documentId, scored.score);
+        }
+    }
+    vector<ScoredDocument> ranked = heap.sortedResults();
+    timer.lap(QueryPhase::Sort);
+    return ranked;
+}
+
+vector<ScoredDocument> MiniSearchEngine::rankDocuments(const IndexSnapshot& index,
+                                                       const vector<QueryTerm>& queryTerms,
+                                                       size_t k, QueryTimer& timer,
+                                                       const TermStatistics* global) const {
+    QueryPlan& plan = rankScratch.plan;
+    planQuery(index, queryTerms, plan, global);
+    timer.lap(QueryPhase::Lookup);
+    return rankPlan(index, plan, k, true, timer);
+}
+
+void MiniSearchEngine::setSearchThreads(unsigned threadCount, size_t minPostings) {
+    shared_ptr<ThreadPool> pool;
+    if (threadCount > 1) pool.reset(new ThreadPool(threadCount));
+    parallelMinPostings = minPostings;
+    // Queries already running keep the previous pool alive
+    atomic_store(&searchPool, pool);
+}
+
+vector<SearchResult> MiniSearchEngine::buildResults(const IndexSnapshot& index,
+                                                    const vector<ScoredDocument>& ranked,
+                                                    const QueryPlan& plan, bool withSnippets) {
+    vector<SearchResult> results;
+    results.reserve(ranked.size());
+    for (const ScoredDocument& scored : ranked) {
+        DocumentView doc = index.document(scored.documentId);
+        string snippet = withSnippets ? generateSnippet(index, doc, plan) : "";
+        results.emplace_back(scored.documentId, scored.score, doc.title, snippet, doc.url);
+    }
+    return results;
+}
+
+string MiniSearchEngine::cacheKey(const vector<QueryTerm>& queryTerms, int maxResults,
+                                  bool withSnippets) {
+    // Terms are sorted and counted, so reordered queries share an entry
+    string key;
+    for (const QueryTerm& term : queryTerms) {
+        key += term.text;
+        if (term.count > 1) key += ':' + to_string(term.count);
+        key += ' ';
+    }
+    key += '#' + to_string(maxResults) + (withSnippets ? "s" : "");
+    return key;
+}
+
+string MiniSearchEngine::cursorKey(const vector<QueryTerm>& queryTerms, size_t batchSize,
+                                   double score, int documentId) {
+    // The score's bits, as printing it could round two positions together
+    uint64_t bits;
+    memcpy(&bits, &score, sizeof(bits));
+    return cacheKey(queryTerms, static_cast<int>(batchSize), false) + '@' + to_string(bits) + ':' +
+           to_string(documentId);
+}
+
+void MiniSearchEngine::setScoring(const ScoringParams& params) {
+    // A new generation, so cached results of the previous model are not reused
+    lock_guard<mutex> lock(writeMutex);
+    scoring = params;
+    installSnapshot();
+}
+
+void MiniSearchEngine::setImpactOrdering(bool enabled) {
+    lock_guard<mutex> lock(writeMutex);
+    impactOrdered = enabled;
+}
+
+void MiniSearchEngine::setQueryCache(size_t capacity) {
+    shared_ptr<QueryCache> cache;
+    if (capacity > 0) cache.reset(new QueryCache(capacity));
+    atomic_store(&queryCache, cache);
+}
+
+QueryCacheStats MiniSearchEngine::queryCacheStats() const {
+    shared_ptr<QueryCache> cache = atomic_load(&queryCache);
+    return cache ? cache->stats() : QueryCacheStats{0, 0, 0, 0, 0};
+}
+
+vector<SearchResult> MiniSearchEngine::search(const string& query, int maxResults, bool withSnippets) {
+    // Phase one ranks on (docId, score) only; documents are touched just for
+    // the survivors in phase two
+    QueryMetrics metrics;
+    metrics.sampled = queryMetrics.sampleNext();
+    QueryTimer timer(metrics);
+    startRankCounters();
+    shared_ptr<const IndexSnapshot> index = snapshot();
+    vector<QueryTerm> queryTerms = resolveQuery(query);
+    timer.lap(QueryPhase::Tokenize);
+    return searchWith(*index, queryTerms, nullptr, query, maxResults, withSnippets, metrics, timer);
+}
+
+vector<SearchResult> MiniSearchEngine::searchWith(const IndexSnapshot& index,
+                                                  const vector<QueryTerm>& queryTerms,
+                                                  const QueryPlan* planned, const string& query,
+                                                  int maxResults, bool withSnippets,
+                                                  QueryMetrics& metrics, QueryTimer& timer) {
+    vector<SearchResult> results;
+    shared_ptr<QueryCache> cache = atomic_load(&queryCache);
+    string key;
+    if (cache) {
+        key = cacheKey(queryTerms, maxResults, withSnippets);
+        if (cache->find(key, index.generation, results)) {
+            timer.lap(QueryPhase::Lookup);
+            metrics.cacheHit = true;
+            metrics.results = results.size();
+            queryMetrics.record(query, metrics);
+            return results;
+        }
+    }
+
+    const QueryPlan* plan = planned ? planned : &rankScratch.plan;
+    vector<ScoredDocument> ranked;
+    if (maxResults > 0) {
+        if (!planned) planQuery(index, queryTerms, rankScratch.plan);
+        timer.lap(QueryPhase::Lookup);
+        ranked = rankPlan(index, *plan, static_cast<size_t>(maxResults), true, timer);
     }
+    results = buildResults(index, ranked, *plan, withSnippets);
+    timer.lap(QueryPhase::Snippets);
+    if (cache) cache->insert(key, index.generation, results);
 
+    takeRankCounters(metrics);
+    metrics.results = results.size();
+    queryMetrics.record(query, metrics);
     return results;
 }
 
+SearchPage MiniSearchEngine::searchAfter(const string& query, const SearchCursor& cursor,
+                                         int pageSize, bool withSnippets) {
+    SearchPage page;
+    page.next = cursor;
+    page.more = false;
+    if (pageSize <= 0) return page;
+    QueryMetrics metrics;
+    metrics.sampled = queryMetrics.sampleNext();
+    QueryTimer timer(metrics);
+    startRankCounters();
+    shared_ptr<const IndexSnapshot> index = snapshot();
+    vector<QueryTerm> queryTerms = resolveQuery(query);
+    timer.lap(QueryPhase::Tokenize);
+
+    // A batch holds one document past its pages, which tells whether the
+    // ranking goes on beyond them. A page holds no more than the index, and
+    // pages too large for kCursorBatchPages of them are ranked one at a time
+    size_t pageLength = min(static_cast<size_t>(pageSize),
+                            static_cast<size_t>(max(index->endDocId, 1)));
+    size_t batchSize = pageLength < kMaxCursorBatch / kCursorBatchPages
+                           ? pageLength * kCursorBatchPages
+                           : max(pageLength, static_cast<size_t>(kMaxCursorBatch));
+    ScoredDocument after{cursor.documentId, cursor.score};
+    vector<SearchResult> batch;
+    size_t first = 0;
+    bool cut = false;
+    // The cursor must not precede the batch it names, or a page could skip documents
+    ScoredDocument batchStart{cursor.batchDocumentId, cursor.batchScore};
+    bool inBatch = batchStart.documentId < 0 || !TopKHeap::ranksBefore(after, batchStart);
+    string key = cursorKey(queryTerms, batchSize, cursor.batchScore, cursor.batchDocumentId);
+    if (inBatch && cursorCache.find(key, index->generation, batch)) {
+        first = cursor.atStart() ? 0 : static_cast<size_t>(partition_point(
+            batch.begin(), batch.end(), [&after](const SearchResult& result) {
+                return !TopKHeap::ranksBefore(after, ScoredDocument{result.documentId,
+                                                                    result.score});
+            }) - batch.begin());
+        cut = batch.size() <= batchSize || first + pageLength < batch.size();
+    }
+    QueryPlan& plan = rankScratch.plan;
+    if (cut) {
+        metrics.cacheHit = true;
+        if (withSnippets) planQuery(*index, queryTerms, plan);
+        timer.lap(QueryPhase::Lookup);
+    } else {
+        planQuery(*index, queryTerms, plan);
+        plan.paged = !cursor.atStart();
+        plan.after = after;
+        timer.lap(QueryPhase::Lookup);
+        vector<ScoredDocument> ranked = rankPlan(*index, plan, batchSize + 1, true, timer);
+        batch = buildResults(*index, ranked, plan, false);
+        cursorCache.insert(cursorKey(queryTerms, batchSize, cursor.score, cursor.documentId),
+                           index->generation, batch);
+        page.next.batchScore = cursor.score;
+        page.next.batchDocumentId = cursor.documentId;
+        first = 0;
+    }
+
+    size_t last = min(batch.size(), first + pageLength);
+    vector<ScoredDocument> ranked;
+    for (size_t i = first; i < last; ++i) {
+        ranked.push_back(ScoredDocument{batch[i].documentId, batch[i].score});
+    }
+    page.results = buildResults(*index, ranked, plan, withSnippets);
+    page.more = last < batch.size();
+    if (!ranked.empty()) {
+        page.next.score = ranked.back().score;
+        page.next.documentId = ranked.back().documentId;
+    }
+    timer.lap(QueryPhase::Snippets);
+
+    takeRankCounters(metrics);
+    metrics.results = page.results.size();
+    queryMetrics.record(query, metrics);
+    return page;
+}
+
+vector<ScoredDocument> MiniSearchEngine::searchIds(const string& query, int maxResults) {
+    return rankQuery(query, maxResults, nullptr);
+}
+
+vector<ScoredDocument> MiniSearchEngine::searchIds(const string& query, int maxResults,
+                                                   const TermStatistics& global) {
+    return rankQuery(query, maxResults, &global);
+}
+
+vector<ScoredDocument> MiniSearchEngine::rankQuery(const string& query, int maxResults,
+                                                   const TermStatistics* global) {
+    if (maxResults <= 0) return vector<ScoredDocument>();
+    QueryMetrics metrics;
+    metrics.sampled = queryMetrics.sampleNext();
+    QueryTimer timer(metrics);
+    startRankCounters();
+    shared_ptr<const IndexSnapshot> index = snapshot();
+    vector<QueryTerm> queryTerms = resolveQuery(query);
+    timer.lap(QueryPhase::Tokenize);
+    vector<ScoredDocument> ranked = rankDocuments(*index, queryTerms,
+                                                  static_cast<size_t>(maxResults), timer, global);
+
+    takeRankCounters(metrics);
+    metrics.results = ranked.size();
+    queryMetrics.record(query, metrics);
+    return ranked;
+}
+
+TermStatistics MiniSearchEngine::termStatistics(const string& query) {
+    shared_ptr<const IndexSnapshot> index = snapshot();
+    vector<QueryTerm> queryTerms = resolveQuery(query);
+    planQuery(*index, queryTerms, rankScratch.plan);
+    TermStatistics statistics;
+    for (size_t t = 0; t < queryTerms.size(); ++t) {
+        statistics.terms.push_back(queryTerms[t].text);
+        statistics.documentFrequencies.push_back(rankScratch.documentFrequency[t]);
+    }
+    statistics.documentCount = index->postedDocumentCount();
+    statistics.titleTokens = index->titleTokens;
+    statistics.contentTokens = index->contentTokens;
+    return statistics;
+}
+
+vector<SearchResult> MiniSearchEngine::fetchResults(const string& query,
+                                                    const vector<ScoredDocument>& ranked,
+                                                    bool withSnippets) {
+    // Ids come from an earlier snapshot, so any later one still holds them
+    // unless openIndex() replaced the index in between
+    shared_ptr<const IndexSnapshot> index = snapshot();
+    vector<ScoredDocument> present;
+    for (const ScoredDocument& scored : ranked) {
+        if (scored.documentId >= 0 && scored.documentId < index->endDocId) present.push_back(scored);
+    }
+    QueryPlan& plan = rankScratch.plan;
+    if (withSnippets) planQuery(*index, resolveQuery(query), plan);
+    return buildResults(*index, present, plan, withSnippets);
+}
+
+vector<SearchResult> MiniSearchEngine::searchImpacts(const string& query, int maxResults,
+                                                     const ImpactSearchOptions& options) {
+    QueryMetrics metrics;
+    metrics.sampled = queryMetrics.sampleNext();
+    QueryTimer timer(metrics);
+    startRankCounters();
+    shared_ptr<const IndexSnapshot> index = snapshot();
+    vector<QueryTerm> queryTerms = resolveQuery(query);
+    timer.lap(QueryPhase::Tokenize);
+
+    // Impacts are BM25 under any scoring model, so the weights are BM25's idf
+    QueryPlan& plan = rankScratch.plan;
+    planQuery(*index, queryTerms, plan);
+    const vector<size_t>& documentFrequency = rankScratch.documentFrequency;
+    for (size_t t = 0; t < plan.termCount; ++t) {
+        if (documentFrequency[t] == 0) continue;
+        plan.weights[t] = queryTerms[t].count *
+            ImpactScorer::idf(documentFrequency[t], plan.stats.documentCount);
+    }
+    timer.lap(QueryPhase::Lookup);
+
+    vector<ScoredDocument> ranked;
+    if (maxResults > 0) {
+        // In doc-id order, like rankPlan, so ties keep going to the lower docId
+        size_t k = index->resultLimit(static_cast<size_t>(maxResults));
+        TopKHeap& heap = rankScratch.heap;
+        heap.reset(k);
+        for (size_t s = 0; s < index->segments.size(); ++s) {
+            rankImpacts(*index->segments[s], index->deletions[s].get(), plan, s, k,
+                        options.postingFraction, heap);
+        }
+        timer.lap(QueryPhase::Rank);
+        ranked = heap.sortedResults();
+        timer.lap(QueryPhase::Sort);
+    }
+    vector<SearchResult> results = buildResults(*index, ranked, plan, options.withSnippets);
+    timer.lap(QueryPhase::Snippets);
+
+    takeRankCounters(metrics);
+    metrics.results = results.size();
+    queryMetrics.record(query, metrics);
+    return results;
+}
+
+void MiniSearchEngine::setAsyncThreads(unsigned threadCount) {
+    lock_guard<mutex> lock(asyncMutex);
+    asyncThreads = threadCount;
+}
+
+shared_ptr<ThreadPool> MiniSearchEngine::startAsync() {
+    lock_guard<mutex> lock(asyncMutex);
+    if (!asyncPool) {
+        asyncPool.reset(new ThreadPool(asyncThreads));
+        pagerThread = thread(&MiniSearchEngine::pagerLoop, this);
+    }
+    return asyncPool;
+}
+
+void MiniSearchEngine::searchAsync(const string& query, int maxResults, bool withSnippets,
+                                   SearchCallback done) {
+    shared_ptr<AsyncQuery> pending(new AsyncQuery());
+    pending->query = query;
+    pending->maxResults = maxResults;
+    pending->withSnippets = withSnippets;
+    pending->done = move(done);
+    asyncQueries++;
+    startAsync()->submit([this, pending]() { prefetchQuery(pending); });
+}
+
+future<vector<SearchResult>> MiniSearchEngine::searchAsync(const string& query, int maxResults,
+                                                          bool withSnippets) {
+    shared_ptr<promise<vector<SearchResult>>> result(new promise<vector<SearchResult>>());
+    future<vector<SearchResult>> pending = result->get_future();
+    searchAsync(query, maxResults, withSnippets,
+                [result](vector<SearchResult> results) { result->set_value(move(results)); });
+    return pending;
+}
+
+void MiniSearchEngine::prefetchQuery(const shared_ptr<AsyncQuery>& query) {
+    // Only postings are read ahead; the dictionary lookups of the plan and
+    // the stored fields of the results may still fault
+    query->index = snapshot();
+    query->terms = resolveQuery(query->query);
+    if (query->maxResults > 0) {
+        const IndexSnapshot& index = *query->index;
+        const QueryPlan& plan = query->plan;
+        planQuery(index, query->terms, query->plan);
+        for (size_t s = 0; s < index.segments.size(); ++s) {
+            for (size_t t = 0; t < plan.termCount; ++t) {
+                int termId = plan.termIds[s * plan.termCount + t];
+                if (termId >= 0) index.segments[s]->termPages(termId, query->pages);
+            }
+        }
+    }
+    // Read-ahead is only requested for queries that would fault
+    if (!query->pages.empty() && !query->pages.resident()) {
+        query->pages.willNeed();
+        asyncPages += query->pages.pageCount();
+        asyncWaited++;
+        query->deadline = chrono::steady_clock::now() +
+                          chrono::milliseconds(static_cast<int>(kPrefetchWaitMillis));
+        lock_guard<mutex> lock(asyncMutex);
+        if (!asyncStopping) {
+            parkedQueries.push_back(query);
+            asyncWakeup.notify_one();
+            return;
+        }
+    }
+    runAsync(*query);
+}
+
+void MiniSearchEngine::runAsync(AsyncQuery& query) {
+    // The snapshot, terms and plan of the read-ahead, so nothing is looked up twice
+    QueryMetrics metrics;
+    metrics.sampled = queryMetrics.sampleNext();
+    QueryTimer timer(metrics);
+    startRankCounters();
+    timer.lap(QueryPhase::Tokenize);
+    const QueryPlan* planned = query.maxResults > 0 ? &query.plan : nullptr;
+    vector<SearchResult> results = searchWith(*query.index, query.terms, planned, query.query,
+                                              query.maxResults, query.withSnippets, metrics,
+                                              timer);
+    query.index.reset();
+    query.done(move(results));
+}
+
+void MiniSearchEngine::pagerLoop() {
+    // Sleeps until a query parks; mincore is polled only while some wait
+    vector<shared_ptr<AsyncQuery>> waiting;
+    unique_lock<mutex> lock(asyncMutex);
+    while (true) {
+        if (waiting.empty()) {
+            asyncWakeup.wait(lock, [this]() { return asyncStopping || !parkedQueries.empty(); });
+        } else {
+            asyncWakeup.wait_for(lock, chrono::microseconds(static_cast<int>(kPagerPollMicros)));
+        }
+        waiting.insert(waiting.end(), parkedQueries.begin(), parkedQueries.end());
+        parkedQueries.clear();
+        bool stop = asyncStopping;
+        shared_ptr<ThreadPool> pool = asyncPool;
+        lock.unlock();
+
+        // Residency is checked without the lock, which parking threads need
+        auto now = chrono::steady_clock::now();
+        size_t kept = 0;
+        for (shared_ptr<AsyncQuery>& query : waiting) {
+            bool runnable = stop || query->pages.resident();
+            if (!runnable && now >= query->deadline) {
+                asyncTimedOut++;
+                runnable = true;
+            }
+            if (runnable) {
+                shared_ptr<AsyncQuery> ready = move(query);
+                pool->submit([this, ready]() { runAsync(*ready); });
+            } else {
+                waiting[kept++] = move(query);
+            }
+        }
+        waiting.resize(kept);
+        if (stop) return;
+        lock.lock();
+    }
+}
+
+AsyncSearchStats MiniSearchEngine::asyncSearchStats() const {
+    AsyncSearchStats stats;
+    stats.queries = asyncQueries;
+    stats.waited = asyncWaited;
+    stats.timedOut = asyncTimedOut;
+    stats.pagesRequested = asyncPages;
+    return stats;
+}
+
+shared_ptr<ThreadPool> MiniSearchEngine::batchPoolFor(unsigned threadCount) {
+    // A batch still running on a pool this replaces keeps it alive
+    lock_guard<mutex> lock(batchMutex);
+    if (!batchPool || batchPool->size() != threadCount) batchPool.reset(new ThreadPool(threadCount));
+    return batchPool;
+}
+
+vector<vector<SearchResult>> MiniSearchEngine::searchBatch(const vector<string>& queries,
+                                                          int maxResults, bool withSnippets,
+                                                          unsigned threadCount) {
+    shared_ptr<const IndexSnapshot> index = snapshot();
+    const vector<shared_ptr<const Segment>>& parts = index->segments;
+    vector<vector<SearchResult>> results(queries.size());
+    if (queries.empty() || maxResults <= 0) return results;
+
+    shared_ptr<ThreadPool> pool = (threadCount == 0) ? atomic_load(&searchPool) : nullptr;
+    if (!pool) {
+        if (threadCount == 0) threadCount = thread::hardware_concurrency();
+        if (threadCount > 1) pool = batchPoolFor(threadCount);
+    }
+    size_t tasks = (queries.size() + kBatchQueriesPerTask - 1) / kBatchQueriesPerTask;
+    auto runTasks = [&](const function<void(size_t, size_t)>& body) {
+        auto chunk = [&](size_t task) {
+            size_t first = task * kBatchQueriesPerTask;
+            body(first, min(queries.size(), first + kBatchQueriesPerTask));
+        };
+        if (pool) {
+            pool->parallelFor(tasks, chunk);
+        } else {
+            for (size_t task = 0; task < tasks; ++task) chunk(task);
+        }
+    };
+
+    vector<vector<QueryTerm>> queryTerms(queries.size());
+    runTasks([&](size_t first, size_t last) {
+        for (size_t q = first; q < last; ++q) queryTerms[q] = resolveQuery(queries[q]);
+    });
+
+    // Each distinct term of the batch is looked up in every segment once;
+    // queries then only gather ids and weights from these tables
+    unordered_map<string, size_t> termSlots;
+    vector<const string*> slotTexts;
+    vector<vector<size_t>> querySlots(queries.size());
+    for (size_t q = 0; q < queries.size(); ++q) {
+        for (const QueryTerm& term : queryTerms[q]) {
+            auto inserted = termSlots.emplace(term.text, slotTexts.size());
+            if (inserted.second) slotTexts.push_back(&inserted.first->first);
+            querySlots[q].push_back(inserted.first->second);
+        }
+    }
+    size_t slotCount = slotTexts.size();
+    vector<int> slotTermIds(parts.size() * slotCount, -1);
+    vector<double> slotIDF(slotCount, 0.0);
+    vector<size_t> slotFrequency(slotCount, 0);
+    for (size_t s = 0; s < parts.size(); ++s) {
+        for (size_t slot = 0; slot < slotCount; ++slot) {
+            int termId = parts[s]->findTermId(*slotTexts[slot]);
+            slotTermIds[s * slotCount + slot] = termId;
+            if (termId >= 0) slotFrequency[slot] += parts[s]->postingList(termId).size();
+        }
+    }
+    for (size_t slot = 0; slot < slotCount; ++slot) {
+        if (slotFrequency[slot] > 0) {
+            slotIDF[slot] = scoringIDF(index->scoring.model, slotFrequency[slot],
+                                       index->postedDocumentCount());
+        }
+    }
+
+    // The batch is already spread over the pool, so each query runs on one thread
+    runTasks([&](size_t first, size_t last) {
+        QueryPlan& plan = rankScratch.batchPlan;
+        plan.scoring = index->scoring;
+        plan.stats = index->collectionStats();
+        for (size_t q = first; q < last; ++q) {
+            const vector<size_t>& slots = querySlots[q];
+            size_t termCount = slots.size();
+            plan.termCount = termCount;
+            plan.termIds.resize(parts.size() * termCount);
+            plan.weights.resize(termCount);
+            plan.postingTotal = 0;
+            for (size_t t = 0; t < termCount; ++t) {
+                plan.postingTotal += slotFrequency[slots[t]];
+                plan.weights[t] = queryTerms[q][t].count * slotIDF[slots[t]];
+                for (size_t s = 0; s < parts.size(); ++s) {
+                    plan.termIds[s * termCount + t] = slotTermIds[s * slotCount + slots[t]];
+                }
+            }
+            // Tokenizing and lookups are shared by the batch, so only the
+            // later phases are timed per query
+            QueryMetrics metrics;
+            metrics.sampled = queryMetrics.sampleNext();
+            QueryTimer timer(metrics);
+            startRankCounters();
+            vector<ScoredDocument> ranked = rankPlan(*index, plan,
+                                                     static_cast<size_t>(maxResults), false, timer);
+            results[q] = buildResults(*index, ranked, plan, withSnippets);
+            timer.lap(QueryPhase::Snippets);
+
+            takeRankCounters(metrics);
+            metrics.results = results[q].size();
+            queryMetrics.record(queries[q], metrics);
+        }
+    });
+    return results;
+}
+
+vector<SearchResult> MiniSearchEngine::searchBoolean(const string& query, int maxResults,
+                                                    bool withSnippets) {
+    QueryMetrics metrics;
+    metrics.sampled = queryMetrics.sampleNext();
+    QueryTimer timer(metrics);
+    startRankCounters();
+    shared_ptr<const IndexSnapshot> index = snapshot();
+    BooleanQueryParser parser(analyzer);
+    QueryNode root = parser.parse(query);
+    expandPrefixes(*index, root);
+
+    // Excluded terms only filter; the others score and pick snippets
+    vector<string> texts;
+    BooleanQueryParser::scoringTerms(root, texts);
+    vector<QueryTerm> queryTerms = countTerms(texts);
+    timer.lap(QueryPhase::Tokenize);
+
+    vector<SearchResult> results;
+    if (maxResults > 0 && !root.blank()) {
+        QueryPlan& plan = rankScratch.plan;
+        planQuery(*index, queryTerms, plan);
+
+        // Every term of the tree gets a table entry. Scoring terms reuse the
+        // ids the plan resolved, so only excluded ones are looked up here
+        vector<string> table;
+        BooleanQueryParser::indexTerms(root, table);
+        const vector<shared_ptr<const Segment>>& parts = index->segments;
+        vector<int> tableIds(parts.size() * table.size());
+        for (size_t entry = 0, t = 0; entry < table.size(); ++entry) {
+            while (t < queryTerms.size() && queryTerms[t].text < table[entry]) t++;
+            bool scoring = t < queryTerms.size() && queryTerms[t].text == table[entry];
+            for (size_t s = 0; s < parts.size(); ++s) {
+                tableIds[s * table.size() + entry] = scoring ? plan.termIds[s * plan.termCount + t]
+                                                             : parts[s]->findTermId(table[entry]);
+            }
+        }
+        timer.lap(QueryPhase::Lookup);
+
+        TopKHeap& heap = rankScratch.heap;
+        heap.reset(index->resultLimit(static_cast<size_t>(maxResults)));
+        bool conjunction = isTermConjunction(root);
+        for (size_t s = 0; s < parts.size(); ++s) {
+            rankBoolean(*parts[s], index->deletions[s].get(), plan, s, root,
+                        tableIds.data() + s * table.size(), conjunction, heap);
+        }
+        timer.lap(QueryPhase::Rank);
+        vector<ScoredDocument> ranked = heap.sortedResults();
+        timer.lap(QueryPhase::Sort);
+        results = buildResults(*index, ranked, plan, withSnippets);
+        timer.lap(QueryPhase::Snippets);
+    }
+
+    takeRankCounters(metrics);
+    metrics.results = results.size();
+    queryMetrics.record(query, metrics);
+    return results;
+}
+
+vector<TermSuggestion> MiniSearchEngine::completeTerm(const IndexSnapshot& index,
+                                                      const string& prefix, size_t maxTerms) {
+    // Segments number their terms independently, so frequencies are summed by text
+    unordered_map<string, size_t> frequencies;
+    vector<int> termIds;
+    for (const shared_ptr<const Segment>& segment : index.segments) {
+        termIds.clear();
+        segment->termsWithPrefix(prefix, termIds);
+        for (int termId : termIds) {
+            frequencies[segment->term(termId)] += segment->postingList(termId).size();
+        }
+    }
+
+    vector<TermSuggestion> completions;
+    completions.reserve(frequencies.size());
+    for (const pair<const string, size_t>& entry : frequencies) {
+        completions.push_back(TermSuggestion{entry.first, entry.second});
+    }
+    size_t kept = min(maxTerms, completions.size());
+    partial_sort(completions.begin(), completions.begin() + static_cast<ptrdiff_t>(kept),
+                 completions.end(), [](const TermSuggestion& a, const TermSuggestion& b) {
+        if (a.documentFrequency != b.documentFrequency) return a.documentFrequency > b.documentFrequency;
+        return a.term < b.term;
+    });
+    completions.resize(kept);
+    return completions;
+}
+
+void MiniSearchEngine::expandPrefixes(const IndexSnapshot& index, QueryNode& node) {
+    if (node.type != QueryNodeType::Prefix) {
+        for (QueryNode& child : node.children) expandPrefixes(index, child);
+        return;
+    }
+
+    // Left unexpanded, a prefix without completions matches nothing
+    vector<TermSuggestion> completions = completeTerm(index, node.terms[0], kMaxPrefixTerms);
+    if (completions.empty()) return;
+    QueryNode expanded;
+    expanded.type = QueryNodeType::Or;
+    for (TermSuggestion& completion : completions) {
+        QueryNode term;
+        term.type = QueryNodeType::Term;
+        term.terms.push_back(move(completion.term));
+        expanded.children.push_back(move(term));
+    }
+    node = (expanded.children.size() == 1) ? expanded.children[0] : expanded;
+}
+
+vector<TermSuggestion> MiniSearchEngine::prefixSearch(const string& prefix, size_t maxTerms) {
+    string text = prefix;
+    if (!text.empty() && text.back() == '*') text.pop_back();
+    string normalized;
+    if (maxTerms == 0 || !BooleanQueryParser::normalizePrefix(text, normalized)) {
+        return vector<TermSuggestion>();
+    }
+    shared_ptr<const IndexSnapshot> index = snapshot();
+    return completeTerm(*index, normalized, maxTerms);
+}
+
 void MiniSearchEngine::printResults(const vector<SearchResult>& results, const string& query) {
     cout << "\n=== Results for: \"" << query << "\" ===" << endl;
     cout << "Found " << results.size() << " results\n" << endl;
@@ -132,29 +1910,194 @@ void MiniSearchEngine::printResults(const vector<SearchResult>& results, const s
     }
 }
 
-void MiniSearchEngine::loadFromFile(const string& filename) {
-    ifstream file(filename);
-    string line;
+LoadStats MiniSearchEngine::loadFromFile(const string& filename, size_t batchSize) {
+    auto started = chrono::steady_clock::now();
+    lock_guard<mutex> lock(writeMutex);
+    DocumentReader reader(filename);
+    DocumentFields fields;
+    vector<DocumentView> batch;
+
+    // Fields are copied once, from the read buffer into the document store
+    while (reader.next(fields)) {
+        batch.push_back(store->document(store->add(fields.title, fields.content, fields.url)));
+        if (batch.size() >= batchSize) {
+            indexDocuments(batch, 0);
+            publish();
+            batch.clear();
+        }
+    }
+    if (!batch.empty()) {
+        indexDocuments(batch, 0);
+        publish();
+    }
+
+    LoadStats stats = reader.loadStats();
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    return stats;
+}
+
+bool MiniSearchEngine::saveIndex(const string& path) {
+    refresh();
+    shared_ptr<const IndexSnapshot> index = snapshot();
+
+    // Removed documents keep their ids but no stored fields
+    vector<DocumentView> views;
+    views.reserve(static_cast<size_t>(index->endDocId));
+    for (int docId = 0; docId < index->endDocId; ++docId) {
+        views.push_back(index->isDeleted(docId) ? DocumentView{docId, StringRef(), StringRef(), StringRef()}
+                                                : index->document(docId));
+    }
+    if (index->segments.size() == 1 && !index->deletions[0]) {
+        return IndexFile::write(path, *index->segments[0], views, nullptr, analyzer.fingerprint());
+    }
+
+    // Fold every segment into one so the file has a single dictionary and
+    // no postings of removed documents
+    bool withImpacts;
+    {
+        lock_guard<mutex> lock(writeMutex);
+        withImpacts = impactOrdered;
+    }
+    IndexSegment merged(codec, 0);
+    DeletionBitmap deleted(static_cast<size_t>(index->endDocId));
+    vector<const Segment*> inputs;
+    vector<const DeletionBitmap*> inputDeleted;
+    for (size_t s = 0; s < index->segments.size(); ++s) {
+        const Segment& segment = *index->segments[s];
+        const DeletionBitmap* segmentDeleted = index->deletions[s].get();
+        inputs.push_back(&segment);
+        inputDeleted.push_back(segmentDeleted);
+        if (segmentDeleted) deleted.insertAll(*segmentDeleted, static_cast<size_t>(segment.baseDocId()));
+    }
+    merged.merge(inputs, inputDeleted, withImpacts);
+    return IndexFile::write(path, merged, views, &deleted, analyzer.fingerprint());
+}
+
+bool MiniSearchEngine::openIndex(const string& path) {
+    shared_ptr<const IndexFile> file(IndexFile::open(path));
+    if (!file || file->baseDocId() != 0) return false;
+    // Its terms would not match what this engine makes of queries
+    if (file->analyzerFingerprint() != analyzer.fingerprint()) return false;
 
-    while (getline(file, line)) {
-        size_t pos1 = line.find('|');
-        if (pos1 == string::npos) continue;
+    // Snapshots already handed out keep the previous index alive
+    lock_guard<mutex> lock(writeMutex);
+    codec = file->postingCodec();
+    baseIndex = file;
+    store.reset(new DocumentStore(file->endDocId()));
+    pending.reset(new IndexSegment(codec, file->endDocId(), analyzer));
+    DeletionBitmap fileDeletions = file->deletions();
+    shared_ptr<DeletionBitmap> deleted;
+    if (fileDeletions.count() > 0) deleted.reset(new DeletionBitmap(fileDeletions));
+    // Postings of documents deleted before the file was written are already gone
+    sealed.assign(1, SealedSegment{file, deleted, false, fileDeletions.count()});
+    publish();
+    return true;
+}
+
+void MiniSearchEngine::setQueryMetricsSampling(uint32_t sampleEvery) {
+    queryMetrics.setSampling(sampleEvery);
+}
 
-        size_t pos2 = line.find('|', pos1 + 1);
-        string title = line.substr(0, pos1);
-        string content = (pos2 != string::npos) ?
-                        line.substr(pos1 + 1, pos2 - pos1 - 1) :
-                        line.substr(pos1 + 1);
-        string url = (pos2 != string::npos) ? line.substr(pos2 + 1) : "";
+void MiniSearchEngine::setQueryObserver(QueryObserver observer) {
+    queryMetrics.setObserver(move(observer));
+}
+
+SearchMetrics MiniSearchEngine::searchMetrics() const {
+    return queryMetrics.snapshot();
+}
 
-        addDocument(title, content, url);
+IndexMemoryStats MiniSearchEngine::memoryStats() {
+    // Read from the published snapshot alone, so a scrape neither waits for
+    // a writer nor publishes a segment of its own
+    shared_ptr<const IndexSnapshot> index = snapshot();
+    IndexMemoryStats memory = IndexMemoryStats();
+    for (size_t s = 0; s < index->segments.size(); ++s) {
+        const Segment& segment = *index->segments[s];
+        memory.dictionaryBytes += segment.dictionaryBytes();
+        memory.postingBytes += segment.postingBytes();
+        memory.bitmapBytes += segment.bitmapBytes();
+        memory.impactBytes += segment.impactBytes();
+        memory.positionBytes += segment.positionBytes();
+        memory.lengthBytes += segment.documentCount() * (sizeof(DocumentLength) + sizeof(uint8_t));
+        if (index->deletions[s]) {
+            memory.deletionBytes += index->deletions[s]->wordCount() * sizeof(uint64_t);
+        }
+    }
+    memory.documentBytes = index->storeBytes;
+    if (index->file) {
+        memory.documentBytes += index->file->documentBytes();
+        memory.mappedBytes = index->file->fileBytes();
     }
-    file.close();
+    return memory;
 }
 
 void MiniSearchEngine::printStats() {
+    refresh();
+    shared_ptr<const IndexSnapshot> index = snapshot();
+    const vector<shared_ptr<const Segment>>& parts = index->segments;
+
+    size_t termTotal = parts.empty() ? 0 : parts[0]->termCount();
+    size_t postingTotal = 0;
+    size_t postingBytes = 0;
+    size_t positionBytes = 0;
+    uint64_t titleTokens = 0;
+    uint64_t contentTokens = 0;
+    for (size_t s = 0; s < parts.size(); ++s) {
+        const Segment& segment = *parts[s];
+        postingTotal += segment.postingCount();
+        postingBytes += segment.postingBytes();
+        positionBytes += segment.positionBytes();
+
+        // Removed documents may still have lengths until their segment is rewritten
+        const DocumentLength* lengths = segment.documentLengths();
+        const DeletionBitmap* deleted = index->deletions[s].get();
+        for (size_t doc = 0; doc < segment.documentCount(); ++doc) {
+            if (deleted && deleted->contains(doc)) continue;
+            titleTokens += lengths[doc].title;
+            contentTokens += lengths[doc].content;
+        }
+    }
+    size_t liveDocuments = max<size_t>(index->documentCount(), 1);
+    if (parts.size() > 1) {
+        // Segments share vocabulary, so count distinct terms
+        unordered_set<string> distinct;
+        for (const shared_ptr<const Segment>& segment : parts) {
+            for (size_t termId = 0; termId < segment->termCount(); ++termId) {
+                distinct.insert(segment->term(static_cast<int>(termId)));
+            }
+        }
+        termTotal = distinct.size();
+    }
+
+    lock_guard<mutex> lock(writeMutex);
     cout << "\n=== Search Engine Statistics ===" << endl;
-    cout << "Indexed documents: " << documents.size() << endl;
-    cout << "Unique terms: " << invertedIndex.size() << endl;
+    cout << "Indexed documents: " << index->documentCount() << " (" << index->deletedCount
+         << " removed)" << endl;
+    cout << "Segments: " << parts.size() << endl;
+    cout << "Merges: " << mergeTotals.merges << " (" << mergeTotals.segmentsMerged << " segments, "
+         << mergeTotals.documentsMerged << " documents, " << mergeTotals.bytesMerged << " bytes, "
+         << fixed << setprecision(3) << mergeTotals.seconds << "s), write amplification "
+         << setprecision(2) << mergeTotals.writeAmplification() << endl;
+    cout << "Scoring: " << scoringModelName(index->scoring.model) << endl;
+    cout << "Unique terms: " << termTotal << endl;
+    cout << "Postings: " << postingTotal << " (" << postingBytes << " bytes, "
+         << postingCodecName(codec) << ")" << endl;
+    cout << "Positions: " << positionBytes << " bytes" << endl;
+    cout << "Average length: " << setprecision(1)
+         << static_cast<double>(titleTokens) / liveDocuments << " title, "
+         << static_cast<double>(contentTokens) / liveDocuments << " content tokens" << endl;
+    cout << "Documents: " << store->memoryBytes() << " bytes, " << store->blockCount()
+         << " arena blocks (" << store->internedBytes() << " bytes interned)" << endl;
+    if (baseIndex) {
+        cout << "Mapped index: " << baseIndex->fileBytes() << " bytes" << endl;
+    }
+    shared_ptr<QueryCache> cache = atomic_load(&queryCache);
+    if (cache) {
+        QueryCacheStats cached = cache->stats();
+        cout << "Query cache: " << cached.entries << " entries, " << cached.hits << " hits, "
+             << cached.misses << " misses (" << setprecision(1) << cached.hitRate() * 100.0
+             << "%), " << cached.evictions << " evicted, " << cached.invalidations
+             << " invalidated" << endl;
+    }
     cout << "================================" << endl;
 }
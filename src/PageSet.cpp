@@ -0,0 +1,62 @@
+#include "../include/PageSet.h"
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+size_t PageSet::pageSize() {
+#if !defined(_WIN32)
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+#else
+    return 4096;
+#endif
+}
+
+void PageSet::add(const void* data, size_t bytes) {
+    if (!data || bytes == 0) return;
+    uintptr_t mask = pageSize() - 1;
+    uintptr_t begin = reinterpret_cast<uintptr_t>(data) & ~mask;
+    uintptr_t end = (reinterpret_cast<uintptr_t>(data) + bytes + mask) & ~mask;
+    // Lists of one term are laid out in order, so ranges often touch
+    if (!ranges.empty() && begin <= ranges.back() && begin >= ranges[ranges.size() - 2]) {
+        if (end > ranges.back()) {
+            pages += (end - ranges.back()) / pageSize();
+            ranges.back() = end;
+        }
+        return;
+    }
+    ranges.push_back(begin);
+    ranges.push_back(end);
+    pages += (end - begin) / pageSize();
+}
+
+void PageSet::clear() {
+    ranges.clear();
+    pages = 0;
+}
+
+void PageSet::willNeed() const {
+#if !defined(_WIN32)
+    for (size_t i = 0; i < ranges.size(); i += 2) {
+        posix_madvise(reinterpret_cast<void*>(ranges[i]), ranges[i + 1] - ranges[i],
+                      POSIX_MADV_WILLNEED);
+    }
+#endif
+}
+
+bool PageSet::resident() const {
+#if defined(__linux__)
+    vector<unsigned char> states;
+    for (size_t i = 0; i < ranges.size(); i += 2) {
+        size_t bytes = ranges[i + 1] - ranges[i];
+        states.resize(bytes / pageSize());
+        if (mincore(reinterpret_cast<void*>(ranges[i]), bytes, states.data()) != 0) continue;
+        for (unsigned char state : states) {
+            if (!(state & 1)) return false;
+        }
+    }
+#endif
+    return true;
+}
@@ -0,0 +1,228 @@
+#include "../include/PorterStemmer.h"
+#include <cstring>
+
+/**
+ * StemState: The word being stemmed. b[0..k] is the current word and, after
+ * a successful ends(), b[0..j] is the part before the matched suffix.
+ */
+struct StemState {
+    char* b;
+    int k;
+    int j;
+
+    // True if b[i] is a consonant; y is one unless it follows a consonant
+    bool cons(int i) const {
+        switch (b[i]) {
+            case 'a': case 'e': case 'i': case 'o': case 'u': return false;
+            case 'y': return i == 0 ? true : !cons(i - 1);
+            default: return true;
+        }
+    }
+
+    // Number of vowel-consonant sequences in b[0..j]: [C](VC)^m[V]
+    int measure() const {
+        int n = 0;
+        int i = 0;
+        for (;;) {
+            if (i > j) return n;
+            if (!cons(i)) break;
+            i++;
+        }
+        i++;
+        for (;;) {
+            for (;;) {
+                if (i > j) return n;
+                if (cons(i)) break;
+                i++;
+            }
+            i++;
+            n++;
+            for (;;) {
+                if (i > j) return n;
+                if (!cons(i)) break;
+                i++;
+            }
+            i++;
+        }
+    }
+
+    bool vowelInStem() const {
+        for (int i = 0; i <= j; ++i) {
+            if (!cons(i)) return true;
+        }
+        return false;
+    }
+
+    bool doubleConsonant(int i) const {
+        return i >= 1 && b[i] == b[i - 1] && cons(i);
+    }
+
+    // Consonant-vowel-consonant ending at i, the last not w, x or y, as in
+    // hop but not snow; such stems get their e back (hope)
+    bool cvc(int i) const {
+        if (i < 2 || !cons(i) || cons(i - 1) || !cons(i - 2)) return false;
+        return b[i] != 'w' && b[i] != 'x' && b[i] != 'y';
+    }
+
+    bool ends(const char* suffix) {
+        int length = static_cast<int>(strlen(suffix));
+        if (b[k] != suffix[length - 1] || length > k + 1) return false;
+        if (memcmp(b + k - length + 1, suffix, static_cast<size_t>(length)) != 0) return false;
+        j = k - length;
+        return true;
+    }
+
+    // Replaces b[j+1..k] with text, which is never longer
+    void setTo(const char* text) {
+        int length = static_cast<int>(strlen(text));
+        memmove(b + j + 1, text, static_cast<size_t>(length));
+        k = j + length;
+    }
+
+    void replaceIfMeasured(const char* text) {
+        if (measure() > 0) setTo(text);
+    }
+
+    // Plurals and -ed or -ing
+    void step1ab() {
+        if (b[k] == 's') {
+            if (ends("sses")) k -= 2;
+            else if (ends("ies")) setTo("i");
+            else if (b[k - 1] != 's') k--;
+        }
+        if (ends("eed")) {
+            if (measure() > 0) k--;
+        } else if ((ends("ed") || ends("ing")) && vowelInStem()) {
+            k = j;
+            if (ends("at")) setTo("ate");
+            else if (ends("bl")) setTo("ble");
+            else if (ends("iz")) setTo("ize");
+            else if (doubleConsonant(k)) {
+                k--;
+                if (b[k] == 'l' || b[k] == 's' || b[k] == 'z') k++;
+            } else if (measure() == 1 && cvc(k)) {
+                setTo("e");
+            }
+        }
+    }
+
+    // Terminal y to i when there is another vowel in the stem
+    void step1c() {
+        if (ends("y") && vowelInStem()) b[k] = 'i';
+    }
+
+    // Double suffixes to single ones: -ization to -ize
+    void step2() {
+        switch (b[k - 1]) {
+            case 'a':
+                if (ends("ational")) { replaceIfMeasured("ate"); break; }
+                if (ends("tional")) { replaceIfMeasured("tion"); break; }
+                break;
+            case 'c':
+                if (ends("enci")) { replaceIfMeasured("ence"); break; }
+                if (ends("anci")) { replaceIfMeasured("ance"); break; }
+                break;
+            case 'e':
+                if (ends("izer")) { replaceIfMeasured("ize"); break; }
+                break;
+            case 'l':
+                if (ends("bli")) { replaceIfMeasured("ble"); break; }
+                if (ends("alli")) { replaceIfMeasured("al"); break; }
+                if (ends("entli")) { replaceIfMeasured("ent"); break; }
+                if (ends("eli")) { replaceIfMeasured("e"); break; }
+                if (ends("ousli")) { replaceIfMeasured("ous"); break; }
+                break;
+            case 'o':
+                if (ends("ization")) { replaceIfMeasured("ize"); break; }
+                if (ends("ation")) { replaceIfMeasured("ate"); break; }
+                if (ends("ator")) { replaceIfMeasured("ate"); break; }
+                break;
+            case 's':
+                if (ends("alism")) { replaceIfMeasured("al"); break; }
+                if (ends("iveness")) { replaceIfMeasured("ive"); break; }
+                if (ends("fulness")) { replaceIfMeasured("ful"); break; }
+                if (ends("ousness")) { replaceIfMeasured("ous"); break; }
+                break;
+            case 't':
+                if (ends("aliti")) { replaceIfMeasured("al"); break; }
+                if (ends("iviti")) { replaceIfMeasured("ive"); break; }
+                if (ends("biliti")) { replaceIfMeasured("ble"); break; }
+                break;
+            case 'g':
+                if (ends("logi")) { replaceIfMeasured("log"); break; }
+                break;
+        }
+    }
+
+    // -ic-, -full, -ness and the like
+    void step3() {
+        switch (b[k]) {
+            case 'e':
+                if (ends("icate")) { replaceIfMeasured("ic"); break; }
+                if (ends("ative")) { replaceIfMeasured(""); break; }
+                if (ends("alize")) { replaceIfMeasured("al"); break; }
+                break;
+            case 'i':
+                if (ends("iciti")) { replaceIfMeasured("ic"); break; }
+                break;
+            case 'l':
+                if (ends("ical")) { replaceIfMeasured("ic"); break; }
+                if (ends("ful")) { replaceIfMeasured(""); break; }
+                break;
+            case 's':
+                if (ends("ness")) { replaceIfMeasured(""); break; }
+                break;
+        }
+    }
+
+    // -ant, -ence and other suffixes of stems with measure above one
+    void step4() {
+        switch (b[k - 1]) {
+            case 'a': if (ends("al")) break; return;
+            case 'c': if (ends("ance") || ends("ence")) break; return;
+            case 'e': if (ends("er")) break; return;
+            case 'i': if (ends("ic")) break; return;
+            case 'l': if (ends("able") || ends("ible")) break; return;
+            case 'n': if (ends("ant") || ends("ement") || ends("ment") || ends("ent")) break; return;
+            case 'o':
+                if (ends("ion") && j >= 0 && (b[j] == 's' || b[j] == 't')) break;
+                if (ends("ou")) break;
+                return;
+            case 's': if (ends("ism")) break; return;
+            case 't': if (ends("ate") || ends("iti")) break; return;
+            case 'u': if (ends("ous")) break; return;
+            case 'v': if (ends("ive")) break; return;
+            case 'z': if (ends("ize")) break; return;
+            default: return;
+        }
+        if (measure() > 1) k = j;
+    }
+
+    // A final -e, and -ll to -l, where the stem is long enough
+    void step5() {
+        j = k;
+        if (b[k] == 'e') {
+            int m = measure();
+            if (m > 1 || (m == 1 && !cvc(k - 1))) k--;
+        }
+        if (b[k] == 'l' && doubleConsonant(k) && measure() > 1) k--;
+    }
+};
+
+size_t PorterStemmer::stem(char* word, size_t length) {
+    // Words of one or two letters are left alone
+    if (length <= 2) return length;
+    StemState state;
+    state.b = word;
+    state.k = static_cast<int>(length) - 1;
+    state.j = 0;
+    state.step1ab();
+    if (state.k > 0) {
+        state.step1c();
+        state.step2();
+        state.step3();
+        state.step4();
+        state.step5();
+    }
+    return static_cast<size_t>(state.k + 1);
+}
@@ -0,0 +1,116 @@
+#include "../include/PositionStore.h"
+#include <algorithm>
+
+PositionStore::PositionStore() {
+    spanStart.push_back(0);
+    termStart.push_back(0);
+}
+
+void PositionStore::addDocument(const vector<TokenSpan>& tokenSpans, const vector<int>& termIds) {
+    spans.insert(spans.end(), tokenSpans.begin(), tokenSpans.end());
+    spanStart.push_back(static_cast<uint32_t>(spans.size()));
+
+    // Group token positions by term: sort (termId, position) pairs once
+    vector<pair<int, uint32_t>> occurrences;
+    occurrences.reserve(termIds.size());
+    for (size_t i = 0; i < termIds.size(); ++i) {
+        occurrences.push_back(make_pair(termIds[i], static_cast<uint32_t>(i)));
+    }
+    sort(occurrences.begin(), occurrences.end());
+
+    for (size_t i = 0; i < occurrences.size(); ++i) {
+        if (i == 0 || occurrences[i].first != occurrences[i - 1].first) {
+            terms.push_back(TermPositions{occurrences[i].first,
+                                          static_cast<uint32_t>(positions.size()), 0});
+        }
+        positions.push_back(occurrences[i].second);
+        terms.back().count++;
+    }
+    termStart.push_back(static_cast<uint32_t>(terms.size()));
+}
+
+void PositionStore::append(const PositionStoreView& other, const vector<int>& termIdMap,
+                           const DeletionBitmap* deleted) {
+    for (uint32_t doc = 0; doc < other.documentCount; ++doc) {
+        if (deleted && deleted->contains(doc)) {
+            spanStart.push_back(static_cast<uint32_t>(spans.size()));
+            termStart.push_back(static_cast<uint32_t>(terms.size()));
+            continue;
+        }
+
+        // Token positions are relative to their document, so spans copy as is
+        spans.insert(spans.end(), other.spans + other.spanStart[doc],
+                     other.spans + other.spanStart[doc + 1]);
+        spanStart.push_back(static_cast<uint32_t>(spans.size()));
+
+        // Remapped ids no longer follow the old order, so re-sort the entries
+        size_t firstTerm = terms.size();
+        for (uint32_t t = other.termStart[doc]; t < other.termStart[doc + 1]; ++t) {
+            const TermPositions& entry = other.terms[t];
+            terms.push_back(TermPositions{termIdMap[entry.termId],
+                                          static_cast<uint32_t>(positions.size()), entry.count});
+            positions.insert(positions.end(), other.positions + entry.start,
+                             other.positions + entry.start + entry.count);
+        }
+        sort(terms.begin() + firstTerm, terms.end(),
+            [](const TermPositions& a, const TermPositions& b) { return a.termId < b.termId; });
+        termStart.push_back(static_cast<uint32_t>(terms.size()));
+    }
+}
+
+void PositionStore::renumberTerms(const vector<int>& termIdMap) {
+    // Entries keep pointing at the same positions; only their order changes
+    for (size_t doc = 0; doc + 1 < termStart.size(); ++doc) {
+        vector<TermPositions>::iterator first = terms.begin() + termStart[doc];
+        vector<TermPositions>::iterator last = terms.begin() + termStart[doc + 1];
+        for (vector<TermPositions>::iterator entry = first; entry != last; ++entry) {
+            entry->termId = termIdMap[entry->termId];
+        }
+        sort(first, last,
+            [](const TermPositions& a, const TermPositions& b) { return a.termId < b.termId; });
+    }
+}
+
+PositionStoreView PositionStore::view() const {
+    PositionStoreView view;
+    view.documentCount = static_cast<uint32_t>(spanStart.size() - 1);
+    view.spanStart = spanStart.data();
+    view.termStart = termStart.data();
+    view.spans = spans.data();
+    view.terms = terms.data();
+    view.positions = positions.data();
+    return view;
+}
+
+pair<const uint32_t*, const uint32_t*> PositionStoreView::termPositions(int doc, int termId) const {
+    const TermPositions* first = terms + termStart[doc];
+    const TermPositions* last = terms + termStart[doc + 1];
+    const TermPositions* entry = lower_bound(first, last, termId,
+        [](const TermPositions& t, int id) { return t.termId < id; });
+    if (entry == last || entry->termId != termId) {
+        return make_pair(nullptr, nullptr);
+    }
+    const uint32_t* begin = positions + entry->start;
+    return make_pair(begin, begin + entry->count);
+}
+
+size_t PositionStoreView::positionCount() const {
+    // Each document's positions follow the previous one's, so the furthest
+    // run of the last document that has any ends the array
+    for (uint32_t doc = documentCount; doc-- > 0;) {
+        auto entries = termEntries(static_cast<int>(doc));
+        if (entries.first == entries.second) continue;
+
+        size_t total = 0;
+        for (const TermPositions* entry = entries.first; entry != entries.second; ++entry) {
+            total = max(total, static_cast<size_t>(entry->start + entry->count));
+        }
+        return total;
+    }
+    return 0;
+}
+
+size_t PositionStoreView::memoryBytes() const {
+    return 2 * (documentCount + 1) * sizeof(uint32_t) + spanCount() * sizeof(TokenSpan) +
+           termEntryCount() * sizeof(TermPositions) + positionCount() * sizeof(uint32_t);
+}
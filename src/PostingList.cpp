@@ -0,0 +1,324 @@
+#include "../include/PostingList.h"
+#include <algorithm>
+#include <cstring>
+
+const char* postingCodecName(PostingCodec codec) {
+    switch (codec) {
+        case PostingCodec::Raw: return "raw";
+        case PostingCodec::VarByte: return "varbyte";
+        case PostingCodec::BitPacked: return "bitpacked";
+    }
+    return "unknown";
+}
+
+static void writeVarByte(uint32_t value, vector<uint8_t>& out) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static const uint8_t* readVarByte(const uint8_t* in, uint32_t& value) {
+    uint32_t result = 0;
+    int shift = 0;
+    while (*in & 0x80) {
+        result |= static_cast<uint32_t>(*in++ & 0x7F) << shift;
+        shift += 7;
+    }
+    value = result | (static_cast<uint32_t>(*in++) << shift);
+    return in;
+}
+
+static int bitWidth(const uint32_t* values, int n) {
+    uint32_t merged = 0;
+    for (int i = 0; i < n; ++i) merged |= values[i];
+    int bits = 0;
+    while (merged) {
+        bits++;
+        merged >>= 1;
+    }
+    return bits;
+}
+
+static void packBits(const uint32_t* values, int n, int bits, vector<uint8_t>& out) {
+    uint64_t buffer = 0;
+    int filled = 0;
+    for (int i = 0; i < n; ++i) {
+        buffer |= static_cast<uint64_t>(values[i]) << filled;
+        filled += bits;
+        while (filled >= 8) {
+            out.push_back(static_cast<uint8_t>(buffer));
+            buffer >>= 8;
+            filled -= 8;
+        }
+    }
+    if (filled > 0) out.push_back(static_cast<uint8_t>(buffer));
+}
+
+static const uint8_t* unpackBits(const uint8_t* in, int n, int bits, uint32_t* values) {
+    if (bits == 0) {
+        fill(values, values + n, 0u);
+        return in;
+    }
+    const uint64_t mask = (static_cast<uint64_t>(1) << bits) - 1;
+    uint64_t buffer = 0;
+    int filled = 0;
+    for (int i = 0; i < n; ++i) {
+        while (filled < bits) {
+            buffer |= static_cast<uint64_t>(*in++) << filled;
+            filled += 8;
+        }
+        values[i] = static_cast<uint32_t>(buffer & mask);
+        buffer >>= bits;
+        filled -= bits;
+    }
+    return in;
+}
+
+PostingList::PostingList(PostingCodec codec)
+    : codec(codec), count(0), maxTf(0), tailMaxTf(0), maxTitleTf(0), tailMaxTitleTf(0) {}
+
+void PostingList::add(int docId, int tf, int titleTf) {
+    tail.push_back(Posting{docId, tf, titleTf});
+    count++;
+    maxTf = max(maxTf, tf);
+    tailMaxTf = max(tailMaxTf, tf);
+    maxTitleTf = max(maxTitleTf, titleTf);
+    tailMaxTitleTf = max(tailMaxTitleTf, titleTf);
+    if (tail.size() == static_cast<size_t>(kPostingBlockSize)) {
+        flushTail();
+    }
+}
+
+void PostingList::append(const PostingListView& other) {
+    // Blocks are delta-encoded against their predecessor, so they are
+    // re-encoded rather than copied
+    for (PostingIterator it(other); it.docId() != kEndDocId; it.next()) {
+        add(it.docId(), it.tf(), it.titleTf());
+    }
+}
+
+void PostingList::flushTail() {
+    // Gaps and frequencies are stored minus one: both are always >= 1.
+    // Title frequencies follow as a third stream, left out when all are 0;
+    // VarByte stores only the nonzero ones, as (index, value) pairs
+    int base = blocks.empty() ? -1 : blocks.back().maxDocId;
+    uint32_t gaps[kPostingBlockSize];
+    uint32_t freqs[kPostingBlockSize];
+    uint32_t titleFreqs[kPostingBlockSize];
+    int n = static_cast<int>(tail.size());
+    for (int i = 0; i < n; ++i) {
+        gaps[i] = static_cast<uint32_t>(tail[i].docId - base - 1);
+        freqs[i] = static_cast<uint32_t>(tail[i].tf - 1);
+        titleFreqs[i] = static_cast<uint32_t>(tail[i].titleTf);
+        base = tail[i].docId;
+    }
+    int streams = (tailMaxTitleTf > 0) ? 3 : 2;
+
+    blocks.push_back(PostingBlock{tail.back().docId, tailMaxTf, tailMaxTitleTf,
+                                  static_cast<uint32_t>(data.size())});
+    switch (codec) {
+        case PostingCodec::Raw: {
+            size_t start = data.size();
+            data.resize(start + streams * n * sizeof(uint32_t));
+            memcpy(&data[start], gaps, n * sizeof(uint32_t));
+            memcpy(&data[start + n * sizeof(uint32_t)], freqs, n * sizeof(uint32_t));
+            if (streams == 3) {
+                memcpy(&data[start + 2 * n * sizeof(uint32_t)], titleFreqs, n * sizeof(uint32_t));
+            }
+            break;
+        }
+        case PostingCodec::VarByte:
+            for (int i = 0; i < n; ++i) writeVarByte(gaps[i], data);
+            for (int i = 0; i < n; ++i) writeVarByte(freqs[i], data);
+            if (streams == 3) {
+                size_t countAt = data.size();
+                data.push_back(0);
+                uint8_t titled = 0;
+                for (int i = 0; i < n; ++i) {
+                    if (titleFreqs[i] == 0) continue;
+                    data.push_back(static_cast<uint8_t>(i));
+                    writeVarByte(titleFreqs[i], data);
+                    titled++;
+                }
+                data[countAt] = titled;
+            }
+            break;
+        case PostingCodec::BitPacked: {
+            int gapBits = bitWidth(gaps, n);
+            int tfBits = bitWidth(freqs, n);
+            data.push_back(static_cast<uint8_t>(gapBits));
+            data.push_back(static_cast<uint8_t>(tfBits));
+            packBits(gaps, n, gapBits, data);
+            packBits(freqs, n, tfBits, data);
+            if (streams == 3) {
+                int titleBits = bitWidth(titleFreqs, n);
+                data.push_back(static_cast<uint8_t>(titleBits));
+                packBits(titleFreqs, n, titleBits, data);
+            }
+            break;
+        }
+    }
+    tail.clear();
+    tailMaxTf = 0;
+    tailMaxTitleTf = 0;
+}
+
+int PostingListView::decodeBlock(size_t index, int* docs, int* tfs, int* titleTfs) const {
+    const uint8_t* in = data + blocks[index].offset;
+    int base = (index == 0) ? -1 : blocks[index - 1].maxDocId;
+    int n = kPostingBlockSize;
+    bool hasTitles = blocks[index].maxTitleTf > 0;
+    uint32_t gaps[kPostingBlockSize];
+    uint32_t freqs[kPostingBlockSize];
+    uint32_t titleFreqs[kPostingBlockSize];
+    if (!hasTitles || codec == PostingCodec::VarByte) fill(titleFreqs, titleFreqs + n, 0u);
+
+    switch (codec) {
+        case PostingCodec::Raw:
+            memcpy(gaps, in, n * sizeof(uint32_t));
+            memcpy(freqs, in + n * sizeof(uint32_t), n * sizeof(uint32_t));
+            if (hasTitles) memcpy(titleFreqs, in + 2 * n * sizeof(uint32_t), n * sizeof(uint32_t));
+            break;
+        case PostingCodec::VarByte:
+            for (int i = 0; i < n; ++i) in = readVarByte(in, gaps[i]);
+            for (int i = 0; i < n; ++i) in = readVarByte(in, freqs[i]);
+            if (hasTitles) {
+                int titled = *in++;
+                for (int i = 0; i < titled; ++i) {
+                    int index = *in++;
+                    in = readVarByte(in, titleFreqs[index]);
+                }
+            }
+            break;
+        case PostingCodec::BitPacked: {
+            int gapBits = *in++;
+            int tfBits = *in++;
+            in = unpackBits(in, n, gapBits, gaps);
+            in = unpackBits(in, n, tfBits, freqs);
+            if (hasTitles) {
+                int titleBits = *in++;
+                unpackBits(in, n, titleBits, titleFreqs);
+            }
+            break;
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        base += static_cast<int>(gaps[i]) + 1;
+        docs[i] = base;
+        tfs[i] = static_cast<int>(freqs[i]) + 1;
+        titleTfs[i] = static_cast<int>(titleFreqs[i]);
+    }
+    return n;
+}
+
+size_t PostingList::size() const {
+    return count;
+}
+
+size_t PostingList::memoryBytes() const {
+    return data.size() + blocks.size() * sizeof(PostingBlock) + tail.size() * sizeof(Posting);
+}
+
+int PostingList::maxTermFrequency() const {
+    return maxTf;
+}
+
+PostingListView PostingList::view() const {
+    PostingListView view;
+    view.codec = codec;
+    view.blocks = blocks.data();
+    view.blockCount = static_cast<uint32_t>(blocks.size());
+    view.data = data.data();
+    view.dataSize = data.size();
+    view.tail = tail.data();
+    view.tailCount = static_cast<uint32_t>(tail.size());
+    view.tailMaxTf = tailMaxTf;
+    view.tailMaxTitleTf = tailMaxTitleTf;
+    view.count = static_cast<uint32_t>(count);
+    view.maxTf = maxTf;
+    view.maxTitleTf = maxTitleTf;
+    return view;
+}
+
+PostingIterator PostingList::iterator() const {
+    return PostingIterator(view());
+}
+
+PostingIterator::PostingIterator(const PostingListView& list)
+    : list(list), blockIndex(0), boundBlock(0), position(0), blockCount(0), decoded(0) {
+    loadBlock(0);
+}
+
+void PostingIterator::loadBlock(size_t index) {
+    blockIndex = index;
+    position = 0;
+    if (index < list.blockCount) {
+        blockCount = list.decodeBlock(index, docs, tfs, titleTfs);
+    } else {
+        blockCount = static_cast<int>(list.tailCount);
+        for (int i = 0; i < blockCount; ++i) {
+            docs[i] = list.tail[i].docId;
+            tfs[i] = list.tail[i].tf;
+            titleTfs[i] = list.tail[i].titleTf;
+        }
+    }
+    decoded += static_cast<size_t>(blockCount);
+}
+
+void PostingIterator::next() {
+    if (position < blockCount && ++position == blockCount && blockIndex < list.blockCount) {
+        loadBlock(blockIndex + 1);
+    }
+}
+
+void PostingIterator::nextBlock() {
+    if (blockIndex < list.blockCount) {
+        loadBlock(blockIndex + 1);
+    } else {
+        position = blockCount;
+    }
+}
+
+size_t PostingIterator::findBlock(size_t index, int target) const {
+    // The skip headers are galloped: doubling steps bracket the target block
+    // and a binary search finds it, so long jumps cost O(log distance)
+    if (index >= list.blockCount || list.blocks[index].maxDocId >= target) return index;
+    size_t low = index;
+    size_t step = 1;
+    size_t high = low + 1;
+    while (high < list.blockCount && list.blocks[high].maxDocId < target) {
+        low = high;
+        step *= 2;
+        high = low + step;
+    }
+    high = min<size_t>(high, list.blockCount);
+    return static_cast<size_t>(lower_bound(list.blocks + low + 1, list.blocks + high, target,
+        [](const PostingBlock& block, int id) { return block.maxDocId < id; }) - list.blocks);
+}
+
+void PostingIterator::advance(int target) {
+    if (docId() >= target) return;
+
+    // Skip whole blocks whose last docId is below the target without decoding them
+    size_t index = findBlock(blockIndex, target);
+    if (index != blockIndex) loadBlock(index);
+
+    position = static_cast<int>(lower_bound(docs + position, docs + blockCount, target) - docs);
+}
+
+void PostingIterator::blockMaxima(int target, int& maxTf, int& maxTitleTf) const {
+    // Resume from the block found last unless target lies before it
+    size_t from = blockIndex;
+    if (boundBlock > blockIndex && list.blocks[boundBlock - 1].maxDocId < target) from = boundBlock;
+    boundBlock = findBlock(from, target);
+    if (boundBlock < list.blockCount) {
+        maxTf = list.blocks[boundBlock].maxTf;
+        maxTitleTf = list.blocks[boundBlock].maxTitleTf;
+    } else {
+        maxTf = list.tailMaxTf;
+        maxTitleTf = list.tailMaxTitleTf;
+    }
+}
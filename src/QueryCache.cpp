@@ -0,0 +1,84 @@
+#include "../include/QueryCache.h"
+#include <functional>
+
+QueryCache::QueryCache(size_t capacity, size_t shardCount)
+    : shards(new Shard[shardCount > 0 ? shardCount : 1]),
+      shardCount(shardCount > 0 ? shardCount : 1) {
+    // Rounded up so that a small cache still holds at least one entry per shard
+    shardCapacity = (capacity + this->shardCount - 1) / this->shardCount;
+    if (shardCapacity == 0) shardCapacity = 1;
+    for (size_t s = 0; s < this->shardCount; ++s) {
+        shards[s].hits = shards[s].misses = shards[s].evictions = shards[s].invalidations = 0;
+    }
+}
+
+QueryCache::Shard& QueryCache::shardFor(const string& key) const {
+    return shards[hash<string>()(key) % shardCount];
+}
+
+bool QueryCache::find(const string& key, uint64_t generation, vector<SearchResult>& results) {
+    Shard& shard = shardFor(key);
+    lock_guard<mutex> lock(shard.lock);
+    auto found = shard.index.find(key);
+    if (found == shard.index.end()) {
+        shard.misses++;
+        return false;
+    }
+    list<Entry>::iterator entry = found->second;
+    if (entry->generation != generation) {
+        shard.index.erase(found);
+        shard.entries.erase(entry);
+        shard.invalidations++;
+        shard.misses++;
+        return false;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+    results = entry->results;
+    shard.hits++;
+    return true;
+}
+
+void QueryCache::insert(const string& key, uint64_t generation,
+                        const vector<SearchResult>& results) {
+    Shard& shard = shardFor(key);
+    lock_guard<mutex> lock(shard.lock);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end()) {
+        // Another thread may have cached an older or a newer generation meanwhile
+        list<Entry>::iterator entry = found->second;
+        if (entry->generation > generation) return;
+        entry->generation = generation;
+        entry->results = results;
+        shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+        return;
+    }
+
+    if (shard.entries.size() >= shardCapacity) {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+        shard.evictions++;
+    }
+    shard.entries.push_front(Entry{key, generation, results});
+    shard.index.emplace(key, shard.entries.begin());
+}
+
+void QueryCache::clear() {
+    for (size_t s = 0; s < shardCount; ++s) {
+        lock_guard<mutex> lock(shards[s].lock);
+        shards[s].entries.clear();
+        shards[s].index.clear();
+    }
+}
+
+QueryCacheStats QueryCache::stats() const {
+    QueryCacheStats total{0, 0, 0, 0, 0};
+    for (size_t s = 0; s < shardCount; ++s) {
+        lock_guard<mutex> lock(shards[s].lock);
+        total.hits += shards[s].hits;
+        total.misses += shards[s].misses;
+        total.evictions += shards[s].evictions;
+        total.invalidations += shards[s].invalidations;
+        total.entries += shards[s].entries.size();
+    }
+    return total;
+}
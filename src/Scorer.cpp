@@ -0,0 +1,23 @@
+#include "../include/Scorer.h"
+
+const char* scoringModelName(ScoringModel model) {
+    switch (model) {
+        case ScoringModel::TfIdf: return "tf-idf";
+        case ScoringModel::BM25: return "bm25";
+        case ScoringModel::BM25F: return "bm25f";
+    }
+    return "unknown";
+}
+
+ScoringParams::ScoringParams(ScoringModel model)
+    : model(model), titleWeight(2.0), contentWeight(1.0), k1(1.2), b(0.75),
+      titleB(0.5), contentB(0.75), priorWeight(0.0) {}
+
+double scoringIDF(ScoringModel model, size_t documentFrequency, size_t documentCount) {
+    switch (model) {
+        case ScoringModel::TfIdf: return TfIdfScorer::idf(documentFrequency, documentCount);
+        case ScoringModel::BM25: return BM25Scorer::idf(documentFrequency, documentCount);
+        case ScoringModel::BM25F: return BM25FScorer::idf(documentFrequency, documentCount);
+    }
+    return 0.0;
+}
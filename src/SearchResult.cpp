@@ -1,7 +1,7 @@
 #include "../include/SearchResult.h"
 
 SearchResult::SearchResult() 
-    : documentId(0), score(0.0), title(""), snippet(""), url("") {}
+    : documentId(0), score(0.0), snippet("") {}
 
-SearchResult::SearchResult(int id, double s, const string& t, const string& snip, const string& u)
+SearchResult::SearchResult(int id, double s, StringRef t, const string& snip, StringRef u)
     : documentId(id), score(s), title(t), snippet(snip), url(u) {}
@@ -0,0 +1,59 @@
+#include "../include/Segment.h"
+#include <algorithm>
+#include <cmath>
+
+size_t Segment::postingCount() const {
+    size_t total = 0;
+    for (size_t termId = 0; termId < termCount(); ++termId) {
+        total += postingList(static_cast<int>(termId)).size();
+    }
+    return total;
+}
+
+size_t Segment::postingBytes() const {
+    size_t total = 0;
+    for (size_t termId = 0; termId < termCount(); ++termId) {
+        PostingListView list = postingList(static_cast<int>(termId));
+        total += list.blockCount * sizeof(PostingBlock) + list.dataSize +
+                 list.tailCount * sizeof(Posting);
+    }
+    return total;
+}
+
+size_t Segment::positionBytes() const {
+    return positionStore().memoryBytes();
+}
+
+size_t Segment::bitmapBytes() const {
+    size_t bitmaps = 0;
+    for (size_t termId = 0; termId < termCount(); ++termId) {
+        if (termBitmap(static_cast<int>(termId))) bitmaps++;
+    }
+    return bitmaps * bitmapWords(documentCount()) * sizeof(uint64_t);
+}
+
+uint8_t Segment::documentPrior(StringRef url, size_t titleLength) {
+    // Depth counts the path segments after the host, plus one for a query
+    // string; a document without a URL is given depth one
+    size_t depth = 1;
+    if (url.size > 0) {
+        string text = url.str();
+        size_t scheme = text.find("://");
+        size_t at = text.find_first_of("/?#", scheme == string::npos ? 0 : scheme + 3);
+        depth = 0;
+        bool inSegment = false;
+        for (; at < text.size() && text[at] != '#'; ++at) {
+            if (text[at] == '?') {
+                depth++;
+                break;
+            }
+            bool separator = text[at] == '/';
+            if (!separator && !inSegment) depth++;
+            inSegment = !separator;
+        }
+    }
+    double urlScore = 1.0 / static_cast<double>(1 + depth);
+    size_t titled = min(titleLength, static_cast<size_t>(kPriorTitleTokens));
+    double titleScore = static_cast<double>(titled) / kPriorTitleTokens;
+    return static_cast<uint8_t>(lround(127.5 * (urlScore + titleScore)));
+}
@@ -0,0 +1,240 @@
+#include "../include/ShardedSearchEngine.h"
+
+LocalShard::LocalShard(PostingCodec codec, const AnalyzerOptions& analysis)
+    : searchEngine(codec, analysis) {}
+
+int LocalShard::addDocument(const string& title, const string& content, const string& url) {
+    return searchEngine.addDocument(title, content, url);
+}
+
+void LocalShard::addDocuments(vector<Document> batch, unsigned threadCount) {
+    searchEngine.addDocuments(move(batch), threadCount);
+}
+
+bool LocalShard::removeDocument(int docId) {
+    return searchEngine.removeDocument(docId);
+}
+
+int LocalShard::updateDocument(int docId, const string& title, const string& content,
+                               const string& url) {
+    return searchEngine.updateDocument(docId, title, content, url);
+}
+
+void LocalShard::refresh() {
+    searchEngine.refresh();
+}
+
+void LocalShard::waitForMerges() {
+    searchEngine.waitForMerges();
+}
+
+void LocalShard::setScoring(const ScoringParams& params) {
+    searchEngine.setScoring(params);
+}
+
+TermStatistics LocalShard::termStatistics(const string& query) {
+    return searchEngine.termStatistics(query);
+}
+
+vector<ScoredDocument> LocalShard::searchIds(const string& query, int maxResults,
+                                             const TermStatistics& global) {
+    return searchEngine.searchIds(query, maxResults, global);
+}
+
+vector<SearchResult> LocalShard::fetchResults(const string& query,
+                                              const vector<ScoredDocument>& ranked,
+                                              bool withSnippets) {
+    return searchEngine.fetchResults(query, ranked, withSnippets);
+}
+
+ShardedSearchEngine::ShardedSearchEngine(size_t shardCount, unsigned threadCount,
+                                         PostingCodec codec, const AnalyzerOptions& analysis) {
+    for (size_t s = 0; s < max<size_t>(shardCount, 1); ++s) {
+        shards.emplace_back(new LocalShard(codec, analysis));
+        shardIds.emplace_back(new ShardIds());
+    }
+    unsigned threads = threadCount ? threadCount : static_cast<unsigned>(shards.size());
+    if (threads > 1 && shards.size() > 1) pool.reset(new ThreadPool(threads));
+}
+
+ShardedSearchEngine::ShardedSearchEngine(vector<unique_ptr<SearchShard>> input,
+                                         unsigned threadCount)
+    : shards(move(input)) {
+    if (shards.empty()) shards.emplace_back(new LocalShard());
+    for (size_t s = 0; s < shards.size(); ++s) shardIds.emplace_back(new ShardIds());
+    unsigned threads = threadCount ? threadCount : static_cast<unsigned>(shards.size());
+    if (threads > 1 && shards.size() > 1) pool.reset(new ThreadPool(threads));
+}
+
+size_t ShardedSearchEngine::shardFor(int globalId) const {
+    // SplitMix64's finalizer, so runs of consecutive ids spread evenly
+    uint64_t hash = static_cast<uint64_t>(globalId) + 0x9E3779B97F4A7C15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    hash ^= hash >> 31;
+    return static_cast<size_t>(hash % shards.size());
+}
+
+int ShardedSearchEngine::record(size_t shard) {
+    int globalId = static_cast<int>(locations.size());
+    ShardIds& ids = *shardIds[shard];
+    lock_guard<mutex> lock(ids.lock);
+    locations.push_back(DocumentLocation{static_cast<uint32_t>(shard),
+                                         static_cast<int>(ids.globalIds.size())});
+    ids.globalIds.push_back(globalId);
+    return globalId;
+}
+
+void ShardedSearchEngine::unrecord(size_t shard) {
+    ShardIds& ids = *shardIds[shard];
+    lock_guard<mutex> lock(ids.lock);
+    locations.pop_back();
+    ids.globalIds.pop_back();
+}
+
+void ShardedSearchEngine::forEachShard(const function<void(size_t)>& task) {
+    if (!pool) {
+        for (size_t s = 0; s < shards.size(); ++s) task(s);
+        return;
+    }
+    pool->parallelFor(shards.size(), task);
+}
+
+int ShardedSearchEngine::addDocument(const string& title, const string& content,
+                                     const string& url) {
+    lock_guard<mutex> lock(writeMutex);
+    size_t shard = shardFor(static_cast<int>(locations.size()));
+    int globalId = record(shard);
+    shards[shard]->addDocument(title, content, url);
+    return globalId;
+}
+
+void ShardedSearchEngine::addDocuments(vector<Document> batch) {
+    lock_guard<mutex> lock(writeMutex);
+    vector<vector<Document>> parts(shards.size());
+    for (Document& doc : batch) {
+        size_t shard = shardFor(static_cast<int>(locations.size()));
+        record(shard);
+        parts[shard].push_back(move(doc));
+    }
+    batch.clear();
+    batch.shrink_to_fit();
+    // Shards index side by side, so each gets its share of the cores
+    unsigned cores = max(1u, thread::hardware_concurrency());
+    unsigned threadsPerShard = max(1u, cores / static_cast<unsigned>(shards.size()));
+    forEachShard([&](size_t s) {
+        if (!parts[s].empty()) shards[s]->addDocuments(move(parts[s]), threadsPerShard);
+    });
+}
+
+bool ShardedSearchEngine::removeDocument(int docId) {
+    lock_guard<mutex> lock(writeMutex);
+    if (docId < 0 || static_cast<size_t>(docId) >= locations.size()) return false;
+    DocumentLocation& location = locations[static_cast<size_t>(docId)];
+    if (location.docId < 0 || !shards[location.shard]->removeDocument(location.docId)) return false;
+    location.docId = -1;
+    return true;
+}
+
+int ShardedSearchEngine::updateDocument(int docId, const string& title, const string& content,
+                                        const string& url) {
+    lock_guard<mutex> lock(writeMutex);
+    if (docId < 0 || static_cast<size_t>(docId) >= locations.size()) return -1;
+    DocumentLocation location = locations[static_cast<size_t>(docId)];
+    if (location.docId < 0) return -1;
+    int newId = record(location.shard);
+    if (shards[location.shard]->updateDocument(location.docId, title, content, url) < 0) {
+        unrecord(location.shard);
+        return -1;
+    }
+    locations[static_cast<size_t>(docId)].docId = -1;
+    return newId;
+}
+
+void ShardedSearchEngine::refresh() {
+    forEachShard([this](size_t s) { shards[s]->refresh(); });
+}
+
+void ShardedSearchEngine::waitForMerges() {
+    forEachShard([this](size_t s) { shards[s]->waitForMerges(); });
+}
+
+void ShardedSearchEngine::setScoring(const ScoringParams& params) {
+    forEachShard([&](size_t s) { shards[s]->setScoring(params); });
+}
+
+TermStatistics ShardedSearchEngine::termStatistics(const string& query) {
+    vector<TermStatistics> parts(shards.size());
+    forEachShard([&](size_t s) { parts[s] = shards[s]->termStatistics(query); });
+    TermStatistics total;
+    for (const TermStatistics& part : parts) total.add(part);
+    return total;
+}
+
+vector<ShardedSearchEngine::ShardHit> ShardedSearchEngine::rank(const string& query,
+                                                                int maxResults) {
+    vector<ShardHit> hits;
+    if (maxResults <= 0) return hits;
+    TermStatistics global = termStatistics(query);
+    vector<vector<ScoredDocument>> ranked(shards.size());
+    forEachShard([&](size_t s) { ranked[s] = shards[s]->searchIds(query, maxResults, global); });
+
+    for (size_t s = 0; s < shards.size(); ++s) {
+        ShardIds& ids = *shardIds[s];
+        lock_guard<mutex> lock(ids.lock);
+        for (const ScoredDocument& scored : ranked[s]) {
+            int globalId = ids.globalIds[static_cast<size_t>(scored.documentId)];
+            hits.push_back(ShardHit{ScoredDocument{globalId, scored.score}, s, scored.documentId});
+        }
+    }
+    // Shard ids grow with global ids, so each shard already broke its ties
+    // towards the lower global id, as the merge does
+    size_t k = min(hits.size(), static_cast<size_t>(maxResults));
+    partial_sort(hits.begin(), hits.begin() + static_cast<ptrdiff_t>(k), hits.end(),
+                 [](const ShardHit& a, const ShardHit& b) {
+                     return TopKHeap::ranksBefore(a.global, b.global);
+                 });
+    hits.resize(k);
+    return hits;
+}
+
+vector<ScoredDocument> ShardedSearchEngine::searchIds(const string& query, int maxResults) {
+    vector<ScoredDocument> ranked;
+    for (const ShardHit& hit : rank(query, maxResults)) ranked.push_back(hit.global);
+    return ranked;
+}
+
+vector<SearchResult> ShardedSearchEngine::search(const string& query, int maxResults,
+                                                 bool withSnippets) {
+    vector<ShardHit> hits = rank(query, maxResults);
+    vector<vector<ScoredDocument>> wanted(shards.size());
+    vector<vector<size_t>> ranks(shards.size());     // Position of each wanted hit in hits
+    for (size_t i = 0; i < hits.size(); ++i) {
+        wanted[hits[i].shard].push_back(ScoredDocument{hits[i].docId, hits[i].global.score});
+        ranks[hits[i].shard].push_back(i);
+    }
+
+    vector<SearchResult> placed(hits.size());
+    vector<char> found(hits.size(), 0);     // Not vector<bool>: shards write it concurrently
+    forEachShard([&](size_t s) {
+        if (wanted[s].empty()) return;
+        // A shard leaves out documents it no longer holds, keeping the order
+        size_t next = 0;
+        for (SearchResult& result : shards[s]->fetchResults(query, wanted[s], withSnippets)) {
+            while (next < wanted[s].size() && wanted[s][next].documentId != result.documentId) {
+                next++;
+            }
+            if (next == wanted[s].size()) break;
+            size_t i = ranks[s][next++];
+            result.documentId = hits[i].global.documentId;
+            placed[i] = move(result);
+            found[i] = 1;
+        }
+    });
+
+    vector<SearchResult> results;
+    for (size_t i = 0; i < hits.size(); ++i) {
+        if (found[i]) results.push_back(move(placed[i]));
+    }
+    return results;
+}
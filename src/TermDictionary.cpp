@@ -0,0 +1,142 @@
+#include "../include/TermDictionary.h"
+#include <algorithm>
+
+static void writeVarint(vector<uint8_t>& out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static size_t readVarint(const uint8_t*& in) {
+    size_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = *in++;
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+}
+
+TermDictionary::TermDictionary() : count(0) {}
+
+TermDictionary::TermDictionary(const vector<string>& sortedTerms) : count(sortedTerms.size()) {
+    for (size_t i = 0; i < sortedTerms.size(); ++i) {
+        const string& text = sortedTerms[i];
+        size_t shared = 0;
+        if (i % kBlockTerms == 0) {
+            blockOffsets.push_back(static_cast<uint32_t>(data.size()));
+        } else {
+            const string& previous = sortedTerms[i - 1];
+            size_t limit = min(previous.size(), text.size());
+            while (shared < limit && previous[shared] == text[shared]) shared++;
+            writeVarint(data, shared);
+        }
+        writeVarint(data, text.size() - shared);
+        data.insert(data.end(), text.begin() + static_cast<ptrdiff_t>(shared), text.end());
+    }
+    data.shrink_to_fit();
+    blockOffsets.shrink_to_fit();
+}
+
+size_t TermDictionary::seek(StringRef key, bool& exact) const {
+    exact = false;
+    const uint8_t* keyBytes = reinterpret_cast<const uint8_t*>(key.data);
+
+    // Last block whose head is not above key; before every head, key sorts first
+    size_t low = 0, high = blockOffsets.size();
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const uint8_t* in = data.data() + blockOffsets[mid];
+        size_t length = readVarint(in);
+        if (StringRef(reinterpret_cast<const char*>(in), length).compare(key) <= 0) low = mid + 1;
+        else high = mid;
+    }
+    if (low == 0) return 0;
+    size_t block = low - 1;
+
+    // Scan the block keeping matched, the prefix the previous term shares with
+    // key. The previous term sorts below key, so a term sharing less of it
+    // sorts above key and one sharing more still sorts below
+    const uint8_t* in = data.data() + blockOffsets[block];
+    size_t headLength = readVarint(in);
+    size_t matched = 0;
+    while (matched < headLength && matched < key.size && in[matched] == keyBytes[matched]) matched++;
+    size_t termId = block * kBlockTerms;
+    if (matched == headLength && matched == key.size) {
+        exact = true;
+        return termId;
+    }
+    in += headLength;
+
+    size_t blockEnd = min(count, termId + kBlockTerms);
+    for (++termId; termId < blockEnd; ++termId) {
+        size_t shared = readVarint(in);
+        size_t suffixLength = readVarint(in);
+        const uint8_t* suffix = in;
+        in += suffixLength;
+        if (shared < matched) return termId;
+        if (shared > matched) continue;
+
+        size_t i = 0;
+        while (i < suffixLength && matched < key.size && suffix[i] == keyBytes[matched]) {
+            i++;
+            matched++;
+        }
+        if (i == suffixLength) {
+            if (matched == key.size) {
+                exact = true;
+                return termId;
+            }
+            continue;   // The term is a proper prefix of key
+        }
+        if (matched == key.size || suffix[i] > keyBytes[matched]) return termId;
+    }
+    return blockEnd;
+}
+
+int TermDictionary::find(StringRef term) const {
+    bool exact;
+    size_t termId = seek(term, exact);
+    return exact ? static_cast<int>(termId) : -1;
+}
+
+size_t TermDictionary::lowerBound(StringRef key) const {
+    bool exact;
+    return seek(key, exact);
+}
+
+string TermDictionary::term(int termId) const {
+    size_t block = static_cast<size_t>(termId) / kBlockTerms;
+    const uint8_t* in = data.data() + blockOffsets[block];
+    size_t length = readVarint(in);
+    string text(reinterpret_cast<const char*>(in), length);
+    in += length;
+    for (size_t i = block * kBlockTerms; i < static_cast<size_t>(termId); ++i) {
+        size_t shared = readVarint(in);
+        size_t suffixLength = readVarint(in);
+        text.resize(shared);
+        text.append(reinterpret_cast<const char*>(in), suffixLength);
+        in += suffixLength;
+    }
+    return text;
+}
+
+void TermDictionary::prefixRange(StringRef prefix, size_t& first, size_t& last) const {
+    first = lowerBound(prefix);
+
+    // The smallest key above every term with the prefix: drop trailing 0xFF
+    // bytes and increment the last remaining one
+    string successor = prefix.str();
+    while (!successor.empty() && static_cast<uint8_t>(successor.back()) == 0xFF) successor.pop_back();
+    if (successor.empty()) {
+        last = count;
+        return;
+    }
+    successor.back() = static_cast<char>(static_cast<uint8_t>(successor.back()) + 1);
+    last = lowerBound(successor);
+}
+
+size_t TermDictionary::memoryBytes() const {
+    return data.capacity() + blockOffsets.capacity() * sizeof(uint32_t);
+}
@@ -0,0 +1,114 @@
+#include "../include/ThreadPool.h"
+#include <algorithm>
+
+namespace {
+
+// Identifies the pool and queue of the current thread when it is a worker
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local size_t currentQueue = 0;
+
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) : queued(0), nextQueue(0), stopping(false) {
+    if (threadCount == 0) threadCount = max(1u, thread::hardware_concurrency());
+    for (unsigned i = 0; i < threadCount; ++i) queues.emplace_back(new WorkQueue());
+    for (unsigned i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, static_cast<size_t>(i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (thread& worker : workers) worker.join();
+}
+
+void ThreadPool::push(size_t queue, function<void()> task) {
+    {
+        lock_guard<mutex> lock(queues[queue]->lock);
+        queues[queue]->tasks.push_back(move(task));
+        queued++;
+    }
+    // Taking sleepMutex orders the push before a worker's check for work
+    lock_guard<mutex> lock(sleepMutex);
+    wakeup.notify_one();
+}
+
+size_t ThreadPool::homeQueue() {
+    if (currentPool == this) return currentQueue;
+    return nextQueue++ % queues.size();
+}
+
+void ThreadPool::submit(function<void()> task) {
+    push(homeQueue(), move(task));
+}
+
+bool ThreadPool::runOne(size_t home) {
+    function<void()> task;
+    for (size_t i = 0; i < queues.size() && !task; ++i) {
+        WorkQueue& queue = *queues[(home + i) % queues.size()];
+        lock_guard<mutex> lock(queue.lock);
+        if (queue.tasks.empty()) continue;
+        // Own work is taken newest first, stolen work oldest first
+        if (i == 0) {
+            task = move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        queued--;
+    }
+    if (!task) return false;
+    task();
+    return true;
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    currentPool = this;
+    currentQueue = index;
+    while (true) {
+        if (runOne(index)) continue;
+        unique_lock<mutex> lock(sleepMutex);
+        wakeup.wait(lock, [this]() { return stopping || queued > 0; });
+        if (stopping && queued == 0) return;
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const function<void(size_t)>& task) {
+    if (count == 0) return;
+    if (count == 1) {
+        task(0);
+        return;
+    }
+
+    struct Completion {
+        atomic<size_t> remaining;
+        mutex lock;
+        condition_variable done;
+    } completion;
+    completion.remaining = count;
+
+    // Spread the tasks so idle workers find them without stealing first
+    size_t first = homeQueue();
+    for (size_t i = 1; i < count; ++i) {
+        push((first + i) % queues.size(), [&completion, &task, i]() {
+            task(i);
+            lock_guard<mutex> lock(completion.lock);
+            if (--completion.remaining == 0) completion.done.notify_all();
+        });
+    }
+    task(0);
+    completion.remaining--;
+
+    while (completion.remaining > 0) {
+        if (runOne(first)) continue;
+        unique_lock<mutex> lock(completion.lock);
+        completion.done.wait(lock, [&completion]() { return completion.remaining == 0; });
+    }
+    // The last task may still hold the lock; completion must outlive it
+    lock_guard<mutex> lock(completion.lock);
+}
@@ -0,0 +1,156 @@
+#include "../include/Tokenizer.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TOKENIZER_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/**
+ * FoldTable: 256-entry lookup replacing the locale-dependent isalnum/tolower
+ */
+struct FoldTable {
+    unsigned char map[256];
+
+    FoldTable() {
+        for (int c = 0; c < 256; ++c) {
+            if (c >= 'a' && c <= 'z') map[c] = static_cast<unsigned char>(c);
+            else if (c >= 'A' && c <= 'Z') map[c] = static_cast<unsigned char>(c - 'A' + 'a');
+            else if (c >= '0' && c <= '9') map[c] = static_cast<unsigned char>(c);
+            else map[c] = 0;
+        }
+    }
+};
+
+const unsigned char* Tokenizer::foldTable() {
+    static const FoldTable table;
+    return table.map;
+}
+
+void Tokenizer::normalizeScalar(const char* text, size_t length, char* out) {
+    const unsigned char* table = foldTable();
+    for (size_t i = 0; i < length; ++i) {
+        out[i] = static_cast<char>(table[static_cast<unsigned char>(text[i])]);
+    }
+}
+
+// The vector kernels compute the fold table with range compares: bytes in
+// [A-Z] get the 0x20 case bit, and anything outside [A-Za-z0-9] is zeroed.
+// Signed compares reject bytes >= 0x80 because they are negative.
+
+#if defined(__AVX2__)
+
+static size_t normalizeBlocks(const char* text, size_t length, char* out) {
+    const __m256i upperLo = _mm256_set1_epi8('A' - 1), upperHi = _mm256_set1_epi8('Z' + 1);
+    const __m256i lowerLo = _mm256_set1_epi8('a' - 1), lowerHi = _mm256_set1_epi8('z' + 1);
+    const __m256i digitLo = _mm256_set1_epi8('0' - 1), digitHi = _mm256_set1_epi8('9' + 1);
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, upperLo), _mm256_cmpgt_epi8(upperHi, v));
+        __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, lowerLo), _mm256_cmpgt_epi8(lowerHi, v));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, digitLo), _mm256_cmpgt_epi8(digitHi, v));
+        __m256i keep = _mm256_or_si256(_mm256_or_si256(upper, lower), digit);
+        __m256i folded = _mm256_or_si256(v, _mm256_and_si256(upper, caseBit));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_and_si256(folded, keep));
+    }
+    return i;
+}
+
+static const char* kernelName = "avx2";
+
+#elif defined(TOKENIZER_SSE2)
+
+static size_t normalizeBlocks(const char* text, size_t length, char* out) {
+    const __m128i upperLo = _mm_set1_epi8('A' - 1), upperHi = _mm_set1_epi8('Z' + 1);
+    const __m128i lowerLo = _mm_set1_epi8('a' - 1), lowerHi = _mm_set1_epi8('z' + 1);
+    const __m128i digitLo = _mm_set1_epi8('0' - 1), digitHi = _mm_set1_epi8('9' + 1);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, upperLo), _mm_cmplt_epi8(v, upperHi));
+        __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, lowerLo), _mm_cmplt_epi8(v, lowerHi));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, digitLo), _mm_cmplt_epi8(v, digitHi));
+        __m128i keep = _mm_or_si128(_mm_or_si128(upper, lower), digit);
+        __m128i folded = _mm_or_si128(v, _mm_and_si128(upper, caseBit));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_and_si128(folded, keep));
+    }
+    return i;
+}
+
+static const char* kernelName = "sse2";
+
+#elif defined(__ARM_NEON)
+
+static size_t normalizeBlocks(const char* text, size_t length, char* out) {
+    const uint8x16_t caseBit = vdupq_n_u8(0x20);
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(text + i));
+        uint8x16_t upper = vandq_u8(vcgeq_u8(v, vdupq_n_u8('A')), vcleq_u8(v, vdupq_n_u8('Z')));
+        uint8x16_t lower = vandq_u8(vcgeq_u8(v, vdupq_n_u8('a')), vcleq_u8(v, vdupq_n_u8('z')));
+        uint8x16_t digit = vandq_u8(vcgeq_u8(v, vdupq_n_u8('0')), vcleq_u8(v, vdupq_n_u8('9')));
+        uint8x16_t keep = vorrq_u8(vorrq_u8(upper, lower), digit);
+        uint8x16_t folded = vorrq_u8(v, vandq_u8(upper, caseBit));
+        vst1q_u8(reinterpret_cast<uint8_t*>(out + i), vandq_u8(folded, keep));
+    }
+    return i;
+}
+
+static const char* kernelName = "neon";
+
+#else
+
+static size_t normalizeBlocks(const char*, size_t, char*) {
+    return 0;
+}
+
+static const char* kernelName = "scalar";
+
+#endif
+
+void Tokenizer::normalize(const char* text, size_t length, char* out) {
+    size_t done = normalizeBlocks(text, length, out);
+    normalizeScalar(text + done, length - done, out + done);
+}
+
+const char* Tokenizer::normalizeKernelName() {
+    return kernelName;
+}
+
+const vector<TokenSpan>& Tokenizer::tokenize(const char* text, size_t length) {
+    buffer.resize(length);
+    spans.clear();
+    if (length == 0) return spans;
+
+    normalize(text, length, &buffer[0]);
+
+    const char* normalized = buffer.data();
+    size_t pos = 0;
+    while (pos < length) {
+        while (pos < length && normalized[pos] == 0) pos++;
+        size_t start = pos;
+        while (pos < length && normalized[pos] != 0) pos++;
+        if (pos - start >= kMinTokenLength) {
+            spans.push_back(TokenSpan{static_cast<uint32_t>(start),
+                                      static_cast<uint32_t>(pos - start)});
+        }
+    }
+    return spans;
+}
+
+const vector<TokenSpan>& Tokenizer::tokenize(const string& text) {
+    return tokenize(text.data(), text.size());
+}
+
+string Tokenizer::tokenText(const TokenSpan& span) const {
+    return buffer.substr(span.offset, span.length);
+}
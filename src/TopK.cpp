@@ -0,0 +1,55 @@
+#include "../include/TopK.h"
+#include <algorithm>
+#include <limits>
+
+TopKHeap::TopKHeap(size_t k) : k(k), bounded(false), cursor(ScoredDocument{-1, 0.0}) {
+    heap.reserve(min(k, static_cast<size_t>(kReserveLimit)));
+}
+
+void TopKHeap::reset(size_t k) {
+    this->k = k;
+    heap.clear();
+    heap.reserve(min(k, static_cast<size_t>(kReserveLimit)));
+    bounded = false;
+}
+
+void TopKHeap::startAfter(const ScoredDocument& after) {
+    bounded = true;
+    cursor = after;
+}
+
+bool TopKHeap::ranksBefore(const ScoredDocument& a, const ScoredDocument& b) {
+    if (a.score != b.score) return a.score > b.score;
+    return a.documentId < b.documentId;
+}
+
+bool TopKHeap::full() const {
+    return k > 0 && heap.size() == k;
+}
+
+double TopKHeap::threshold() const {
+    return full() ? heap.front().score : -numeric_limits<double>::infinity();
+}
+
+bool TopKHeap::push(int docId, double score) {
+    if (k == 0) return false;
+    ScoredDocument candidate{docId, score};
+    if (bounded && !ranksBefore(cursor, candidate)) return false;
+    if (heap.size() < k) {
+        heap.push_back(candidate);
+        push_heap(heap.begin(), heap.end(), ranksBefore);
+        return true;
+    }
+    if (!ranksBefore(candidate, heap.front())) return false;
+
+    pop_heap(heap.begin(), heap.end(), ranksBefore);
+    heap.back() = candidate;
+    push_heap(heap.begin(), heap.end(), ranksBefore);
+    return true;
+}
+
+vector<ScoredDocument> TopKHeap::sortedResults() const {
+    vector<ScoredDocument> results = heap;
+    sort(results.begin(), results.end(), ranksBefore);
+    return results;
+}
@@ -0,0 +1,81 @@
+#include "../include/MiniSearchEngine.h"
+#include <cstdio>
+using namespace std;
+
+/**
+ * ingest_test: Queries and memory scrapes interleaved with ingestion must
+ * not publish. Adding documents with a query and a memoryStats() call after
+ * each one seals exactly the segments that adding them alone does, and
+ * pending documents become visible through refresh() or the refresh
+ * interval only. Exits non-zero on failure.
+ */
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    if (condition) return;
+    fprintf(stderr, "FAILED: %s\n", what);
+    failures++;
+}
+
+static string content(int i) {
+    return "ingest document " + to_string(i) + " term" + to_string(i % 97) + " shared words";
+}
+
+int main() {
+    const int documentCount = 20000;
+
+    MiniSearchEngine quiet;
+    MiniSearchEngine queried;
+    quiet.setRefreshInterval(0);
+    queried.setRefreshInterval(0);
+    for (int i = 0; i < documentCount; ++i) {
+        quiet.addDocument("Title " + to_string(i), content(i));
+        queried.addDocument("Title " + to_string(i), content(i));
+        queried.searchIds("shared term" + to_string(i % 97), 10);
+        queried.memoryStats();
+    }
+    queried.waitForMerges();
+    quiet.waitForMerges();
+
+    MergeStats quietStats = quiet.mergeStats();
+    MergeStats queriedStats = queried.mergeStats();
+    check(queriedStats.segmentsSealed == quietStats.segmentsSealed,
+          "queries change the number of sealed segments");
+    check(queriedStats.merges == quietStats.merges, "queries change the number of merges");
+    check(quietStats.segmentsSealed == static_cast<size_t>(documentCount) / 4096,
+          "adds seal a segment per 4096 documents");
+
+    // The last partial segment waits for refresh()
+    int unpublished = documentCount - documentCount / 4096 * 4096;
+    string lastQuery = "document " + to_string(documentCount - 1);
+    check(queried.searchIds(lastQuery, documentCount).size() ==
+              static_cast<size_t>(documentCount - unpublished),
+          "a query published pending documents");
+    queried.refresh();
+    quiet.refresh();
+    vector<ScoredDocument> found = queried.searchIds(lastQuery, documentCount);
+    check(found.size() == static_cast<size_t>(documentCount),
+          "refresh() publishes pending documents");
+    vector<ScoredDocument> expected = quiet.searchIds(lastQuery, documentCount);
+    bool same = found.size() == expected.size();
+    for (size_t i = 0; same && i < found.size(); ++i) {
+        same = found[i].documentId == expected[i].documentId && found[i].score == expected[i].score;
+    }
+    check(same, "rankings differ between the engines");
+
+    // With an interval, the merge thread publishes without any refresh()
+    MiniSearchEngine timed;
+    timed.setRefreshInterval(10);
+    timed.addDocument("Timed", "published by the flush timer");
+    bool visible = false;
+    for (int waited = 0; waited < 5000 && !visible; waited += 5) {
+        visible = !timed.searchIds("flush timer", 10).empty();
+        if (!visible) this_thread::sleep_for(chrono::milliseconds(5));
+    }
+    check(visible, "the refresh interval does not publish pending documents");
+    check(timed.mergeStats().segmentsSealed == 1, "the flush timer sealed more than once");
+
+    if (failures == 0) printf("ingest_test: ok\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+#include "../include/MiniSearchEngine.h"
+#include <climits>
+#include <cstdio>
+using namespace std;
+
+/**
+ * result_limit_test: A maxResults far beyond the index returns every match
+ * from each ranking entry point instead of sizing a heap by it. Exits
+ * non-zero on failure.
+ */
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    if (condition) return;
+    fprintf(stderr, "FAILED: %s\n", what);
+    failures++;
+}
+
+int main() {
+    MiniSearchEngine single;
+    single.addDocument("Search", "a search engine");
+    single.refresh();
+    check(single.search("search", INT_MAX).size() == 1, "search() on one document");
+    check(single.searchIds("search", INT_MAX).size() == 1, "searchIds() on one document");
+    check(single.searchBoolean("search", INT_MAX).size() == 1, "searchBoolean() on one document");
+    check(single.searchImpacts("search", INT_MAX).size() == 1, "searchImpacts() on one document");
+    check(single.searchBatch(vector<string>{"search", "engine"}, INT_MAX)[1].size() == 1,
+          "searchBatch() on one document");
+
+    // Every third document matches; all of them come back, best first
+    const int documentCount = 3000;
+    MiniSearchEngine engine;
+    engine.setImpactOrdering(true);
+    for (int i = 0; i < documentCount; ++i) {
+        string content = "filler text " + to_string(i);
+        if (i % 3 == 0) content += i % 2 ? " match" : " match match";
+        engine.addDocument("Document " + to_string(i), content);
+    }
+    engine.refresh();
+    size_t matches = static_cast<size_t>(documentCount + 2) / 3;
+    vector<SearchResult> all = engine.search("match", INT_MAX, false);
+    check(all.size() == matches, "search() returns every match");
+    bool ordered = true;
+    for (size_t i = 1; i < all.size(); ++i) {
+        ordered = ordered && (all[i - 1].score > all[i].score ||
+                              (all[i - 1].score == all[i].score &&
+                               all[i - 1].documentId < all[i].documentId));
+    }
+    check(ordered, "search() ranks the matches");
+    check(engine.searchIds("match", INT_MAX).size() == matches, "searchIds() returns every match");
+    check(engine.searchBoolean("match -missing", INT_MAX, false).size() == matches,
+          "searchBoolean() returns every match");
+    ImpactSearchOptions exhaustive;
+    exhaustive.withSnippets = false;
+    check(engine.searchImpacts("match", INT_MAX, exhaustive).size() == matches,
+          "searchImpacts() returns every match");
+    engine.setSearchThreads(2, 1);
+    check(engine.search("match", INT_MAX, false).size() == matches,
+          "parallel search() returns every match");
+
+    if (failures == 0) printf("result_limit_test: ok\n");
+    return failures == 0 ? 0 : 1;
+}